@@ -0,0 +1,245 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Module decode library (libpmd-core).
+ *
+ * The functions that turn EEPROM pages into module data, built as a static
+ * library so that the daemon, pmd-bench and offline tools share them:
+ *
+ *  - the serial ID page (SFP+ A0h, QSFP upper page 00h) goes into the
+ *    identity columns of a pm_module_t, with pm_parse()
+ *  - the DOM page (SFP+ A2h, QSFP lower page) goes into the DOM columns and
+ *    the raw-unit dom_sample, with pm_set_a2()
+ *  - pm_build_pm_info() turns both into the pm_info map
+ *
+ * A pm_module_t is the decoded state of one module and the connector type
+ * of the socket it is in. The daemon keeps one in every pm_port_t; other
+ * callers fill in name, connector and pluggable themselves. Nothing here
+ * reads the hardware, opens the database or looks at daemon state, so the
+ * library links against libovscommon alone. The IDL header is only needed
+ * for the pm_info value strings (OVSREC_INTERFACE_PM_INFO_*).
+ ***************************************************************************/
+
+#ifndef _PM_CORE_H_
+#define _PM_CORE_H_
+
+#include <stdbool.h>
+
+#include <smap.h>
+
+#include "plug.h"
+#include "pm_dom.h"
+#include "pm_shm.h"
+
+#define STATIC static
+
+#define MODULE_TYPE_SFP_PLUS    1
+#define MODULE_TYPE_QSFP_PLUS   2
+#define MODULE_TYPE_QSFP28      3
+
+#define CONNECTOR_SFP_PLUS      "SFP_PLUS"
+#define CONNECTOR_QSFP_PLUS     "QSFP_PLUS"
+#define CONNECTOR_QSFP28        "QSFP28"
+
+struct ovs_module_info {
+    /* cable_length column.
+       Length of the cable. NOTE: Only applicable to transceiver with
+       built in cable or the maximum cable length for a transceiver
+       restricted by length. */
+    char    *cable_length;
+
+    /* cable_technology column.
+       Technology of the cable. NOTE: Only applicable to copper cables. */
+    char    *cable_technology;
+
+    /* connector column.
+       Type of connector plugged into the socket. */
+    char    *connector;
+
+    /* connector_status column.
+       Status of the connector to indicate whether it is supported by
+       the h/w platform. */
+    char    *connector_status;
+
+    /* supported_speeds column.
+       List of support speeds. */
+    char    *supported_speeds;
+
+    /* Maximum speed supported by the transceiver, in units of megabits.*/
+    char    *max_speed;
+
+    /* power_mode column.
+       Power mode for pluggable module, i.e. 'low' or 'high'.
+       Typically for QSFP only. */
+    char    *power_mode;
+
+    /*  Vendor name on the module. */
+    char    *vendor_name;
+    /* Vendor Organizationally Unique Identifier (OUI) on the module. */
+    char    *vendor_oui;
+    /* Vendor part number on the module. */
+    char    *vendor_part_number;
+    /* Vendor revision for the module. */
+   char     *vendor_revision;
+    /* Vendor serial number for the module. */
+    char    *vendor_serial_number;
+    /* a0 page.
+       Raw serial ID page for SFPs. Raw lower page for QSFPs.
+       The raw binary data is stored as ASCII characters with space
+       character separating 4 byte words.*/
+    char    *a0;
+    /* a0_uppers[]:
+       Raw upper pages for QSFPs. Indexed by page number.
+       NOTE: Not applicable to SFPs.
+       The raw binary data is stored as ASCII characters with space
+       character separating 4 byte words.*/
+    char    *a0_uppers;
+    /* a2 page.
+       Raw diagnostic page for SFPs. NOTE: Not applicable to QSFPs.
+       The raw binary data is stored as ASCII characters with space
+       character separating 4 byte words.*/
+    char    *a2;
+
+}; /* struct ovs_module_info */
+
+typedef struct {
+    const char *name;                 /* interface name, for log messages */
+    const char *connector;            /* socket type (CONNECTOR_*) from
+                                         ports.yaml, NULL if unknown */
+    bool    pluggable;
+    struct ovs_module_info ovs_module_columns; /* pluggable module data in a
+                                                  form suitable for ovsrec
+                                                  update */
+    struct ovs_module_dom_info ovs_module_dom_columns;
+    bool    module_info_changed;         /* indicates db update is needed */
+    bool    module_dom_changed;          /* indicates DOM db update is
+                                            needed */
+    bool    a2_read_requested;
+    bool    dom_supported;               /* module reports DOM data */
+    bool    optical;
+    pm_dom_sample_t dom_sample;          /* last DOM reading, raw units */
+    bool    dom_sample_valid;
+    bool    dom_sample_stale;            /* the last DOM read failed;
+                                            dom_sample isn't valid until
+                                            one succeeds */
+} pm_module_t;
+
+// macros to manage changes to pluggable module data in ovsrec.
+// Set static string constant.
+#define SET_STATIC_STRING(port, field, value) \
+        port->ovs_module_columns.field = value;    \
+        port->module_info_changed = true;
+
+// Set string pointer using dynamically allocated memory.
+#define SET_STRING(port, field, value) \
+    if (NULL == (port->ovs_module_columns.field) || \
+        strlen(port->ovs_module_columns.field) != strlen(value) || \
+        strcmp(port->ovs_module_columns.field, value) != 0) { \
+        free(port->ovs_module_columns.field); \
+        port->ovs_module_columns.field = strdup(value);    \
+        port->module_info_changed = true;    \
+    }
+
+// Set string pointer converting integer to a string.
+#define SET_INT_STRING(port, field, value) \
+    if (NULL == (port->ovs_module_columns.field) || \
+        strtol(port->ovs_module_columns.field, NULL, 0) != value) { \
+        free(port->ovs_module_columns.field); \
+        asprintf(&port->ovs_module_columns.field, "%d", value); \
+        port->module_info_changed = true;    \
+    }
+
+// Set string pointer converting float to a string.
+// The formatted string is compared, so a value only counts as changed when
+// its published form does.
+// DOM values only mark the DOM data as changed; they are published on
+// their own cadence (see pm_ovsdb_dom_update).
+#define SET_FLOAT_STRING(port, field, value) \
+    do { \
+        char float_str[32]; \
+        snprintf(float_str, sizeof(float_str), "%4.2f", value); \
+        if (NULL == (port->ovs_module_dom_columns.field) || \
+            strcmp(port->ovs_module_dom_columns.field, float_str) != 0) { \
+            free(port->ovs_module_dom_columns.field); \
+            port->ovs_module_dom_columns.field = strdup(float_str); \
+            port->module_dom_changed = true;    \
+        } \
+    } while (0)
+
+#define SET_FLAG_STRING(port, field, value) \
+    if (NULL == (port->ovs_module_dom_columns.field) || \
+        strlen(port->ovs_module_dom_columns.field) != strlen(value) || \
+        strcmp(port->ovs_module_dom_columns.field, value) != 0) { \
+        free(port->ovs_module_dom_columns.field); \
+        port->ovs_module_dom_columns.field = strdup(value);    \
+        port->module_dom_changed = true;    \
+    }
+
+#define SET_BOOL_STRING(port, field, value) \
+    if (value) { \
+        SET_FLAG_STRING(port, field, "On") } \
+    else { \
+        SET_FLAG_STRING(port, field, "Off") }
+
+#define SET_BINARY(port, field, value, size) \
+    do { \
+        free(port->ovs_module_columns.field); \
+        port->ovs_module_columns.field = hex_to_ascii(value, size); \
+        port->module_info_changed = true;                           \
+    } while(0);
+
+// Raw DOM page: kept with the identity data, but only marks DOM changed.
+#define SET_DOM_BINARY(port, field, value, size) \
+    do { \
+        free(port->ovs_module_columns.field); \
+        port->ovs_module_columns.field = hex_to_ascii(value, size); \
+        port->module_dom_changed = true;                            \
+    } while(0);
+
+// macro to delete attributes
+#define DELETE(port, field) \
+    if (NULL != (port->ovs_module_columns.field)) { \
+        port->ovs_module_columns.field = NULL; \
+        port->module_info_changed = true;      \
+    }
+
+#define DELETE_FREE(port, field) \
+    if (NULL != (port->ovs_module_columns.field)) { \
+        free(port->ovs_module_columns.field);       \
+        port->ovs_module_columns.field = NULL; \
+        port->module_info_changed = true;      \
+    }
+
+// identity (pm_detect.c)
+extern int sfpp_sum_verify(unsigned char *serial_datap);
+extern int pm_parse(pm_sfp_serial_id_t *serial_datap, pm_module_t *port);
+extern void pm_delete_all_data(pm_module_t *port);
+extern char *hex_to_ascii(char *buf, int buf_size);
+
+// DOM (pm_dom.c)
+extern void set_a2_read_request(pm_module_t *port,
+                                pm_sfp_serial_id_t *serial_datap);
+extern int pm_set_a2(pm_module_t *port, pm_sfp_dom_t *a2_data);
+extern void pm_delete_all_dom_data(pm_module_t *port);
+
+// pm_info map (pm_info.c)
+extern void pm_build_pm_info(pm_module_t *port, struct smap *pm_info);
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Header file for the ops-pmd latency histograms.
+ ***************************************************************************/
+
+#ifndef _PM_PERF_H_
+#define _PM_PERF_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <dynamic-string.h>
+
+// things that are timed; keep pm_perf_names[] in pm_perf.c in sync
+enum pm_perf_id {
+    // main loop iteration, wakeup to going idle (its flight recorder busy
+    // time): pmd_run plus unixctl, subscriber and metrics work
+    PM_PERF_LOOP,
+
+    // pmd_run phases
+    PM_PERF_RUN,                // whole pmd_run
+    PM_PERF_RECONFIGURE,        // pmd_reconfigure
+    PM_PERF_READ_STATE,         // pm_read_state
+    PM_PERF_OVSDB_UPDATE,       // pm_ovsdb_update, including the commit
+    PM_PERF_DOM_READ,           // pm_read_dom_state
+    PM_PERF_DOM_UPDATE,         // pm_ovsdb_dom_update, including the commit
+
+    // I2C operations
+    PM_PERF_I2C_REG_READ,
+    PM_PERF_I2C_REG_WRITE,
+    PM_PERF_I2C_DATA_READ,
+    PM_PERF_I2C_DATA_WRITE,
+
+    // module insertion/removal, each stage timed from the previous one
+    PM_PERF_STAGE_A0,
+    PM_PERF_STAGE_CHECKSUM,
+    PM_PERF_STAGE_PARSE,
+    PM_PERF_STAGE_A2,
+    PM_PERF_STAGE_PUBLISH,
+    PM_PERF_STAGE_COMMIT,
+    PM_PERF_INSERT,             // presence change to commit acknowledged
+    PM_PERF_REMOVE,
+
+    // OVSDB commits that wrote something (not TXN_UNCHANGED)
+    PM_PERF_COMMIT_IDENTITY,
+    PM_PERF_COMMIT_DOM,
+
+    PM_PERF_N_IDS
+};
+
+// monotonic time in microseconds
+static inline uint64_t
+pm_perf_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+extern void pm_perf_record(enum pm_perf_id id, uint64_t usecs);
+extern void pm_perf_reset(void);
+extern void pm_perf_dump(struct ds *ds);
+extern void pm_perf_metrics(struct ds *ds);
+
+// record the time elapsed since start, a value returned by pm_perf_now()
+static inline void
+pm_perf_end(enum pm_perf_id id, uint64_t start)
+{
+    pm_perf_record(id, pm_perf_now() - start);
+}
+
+// same as pm_perf_end, for a pmd_run phase (PM_PERF_RECONFIGURE ..
+// PM_PERF_DOM_UPDATE); the time is also charged to the current main loop
+// iteration in the flight recorder
+extern void pm_loop_phase_end(enum pm_perf_id id, uint64_t start);
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Shared-memory snapshot of pluggable module state.
+ *
+ * ops-pmd publishes one fixed-layout record per managed port into the POSIX
+ * shared-memory segment PM_SHM_NAME. Local consumers (thermal/fan control,
+ * inventory agents, ...) can map it read-only and read module state without
+ * going through OVSDB.
+ *
+ * Each record is protected by a sequence lock: the writer makes the sequence
+ * number odd while it updates the record and even again when it is done. A
+ * reader copies the record and retries if the sequence number was odd or
+ * changed during the copy. pm_shm_read_port() does this for you.
+ *
+ * This header has no dependencies beyond libc (link with -lrt on older
+ * glibc) and is installed for use by other daemons.
+ *
+ * Layout changes must bump PM_SHM_VERSION.
+ ***************************************************************************/
+
+#ifndef _PM_SHM_H_
+#define _PM_SHM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PM_SHM_NAME             "/ops-pmd"
+#define PM_SHM_MAGIC            0x504d4453  // "PMDS"
+#define PM_SHM_VERSION          1
+#define PM_SHM_MAX_PORTS        1024
+
+#define PM_SHM_NAME_LEN         32
+#define PM_SHM_CONNECTOR_LEN    16
+#define PM_SHM_VENDOR_LEN       20
+#define PM_SHM_OUI_LEN          12
+#define PM_SHM_REVISION_LEN     8
+
+// bounded so that a writer that died mid-update can't hang a reader
+#define PM_SHM_READ_RETRIES     10000
+
+// record flags
+#define PM_SHM_F_IN_USE         0x0001  // slot is assigned to a port
+#define PM_SHM_F_PRESENT        0x0002  // a module is inserted
+#define PM_SHM_F_DOM_VALID      0x0004  // dom holds a valid sample
+#define PM_SHM_F_HW_ENABLE      0x0008  // port is administratively enabled
+#define PM_SHM_F_OPTICAL        0x0010  // module is an optical transceiver
+#define PM_SHM_F_READ_ERROR     0x0020  // last module read failed, retrying
+#define PM_SHM_F_DOM_STALE      0x0040  // last DOM read failed; no valid dom
+
+// DOM alarm/warning flag bits: PM_DOM_FLAG(PM_DOM_TEMP, PM_DOM_HIGH_ALARM)
+#define PM_DOM_TEMP             0
+#define PM_DOM_VCC              1
+#define PM_DOM_TX_BIAS          2
+#define PM_DOM_TX_POWER         3
+#define PM_DOM_RX_POWER         4
+
+#define PM_DOM_HIGH_ALARM       0
+#define PM_DOM_LOW_ALARM        1
+#define PM_DOM_HIGH_WARNING     2
+#define PM_DOM_LOW_WARNING      3
+
+#define PM_DOM_FLAG(measure, kind)  (1u << ((measure) * 4 + (kind)))
+
+#define PM_DOM_MAX_LANES        4
+
+// DOM sample, in the raw units defined by SFF-8472 (SFP+) and SFF-8636
+// (QSFP). SFP+ modules only report lane 0. QSFP lane alarm/warning flags are
+// or-ed together into flags.
+typedef struct pm_dom_sample {
+    int16_t     temperature;                    // 1/256 degrees C
+    uint16_t    vcc;                            // 100 uV
+    uint16_t    tx_bias[PM_DOM_MAX_LANES];      // 2 uA
+    uint16_t    tx_power[PM_DOM_MAX_LANES];     // 0.1 uW
+    uint16_t    rx_power[PM_DOM_MAX_LANES];     // 0.1 uW
+    uint16_t    n_lanes;
+    uint32_t    flags;                          // PM_DOM_FLAG() bits
+} pm_dom_sample_t;
+
+struct pm_shm_header {
+    uint32_t    magic;                  // PM_SHM_MAGIC
+    uint32_t    version;                // PM_SHM_VERSION
+    uint32_t    header_size;            // offset of the first record
+    uint32_t    record_size;            // stride between records
+    uint32_t    max_ports;              // number of record slots
+    uint32_t    writer_pid;             // 0 once ops-pmd has exited
+    uint64_t    generation;             // bumped when a slot is (re)assigned
+};
+
+struct pm_shm_port {
+    uint32_t    seq;                    // sequence lock, odd while updating
+    uint32_t    flags;                  // PM_SHM_F_*
+    int64_t     update_time;            // wall clock msecs of last update
+    int64_t     dom_time;               // wall clock msecs of the DOM sample
+    char        name[PM_SHM_NAME_LEN];  // interface name
+    char        connector[PM_SHM_CONNECTOR_LEN];    // pm_info connector
+    char        vendor_name[PM_SHM_VENDOR_LEN];
+    char        vendor_oui[PM_SHM_OUI_LEN];
+    char        vendor_part_number[PM_SHM_VENDOR_LEN];
+    char        vendor_revision[PM_SHM_REVISION_LEN];
+    char        vendor_serial_number[PM_SHM_VENDOR_LEN];
+    uint32_t    max_speed;              // Mb/s
+    uint32_t    module_type;            // 1 SFP+, 2 QSFP+, 3 QSFP28
+    pm_dom_sample_t dom;
+};
+
+/*
+ * pm_shm_attach: map an ops-pmd segment read-only
+ *
+ * input: segment name (PM_SHM_NAME unless ops-pmd runs with --shm-name),
+ *        where to store the size of the mapping
+ *
+ * output: pointer to the segment header, NULL if it is missing or has an
+ *         incompatible layout
+ */
+static inline const struct pm_shm_header *
+pm_shm_attach(const char *name, size_t *size)
+{
+    const struct pm_shm_header *hdr;
+    struct stat st;
+    void *addr;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*hdr)) {
+        close(fd);
+        return NULL;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == addr) {
+        return NULL;
+    }
+
+    hdr = (const struct pm_shm_header *)addr;
+    if (PM_SHM_MAGIC != hdr->magic || PM_SHM_VERSION != hdr->version ||
+        hdr->record_size < sizeof(struct pm_shm_port) ||
+        (uint64_t)st.st_size <
+            hdr->header_size + (uint64_t)hdr->max_ports * hdr->record_size) {
+        munmap(addr, st.st_size);
+        return NULL;
+    }
+
+    *size = st.st_size;
+    return hdr;
+}
+
+/*
+ * pm_shm_detach: unmap a segment returned by pm_shm_attach
+ *
+ * input: segment header, size returned by pm_shm_attach
+ */
+static inline void
+pm_shm_detach(const struct pm_shm_header *hdr, size_t size)
+{
+    munmap((void *)hdr, size);
+}
+
+/*
+ * pm_shm_read_port: take a consistent copy of one record
+ *
+ * input: segment header, slot number, buffer for the copy
+ *
+ * output: true if the copy is consistent and the slot is in use
+ */
+static inline bool
+pm_shm_read_port(const struct pm_shm_header *hdr, unsigned int slot,
+                 struct pm_shm_port *port)
+{
+    const struct pm_shm_port *rec;
+    uint32_t seq;
+    int retries;
+
+    if (slot >= hdr->max_ports) {
+        return false;
+    }
+
+    rec = (const struct pm_shm_port *)
+              ((const char *)hdr + hdr->header_size +
+               (size_t)slot * hdr->record_size);
+
+    for (retries = 0; retries < PM_SHM_READ_RETRIES; retries++) {
+        seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+
+        memcpy(port, rec, sizeof(*port));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) == seq) {
+            return (port->flags & PM_SHM_F_IN_USE) != 0;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * pm_shm_find_port: take a consistent copy of the record for an interface
+ *
+ * input: segment header, interface name, buffer for the copy
+ *
+ * output: slot number, or -1 if the interface has no record
+ *
+ * Slots only move when the header generation changes, so callers that poll
+ * can cache the slot number and only look it up again when it does.
+ */
+static inline int
+pm_shm_find_port(const struct pm_shm_header *hdr, const char *name,
+                 struct pm_shm_port *port)
+{
+    unsigned int slot;
+
+    for (slot = 0; slot < hdr->max_ports; slot++) {
+        if (pm_shm_read_port(hdr, slot, port) &&
+            strncmp(port->name, name, PM_SHM_NAME_LEN) == 0) {
+            return (int)slot;
+        }
+    }
+
+    return -1;
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Header file for the ops-pmd static tracepoints.
+ *
+ * When the build finds <sys/sdt.h>, each PM_TRACE* call is a USDT probe of
+ * provider "ops_pmd" with a semaphore: until a tracer attaches, the probe
+ * is a test of that semaphore and its arguments (e.g. elapsed times) are
+ * not computed. Without sdt.h the calls compile to nothing. Include this
+ * after pmd.h, which carries HAVE_SYS_SDT_H.
+ *
+ * Probes (strings are port and bus names, usecs are elapsed microseconds):
+ *
+ *      presence        (port, present)
+ *      a0_read_start   (port, bus)
+ *      a0_read_end     (port, bus, rc, usecs)
+ *      a2_read_start   (port, bus)
+ *      a2_read_end     (port, bus, rc, usecs)
+ *      checksum_fail   (port, retries_left)
+ *      parse           (port, rc)
+ *      reset           (port, set, rc)
+ *      tx_enable       (port, disable_mask, rc)
+ *      commit_start    (dom)
+ *      commit_end      (dom, status, usecs)
+ *
+ * e.g. bpftrace -e 'usdt:/usr/bin/ops-pmd:ops_pmd:a0_read_end
+ *                   { @[str(arg0)] = hist(arg3); }'
+ ***************************************************************************/
+
+#ifndef _PM_TRACE_H_
+#define _PM_TRACE_H_
+
+// every probe, for the semaphores (src/pm_trace.c)
+#define PM_TRACE_PROBES(X)                                                  \
+    X(presence) X(a0_read_start) X(a0_read_end) X(a2_read_start)            \
+    X(a2_read_end) X(checksum_fail) X(parse) X(reset) X(tx_enable)          \
+    X(commit_start) X(commit_end)
+
+#ifdef HAVE_SYS_SDT_H
+
+// a tracer attaching to a probe bumps its semaphore; until then the probe
+// is skipped along with its arguments
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define PM_TRACE_SEMAPHORE(name)                                            \
+    __extension__ extern unsigned short ops_pmd_##name##_semaphore          \
+        __attribute__((unused)) __attribute__((section(".probes")));
+PM_TRACE_PROBES(PM_TRACE_SEMAPHORE)
+
+#define PM_TRACE_ENABLED(name)                                              \
+    __builtin_expect(ops_pmd_##name##_semaphore, 0)
+
+#define PM_TRACE1(name, a)                                                  \
+    do {                                                                    \
+        if (PM_TRACE_ENABLED(name)) {                                       \
+            DTRACE_PROBE1(ops_pmd, name, a);                                \
+        }                                                                   \
+    } while (0)
+#define PM_TRACE2(name, a, b)                                               \
+    do {                                                                    \
+        if (PM_TRACE_ENABLED(name)) {                                       \
+            DTRACE_PROBE2(ops_pmd, name, a, b);                             \
+        }                                                                   \
+    } while (0)
+#define PM_TRACE3(name, a, b, c)                                            \
+    do {                                                                    \
+        if (PM_TRACE_ENABLED(name)) {                                       \
+            DTRACE_PROBE3(ops_pmd, name, a, b, c);                          \
+        }                                                                   \
+    } while (0)
+#define PM_TRACE4(name, a, b, c, d)                                         \
+    do {                                                                    \
+        if (PM_TRACE_ENABLED(name)) {                                       \
+            DTRACE_PROBE4(ops_pmd, name, a, b, c, d);                       \
+        }                                                                   \
+    } while (0)
+
+#else
+
+#define PM_TRACE_ENABLED(name) 0
+
+// arguments are never evaluated, but still "used" so that values computed
+// only for a probe don't trip -Werror
+#define PM_TRACE1(name, a)                                                  \
+    do { if (0) { (void)(a); } } while (0)
+#define PM_TRACE2(name, a, b)                                               \
+    do { if (0) { (void)(a); (void)(b); } } while (0)
+#define PM_TRACE3(name, a, b, c)                                            \
+    do { if (0) { (void)(a); (void)(b); (void)(c); } } while (0)
+#define PM_TRACE4(name, a, b, c, d)                                         \
+    do { if (0) { (void)(a); (void)(b); (void)(c); (void)(d); } } while (0)
+
+#endif
+
+#endif
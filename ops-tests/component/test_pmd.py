@@ -174,6 +174,53 @@ def _test_insert_remove_module(interface, dataset, sw1):
         assert pm_info["connector_status"] == "unrecognized"
 
 
+def _test_json_dump(interface, module, sw1):
+    insert_pluggable(interface, module, sw1)
+    pm_info = get_interface(interface, sw1)
+    out = sw1("ovs-appctl -t ops-pmd ops-pmd/dump --json {}"
+              "".format(interface), shell='bash')
+    state = loads(out)
+    assert list(state["interfaces"].keys()) == [interface]
+    port = state["interfaces"][interface]
+    assert port["present"] is True
+    for attribute in port["identity"]:
+        if port["identity"][attribute] is not None:
+            assert port["identity"][attribute] == pm_info[attribute]
+    remove_pluggable(interface, sw1)
+    state = loads(sw1("ovs-appctl -t ops-pmd ops-pmd/dump --json",
+                      shell='bash'))
+    assert state["interfaces"][interface]["present"] is False
+
+
+def _test_sim_dom(interface, module, sw1):
+    insert_pluggable(interface, module, sw1)
+    sw1("ovs-appctl -t ops-pmd ops-pmd/sim {} dom temperature=45.5 "
+        "rx-power=0.02".format(interface), shell='bash')
+    # DOM is refreshed every 10 seconds
+    time.sleep(11)
+    state = loads(sw1("ovs-appctl -t ops-pmd ops-pmd/dump --json {}"
+                      "".format(interface), shell='bash'))
+    dom = state["interfaces"][interface]["dom"]
+    assert dom["temperature"] == 45.5
+    assert dom["rx_power"] == [0.02]
+    remove_pluggable(interface, sw1)
+
+
+def _test_sim_play(interface, scenario, sw1):
+    copy("SFP_SR_AVAGO.bin", sw1.shared_dir)
+    copy(scenario, sw1.shared_dir)
+    sw1("ovs-appctl -t ops-pmd ops-pmd/sim play /tmp/{}"
+        "".format(scenario), shell='bash')
+    # the last event is 2 seconds in
+    time.sleep(4)
+    out = sw1("ovs-appctl -t ops-pmd ops-pmd/sim play", shell='bash')
+    assert "state: done" in out
+    assert "events: 5 of 5 (0 skipped by chance, 0 failed)" in out
+    pm_info = get_interface(interface, sw1)
+    assert pm_info["connector"] == "SFP_SR"
+    remove_pluggable(interface, sw1)
+
+
 def test_pmd(topology, step):
     sw1 = topology.get("sw1")
     step("1-Testing initial conditions\n")
@@ -196,3 +243,9 @@ def test_pmd(topology, step):
     _test_insert_remove_module(sfp_interface, sfp_files, sw1)
     step("3-Testing module insertion/removal of QSFP+s\n")
     _test_insert_remove_module(qsfp_interface, qsfp_files, sw1)
+    step("4-Testing the JSON state dump\n")
+    _test_json_dump(sfp_interface, "SFP_SR_AVAGO.bin", sw1)
+    step("5-Testing the simulated DOM\n")
+    _test_sim_dom(sfp_interface, "SFP_SR_AVAGO.bin", sw1)
+    step("6-Testing simulator scenario playback\n")
+    _test_sim_play(sfp_interface, "flap.scenario", sw1)
@@ -73,6 +73,32 @@ pm_get_yaml_port(const char *subsystem, const char *instance)
     return(NULL);
 }
 
+/*
+ * pm_add_pluggable_ports: add the names of all pluggable ports of a
+ *                         subsystem to a port name -> subsystem name map
+ *
+ * input: subsystem name, map to add to
+ *
+ * output: none
+ */
+void
+pm_add_pluggable_ports(const char *subsystem, struct shash *ports)
+{
+    size_t          count;
+    size_t          idx;
+    const YamlPort *yaml_port;
+
+    count = yaml_get_port_count(global_yaml_handle, subsystem);
+
+    for (idx = 0; idx < count; idx++) {
+        yaml_port = yaml_get_port(global_yaml_handle, subsystem, idx);
+
+        if (yaml_port->pluggable) {
+            shash_add_once(ports, yaml_port->name, subsystem);
+        }
+    }
+}
+
 /*
  * pm_create_a2_devices: create implied a2 devices for sfpp modules
  *
@@ -29,15 +29,21 @@
 
 #include "config-yaml.h"
 
+#include <coverage.h>
 #include <dynamic-string.h>
 #include <vswitch-idl.h>
 #include <openswitch-idl.h>
 
 #include "pmd.h"
 #include "pm_dom.h"
+#include "pm_core.h"
+#include "pm_perf.h"
+#include "pm_trace.h"
 
 VLOG_DEFINE_THIS_MODULE(ovsdb_access);
 
+COVERAGE_DEFINE(pmd_reconfigure);
+
 struct ovsdb_idl *idl;
 
 static unsigned int idl_seqno;
@@ -49,6 +55,39 @@ static bool cur_hw_set = false;
 struct shash ovs_intfs;
 struct shash ovs_subs;
 
+// ovs_subs data: a known subsystem and the interface references of its row
+// that have already been processed, sorted by uuid
+struct pm_subsys {
+    struct uuid uuid;
+    struct uuid *intfs;
+    size_t n_intfs;
+};
+
+// pm_port_t entries from ovs_intfs, indexed by Interface row uuid so that
+// tracked (changed) rows can be matched without walking every port.
+static struct hmap ovs_intfs_by_uuid;
+
+// Names of the pluggable ports of every known subsystem, mapped to the
+// name of the subsystem they belong to. Used to build the Interface
+// monitor condition and to attach Interface rows that are replicated
+// after their subsystem has been processed.
+static struct shash ovs_pluggable_intfs;
+
+static pm_port_t *
+ovsdb_if_intf_find(const struct uuid *uuid)
+{
+    pm_port_t *port;
+
+    HMAP_FOR_EACH_WITH_HASH(port, uuid_node, uuid_hash(uuid),
+                            &ovs_intfs_by_uuid) {
+        if (uuid_equals(&port->uuid, uuid)) {
+            return port;
+        }
+    }
+
+    return NULL;
+}
+
 static bool
 ovsdb_if_intf_get_hw_enable(const struct ovsrec_interface *intf)
 {
@@ -99,14 +138,21 @@ ovsdb_if_intf_create(const struct ovsrec_interface *intf, const char *sub_name)
     port->hw_enable = ovsdb_if_intf_get_hw_enable(intf);
 
     port->module_device = yaml_port;
+    port->module.name = port->instance;
+    port->module.connector = yaml_port->connector;
+    port->module.pluggable = yaml_port->pluggable;
 
     // mark it as absent, first, so it will be processed at least once
     port->present = false;
 
     port->retry = false;
 
+    pm_dom_history_init(port);
+
     // add the port to the ovs_intfs shash, with the instance as the key
     shash_add(&ovs_intfs, port->instance, (void *)port);
+    hmap_insert(&ovs_intfs_by_uuid, &port->uuid_node, uuid_hash(&port->uuid));
+    pm_shm_port_add(port);
 
     VLOG_DBG("pm_port instance (%s) added", instance);
 
@@ -134,6 +180,7 @@ ovsdb_if_intf_modify(const struct ovsrec_interface *intf, pm_port_t *port)
 
         // apply any port enable changes
         pm_configure_port(port);
+        pm_shm_port_update(port);
     }
 }
 
@@ -151,19 +198,64 @@ ovsdb_if_intf_configure(const struct ovsrec_interface *intf)
     }
 }
 
+/*
+ * ovsdb_if_pluggable_intfs_update: rebuild the pluggable port map from the
+ *                                  YAML data of the known subsystems and
+ *                                  narrow Interface monitoring to it.
+ */
+static void
+ovsdb_if_pluggable_intfs_update(void)
+{
+    struct shash_node *node;
+
+    shash_clear(&ovs_pluggable_intfs);
+
+    SHASH_FOR_EACH(node, &ovs_subs) {
+        pm_add_pluggable_ports(node->name, &ovs_pluggable_intfs);
+    }
+
+#ifdef HAVE_OVSDB_IDL_SET_CONDITION
+    {
+        struct ovsdb_idl_condition cond;
+
+        // Only replicate the Interface rows of pluggable ports; internal,
+        // bridge and fixed ports are never sent to ops-pmd.
+        ovsdb_idl_condition_init(&cond);
+        SHASH_FOR_EACH(node, &ovs_pluggable_intfs) {
+            ovsrec_interface_add_clause_name(&cond, OVSDB_F_EQ, node->name);
+        }
+        ovsrec_interface_set_condition(idl, &cond);
+        ovsdb_idl_condition_destroy(&cond);
+    }
+#endif
+}
+
+static int
+ovsdb_if_intf_uuid_cmp(const void *a_, const void *b_)
+{
+    const struct ovsrec_interface *const *a = a_;
+    const struct ovsrec_interface *const *b = b_;
+
+    return uuid_compare_3way(&(*a)->header_.uuid, &(*b)->header_.uuid);
+}
+
 static void
 ovsdb_if_subsys_process(const struct ovsrec_subsystem *ovs_sub)
 {
-    int i;
+    const struct ovsrec_interface **intfs;
+    struct pm_subsys *sub;
+    size_t n_intfs;
+    size_t i;
+    size_t j;
     int rc;
     struct shash_node *node;
 
     node = shash_find(&ovs_subs, ovs_sub->name);
     if (node == NULL) {
         // add the subsystem to the shash
-        struct uuid *uuid = (struct uuid *) calloc(sizeof(struct uuid), 1);
-        memcpy(uuid, &ovs_sub->header_.uuid, sizeof(ovs_sub->header_.uuid));
-        shash_add(&ovs_subs, ovs_sub->name, (void *)uuid);
+        sub = xzalloc(sizeof(*sub));
+        sub->uuid = ovs_sub->header_.uuid;
+        shash_add(&ovs_subs, ovs_sub->name, sub);
 
         // read the needed YAML system definition files for this subsystem
         rc = pm_read_yaml_files(ovs_sub);
@@ -172,39 +264,58 @@ ovsdb_if_subsys_process(const struct ovsrec_subsystem *ovs_sub)
                      ovs_sub->name, rc);
             return;
         }
+
+        ovsdb_if_pluggable_intfs_update();
+    } else {
+        sub = node->data;
     }
 
-    // make sure that all of the interfaces that are present in the subsystem
-    // are created
+    // create the interfaces added to the subsystem since it was last seen:
+    // with both lists sorted by uuid, one pass over them finds the new
+    // references without looking up the ones already processed
+    n_intfs = ovs_sub->n_interfaces;
+    intfs = xmemdup(ovs_sub->interfaces, n_intfs * sizeof(*intfs));
+    qsort(intfs, n_intfs, sizeof(*intfs), ovsdb_if_intf_uuid_cmp);
 
-    for (i = 0; i < ovs_sub->n_interfaces; i++) {
-        const struct ovsrec_interface *intf;
+    j = 0;
+    for (i = 0; i < n_intfs; i++) {
+        const struct uuid *uuid = &intfs[i]->header_.uuid;
 
-        intf = ovs_sub->interfaces[i];
-        node = shash_find(&ovs_intfs, intf->name);
-        if (node == NULL) {
-            ovsdb_if_intf_create(intf, ovs_sub->name);
+        while (j < sub->n_intfs &&
+               uuid_compare_3way(&sub->intfs[j], uuid) < 0) {
+            j++;
+        }
+        if (j < sub->n_intfs && uuid_equals(&sub->intfs[j], uuid)) {
+            continue;
+        }
+        if (NULL == shash_find(&ovs_intfs, intfs[i]->name)) {
+            ovsdb_if_intf_create(intfs[i], ovs_sub->name);
         }
     }
+
+    sub->intfs = xrealloc(sub->intfs, n_intfs * sizeof(*sub->intfs));
+    for (i = 0; i < n_intfs; i++) {
+        sub->intfs[i] = intfs[i]->header_.uuid;
+    }
+    sub->n_intfs = n_intfs;
+    free(intfs);
 }
 
-void
-pm_ovsdb_update(void)
+/*
+ * pm_ovsdb_publish: write pm_info into the current transaction for every
+ *                   port with pending identity (or, if dom is set, DOM)
+ *                   changes
+ */
+static void
+pm_ovsdb_publish(bool dom)
 {
-    struct ovsdb_idl_txn *txn;
     const struct ovsrec_interface *intf;
-    const struct ovsrec_daemon *db_daemon;
     pm_port_t   *port = NULL;
     struct shash_node *node;
 
-    txn = ovsdb_idl_txn_create(idl);
-
-    // Loop through all interfaces and update pluggable module
-    // info in the database if necessary.
     SHASH_FOR_EACH(node, &ovs_intfs) {
-        struct ovs_module_info *module;
-        struct ovs_module_dom_info *module_dom;
         struct smap pm_info;
+        bool changed;
 
         port = (pm_port_t *)node->data;
 
@@ -213,443 +324,64 @@ pm_ovsdb_update(void)
             continue;
         }
 
-        intf = ovsrec_interface_get_for_uuid(idl, &port->uuid);
-        if (NULL == intf) {
-            VLOG_ERR("No DB entry found for hw interface %s\n",
-                     port->instance);
-            continue;
-        }
-        if (false == port->module_info_changed) {
+        changed = dom ? port->module.module_dom_changed :
+                        port->module.module_info_changed;
+        if (false == changed) {
             continue;
         }
 
-        module = &port->ovs_module_columns;
-        // Set pm_info map
-        smap_init(&pm_info);
-        if (module->cable_length) {
-            smap_add(&pm_info, "cable_length", module->cable_length);
-        }
-        if (module->cable_technology) {
-            smap_add(&pm_info, "cable_technology", module->cable_technology);
-        }
-        if (module->connector) {
-            smap_add(&pm_info, "connector", module->connector);
-        }
-        if (module->connector_status) {
-            smap_add(&pm_info, "connector_status", module->connector_status);
-        }
-        if (module->supported_speeds) {
-            smap_add(&pm_info, "supported_speeds", module->supported_speeds);
-        }
-        if (module->max_speed) {
-            smap_add(&pm_info, "max_speed", module->max_speed);
-        }
-        if (module->power_mode) {
-            smap_add(&pm_info, "power_mode", module->power_mode);
-        }
-        if (module->vendor_name) {
-            smap_add(&pm_info, "vendor_name", module->vendor_name);
-        }
-        if (module->vendor_oui) {
-            smap_add(&pm_info, "vendor_oui", module->vendor_oui);
-        }
-        if (module->vendor_part_number) {
-            smap_add(&pm_info, "vendor_part_number",
-                     module->vendor_part_number);
-        }
-        if (module->vendor_revision) {
-            smap_add(&pm_info, "vendor_revision", module->vendor_revision);
-        }
-        if (module->vendor_serial_number) {
-            smap_add(&pm_info, "vendor_serial_number",
-                     module->vendor_serial_number);
-        }
-
-        // Update diagnostics key values
-        module_dom = &port->ovs_module_dom_columns;
-
-        if (module_dom->temperature) {
-            smap_add(&pm_info, "temperature", module_dom->temperature);
-        }
-        if (module_dom->temperature_high_alarm) {
-            smap_add(&pm_info, "temperature_high_alarm", module_dom->temperature_high_alarm);
-        }
-        if (module_dom->temperature_low_alarm) {
-            smap_add(&pm_info, "temperature_low_alarm", module_dom->temperature_low_alarm);
-        }
-        if (module_dom->temperature_high_warning) {
-            smap_add(&pm_info, "temperature_high_warning", module_dom->temperature_high_warning);
-        }
-        if (module_dom->temperature_low_warning) {
-            smap_add(&pm_info, "temperature_low_warning", module_dom->temperature_low_warning);
-        }
-        if (module_dom->temperature_high_alarm_threshold) {
-            smap_add(&pm_info, "temperature_high_alarm_threshold", module_dom->temperature_high_alarm_threshold);
-        }
-        if (module_dom->temperature_low_alarm_threshold) {
-            smap_add(&pm_info, "temperature_low_alarm_threshold", module_dom->temperature_low_alarm_threshold);
-        }
-        if (module_dom->temperature_high_warning_threshold) {
-            smap_add(&pm_info, "temperature_high_warning_threshold", module_dom->temperature_high_warning_threshold);
-        }
-        if (module_dom->temperature_low_warning_threshold) {
-            smap_add(&pm_info, "temperature_low_warning_threshold", module_dom->temperature_low_warning_threshold);
-        }
-
-        if (module_dom->vcc) {
-            smap_add(&pm_info, "vcc", module_dom->vcc);
-        }
-        if (module_dom->vcc_high_alarm) {
-            smap_add(&pm_info, "vcc_high_alarm", module_dom->vcc_high_alarm);
-        }
-        if (module_dom->vcc_low_alarm) {
-            smap_add(&pm_info, "vcc_low_alarm", module_dom->vcc_low_alarm);
-        }
-        if (module_dom->vcc_high_warning) {
-            smap_add(&pm_info, "vcc_high_warning", module_dom->vcc_high_warning);
-        }
-        if (module_dom->vcc_low_warning) {
-            smap_add(&pm_info, "vcc_low_warning", module_dom->vcc_low_warning);
-        }
-        if (module_dom->vcc_high_alarm_threshold) {
-            smap_add(&pm_info, "vcc_high_alarm_threshold", module_dom->vcc_high_alarm_threshold);
-        }
-        if (module_dom->vcc_low_alarm_threshold) {
-            smap_add(&pm_info, "vcc_low_alarm_threshold", module_dom->vcc_low_alarm_threshold);
-        }
-        if (module_dom->vcc_high_warning_threshold) {
-            smap_add(&pm_info, "vcc_high_warning_threshold", module_dom->vcc_high_warning_threshold);
-        }
-        if (module_dom->vcc_low_warning_threshold) {
-            smap_add(&pm_info, "vcc_low_warning_threshold", module_dom->vcc_low_warning_threshold);
-        }
+        pm_loop_note_dirty();
 
-        if (module_dom->tx_bias) {
-            smap_add(&pm_info, "tx_bias", module_dom->tx_bias);
-        }
-        if (module_dom->tx_bias_high_alarm) {
-            smap_add(&pm_info, "tx_bias_high_alarm", module_dom->tx_bias_high_alarm);
-        }
-        if (module_dom->tx_bias_low_alarm) {
-            smap_add(&pm_info, "tx_bias_low_alarm", module_dom->tx_bias_low_alarm);
-        }
-        if (module_dom->tx_bias_high_warning) {
-            smap_add(&pm_info, "tx_bias_high_warning", module_dom->tx_bias_high_warning);
-        }
-        if (module_dom->tx_bias_low_warning) {
-            smap_add(&pm_info, "tx_bias_low_warning", module_dom->tx_bias_low_warning);
-        }
-        if (module_dom->tx_bias_high_alarm_threshold) {
-            smap_add(&pm_info, "tx_bias_high_alarm_threshold", module_dom->tx_bias_high_alarm_threshold);
-        }
-        if (module_dom->tx_bias_low_alarm_threshold) {
-            smap_add(&pm_info, "tx_bias_low_alarm_threshold", module_dom->tx_bias_low_alarm_threshold);
-        }
-        if (module_dom->tx_bias_high_warning_threshold) {
-            smap_add(&pm_info, "tx_bias_high_warning_threshold", module_dom->tx_bias_high_warning_threshold);
-        }
-        if (module_dom->tx_bias_low_warning_threshold) {
-            smap_add(&pm_info, "tx_bias_low_warning_threshold", module_dom->tx_bias_low_warning_threshold);
+        // local consumers see the change before it reaches the database
+        pm_shm_port_update(port);
+        if (false == dom) {
+            pm_sub_module_event(port);
+            pm_latency_stage(port, PM_LATENCY_PUBLISH);
         }
 
-        if (module_dom->rx_power) {
-            smap_add(&pm_info, "rx_power", module_dom->rx_power);
-        }
-        if (module_dom->rx_power_high_alarm) {
-            smap_add(&pm_info, "rx_power_high_alarm", module_dom->rx_power_high_alarm);
-        }
-        if (module_dom->rx_power_low_alarm) {
-            smap_add(&pm_info, "rx_power_low_alarm", module_dom->rx_power_low_alarm);
-        }
-        if (module_dom->rx_power_high_warning) {
-            smap_add(&pm_info, "rx_power_high_warning", module_dom->rx_power_high_warning);
-        }
-        if (module_dom->rx_power_low_warning) {
-            smap_add(&pm_info, "rx_power_low_warning", module_dom->rx_power_low_warning);
-        }
-        if (module_dom->rx_power_high_alarm_threshold) {
-            smap_add(&pm_info, "rx_power_high_alarm_threshold", module_dom->rx_power_high_alarm_threshold);
-        }
-        if (module_dom->rx_power_low_alarm_threshold) {
-            smap_add(&pm_info, "rx_power_low_alarm_threshold", module_dom->rx_power_low_alarm_threshold);
-        }
-        if (module_dom->rx_power_high_warning_threshold) {
-            smap_add(&pm_info, "rx_power_high_warning_threshold", module_dom->rx_power_high_warning_threshold);
-        }
-        if (module_dom->rx_power_low_warning_threshold) {
-            smap_add(&pm_info, "rx_power_low_warning_threshold", module_dom->rx_power_low_warning_threshold);
-        }
-
-        if (module_dom->tx_power) {
-            smap_add(&pm_info, "tx_power", module_dom->tx_power);
-        }
-        if (module_dom->rx_power_high_alarm) {
-            smap_add(&pm_info, "tx_power_high_alarm", module_dom->tx_power_high_alarm);
-        }
-        if (module_dom->tx_power_low_alarm) {
-            smap_add(&pm_info, "tx_power_low_alarm", module_dom->tx_power_low_alarm);
-        }
-        if (module_dom->tx_power_high_warning) {
-            smap_add(&pm_info, "tx_power_high_warning", module_dom->tx_power_high_warning);
-        }
-        if (module_dom->tx_power_low_warning) {
-            smap_add(&pm_info, "tx_power_low_warning", module_dom->tx_power_low_warning);
-        }
-        if (module_dom->tx_power_high_alarm_threshold) {
-            smap_add(&pm_info, "tx_power_high_alarm_threshold", module_dom->tx_power_high_alarm_threshold);
-        }
-        if (module_dom->tx_power_low_alarm_threshold) {
-            smap_add(&pm_info, "tx_power_low_alarm_threshold", module_dom->tx_power_low_alarm_threshold);
-        }
-        if (module_dom->tx_power_high_warning_threshold) {
-            smap_add(&pm_info, "tx_power_high_warning_threshold", module_dom->tx_power_high_warning_threshold);
-        }
-        if (module_dom->tx_power_low_warning_threshold) {
-            smap_add(&pm_info, "tx_power_low_warning_threshold", module_dom->tx_power_low_warning_threshold);
-        }
-
-
-
-        if (module_dom->tx1_bias) {
-            smap_add(&pm_info, "tx1_bias", module_dom->tx1_bias);
-        }
-        if (module_dom->rx1_power) {
-            smap_add(&pm_info, "rx1_power", module_dom->rx1_power);
-        }
-
-        if (module_dom->tx1_bias_high_alarm) {
-            smap_add(&pm_info, "tx1_bias_high_alarm", module_dom->tx1_bias_high_alarm);
-        }
-        if (module_dom->tx1_bias_low_alarm) {
-            smap_add(&pm_info, "tx1_bias_low_alarm", module_dom->tx1_bias_low_alarm);
-        }
-        if (module_dom->tx1_bias_high_warning) {
-            smap_add(&pm_info, "tx1_bias_high_warning", module_dom->tx1_bias_high_warning);
-        }
-        if (module_dom->tx1_bias_low_warning) {
-            smap_add(&pm_info, "tx1_bias_low_warning", module_dom->tx1_bias_low_warning);
-        }
-        if (module_dom->tx1_bias_high_alarm_threshold) {
-            smap_add(&pm_info, "tx1_bias_high_alarm_threshold", module_dom->tx1_bias_high_alarm_threshold);
-        }
-        if (module_dom->tx1_bias_low_alarm_threshold) {
-            smap_add(&pm_info, "tx1_bias_low_alarm_threshold", module_dom->tx1_bias_low_alarm_threshold);
-        }
-        if (module_dom->tx1_bias_high_warning_threshold) {
-            smap_add(&pm_info, "tx1_bias_high_warning_threshold", module_dom->tx1_bias_high_warning_threshold);
-        }
-        if (module_dom->tx1_bias_low_warning_threshold) {
-            smap_add(&pm_info, "tx1_bias_low_warning_threshold", module_dom->tx1_bias_low_warning_threshold);
-        }
-
-        if (module_dom->rx1_power_high_alarm) {
-            smap_add(&pm_info, "rx1_power_high_alarm", module_dom->rx1_power_high_alarm);
-        }
-        if (module_dom->rx1_power_low_alarm) {
-            smap_add(&pm_info, "rx1_power_low_alarm", module_dom->rx1_power_low_alarm);
-        }
-        if (module_dom->rx1_power_high_warning) {
-            smap_add(&pm_info, "rx1_power_high_warning", module_dom->rx1_power_high_warning);
-        }
-        if (module_dom->rx1_power_low_warning) {
-            smap_add(&pm_info, "rx1_power_low_warning", module_dom->rx1_power_low_warning);
-        }
-        if (module_dom->rx1_power_high_alarm_threshold) {
-            smap_add(&pm_info, "rx1_power_high_alarm_threshold", module_dom->rx1_power_high_alarm_threshold);
-        }
-        if (module_dom->rx1_power_low_alarm_threshold) {
-            smap_add(&pm_info, "rx1_power_low_alarm_threshold", module_dom->rx1_power_low_alarm_threshold);
-        }
-        if (module_dom->rx1_power_high_warning_threshold) {
-            smap_add(&pm_info, "rx1_power_high_warning_threshold", module_dom->rx1_power_high_warning_threshold);
-        }
-        if (module_dom->rx1_power_low_warning_threshold) {
-            smap_add(&pm_info, "rx1_power_low_warning_threshold", module_dom->rx1_power_low_warning_threshold);
-        }
-
-
-
-        if (module_dom->tx2_bias) {
-            smap_add(&pm_info, "tx2_bias", module_dom->tx2_bias);
-        }
-        if (module_dom->rx2_power) {
-            smap_add(&pm_info, "rx2_power", module_dom->rx2_power);
-        }
-
-        if (module_dom->tx2_bias_high_alarm) {
-            smap_add(&pm_info, "tx2_bias_high_alarm", module_dom->tx2_bias_high_alarm);
-        }
-        if (module_dom->tx2_bias_low_alarm) {
-            smap_add(&pm_info, "tx2_bias_low_alarm", module_dom->tx2_bias_low_alarm);
-        }
-        if (module_dom->tx2_bias_high_warning) {
-            smap_add(&pm_info, "tx2_bias_high_warning", module_dom->tx2_bias_high_warning);
-        }
-        if (module_dom->tx2_bias_low_warning) {
-            smap_add(&pm_info, "tx2_bias_low_warning", module_dom->tx2_bias_low_warning);
-        }
-        if (module_dom->tx2_bias_high_alarm_threshold) {
-            smap_add(&pm_info, "tx2_bias_high_alarm_threshold", module_dom->tx2_bias_high_alarm_threshold);
-        }
-        if (module_dom->tx2_bias_low_alarm_threshold) {
-            smap_add(&pm_info, "tx2_bias_low_alarm_threshold", module_dom->tx2_bias_low_alarm_threshold);
-        }
-        if (module_dom->tx2_bias_high_warning_threshold) {
-            smap_add(&pm_info, "tx2_bias_high_warning_threshold", module_dom->tx2_bias_high_warning_threshold);
-        }
-        if (module_dom->tx2_bias_low_warning_threshold) {
-            smap_add(&pm_info, "tx2_bias_low_warning_threshold", module_dom->tx2_bias_low_warning_threshold);
-        }
-
-        if (module_dom->rx2_power_high_alarm) {
-            smap_add(&pm_info, "rx2_power_high_alarm", module_dom->rx2_power_high_alarm);
-        }
-        if (module_dom->rx2_power_low_alarm) {
-            smap_add(&pm_info, "rx2_power_low_alarm", module_dom->rx2_power_low_alarm);
-        }
-        if (module_dom->rx2_power_high_warning) {
-            smap_add(&pm_info, "rx2_power_high_warning", module_dom->rx2_power_high_warning);
-        }
-        if (module_dom->rx2_power_low_warning) {
-            smap_add(&pm_info, "rx2_power_low_warning", module_dom->rx2_power_low_warning);
-        }
-        if (module_dom->rx2_power_high_alarm_threshold) {
-            smap_add(&pm_info, "rx2_power_high_alarm_threshold", module_dom->rx2_power_high_alarm_threshold);
-        }
-        if (module_dom->rx2_power_low_alarm_threshold) {
-            smap_add(&pm_info, "rx2_power_low_alarm_threshold", module_dom->rx2_power_low_alarm_threshold);
-        }
-        if (module_dom->rx2_power_high_warning_threshold) {
-            smap_add(&pm_info, "rx2_power_high_warning_threshold", module_dom->rx2_power_high_warning_threshold);
-        }
-        if (module_dom->rx2_power_low_warning_threshold) {
-            smap_add(&pm_info, "rx2_power_low_warning_threshold", module_dom->rx2_power_low_warning_threshold);
-        }
-
-
-
-        if (module_dom->tx3_bias) {
-            smap_add(&pm_info, "tx3_bias", module_dom->tx3_bias);
-        }
-        if (module_dom->rx3_power) {
-            smap_add(&pm_info, "rx3_power", module_dom->rx3_power);
-        }
-
-        if (module_dom->tx3_bias_high_alarm) {
-            smap_add(&pm_info, "tx3_bias_high_alarm", module_dom->tx3_bias_high_alarm);
-        }
-        if (module_dom->tx3_bias_low_alarm) {
-            smap_add(&pm_info, "tx3_bias_low_alarm", module_dom->tx3_bias_low_alarm);
-        }
-        if (module_dom->tx3_bias_high_warning) {
-            smap_add(&pm_info, "tx3_bias_high_warning", module_dom->tx3_bias_high_warning);
-        }
-        if (module_dom->tx3_bias_low_warning) {
-            smap_add(&pm_info, "tx3_bias_low_warning", module_dom->tx3_bias_low_warning);
-        }
-        if (module_dom->tx3_bias_high_alarm_threshold) {
-            smap_add(&pm_info, "tx3_bias_high_alarm_threshold", module_dom->tx3_bias_high_alarm_threshold);
-        }
-        if (module_dom->tx3_bias_low_alarm_threshold) {
-            smap_add(&pm_info, "tx3_bias_low_alarm_threshold", module_dom->tx3_bias_low_alarm_threshold);
-        }
-        if (module_dom->tx3_bias_high_warning_threshold) {
-            smap_add(&pm_info, "tx3_bias_high_warning_threshold", module_dom->tx3_bias_high_warning_threshold);
-        }
-        if (module_dom->tx3_bias_low_warning_threshold) {
-            smap_add(&pm_info, "tx3_bias_low_warning_threshold", module_dom->tx3_bias_low_warning_threshold);
-        }
-
-        if (module_dom->rx3_power_high_alarm) {
-            smap_add(&pm_info, "rx3_power_high_alarm", module_dom->rx3_power_high_alarm);
-        }
-        if (module_dom->rx3_power_low_alarm) {
-            smap_add(&pm_info, "rx3_power_low_alarm", module_dom->rx3_power_low_alarm);
-        }
-        if (module_dom->rx3_power_high_warning) {
-            smap_add(&pm_info, "rx3_power_high_warning", module_dom->rx3_power_high_warning);
-        }
-        if (module_dom->rx3_power_low_warning) {
-            smap_add(&pm_info, "rx3_power_low_warning", module_dom->rx3_power_low_warning);
-        }
-        if (module_dom->rx3_power_high_alarm_threshold) {
-            smap_add(&pm_info, "rx3_power_high_alarm_threshold", module_dom->rx3_power_high_alarm_threshold);
-        }
-        if (module_dom->rx3_power_low_alarm_threshold) {
-            smap_add(&pm_info, "rx3_power_low_alarm_threshold", module_dom->rx3_power_low_alarm_threshold);
-        }
-        if (module_dom->rx3_power_high_warning_threshold) {
-            smap_add(&pm_info, "rx3_power_high_warning_threshold", module_dom->rx3_power_high_warning_threshold);
-        }
-        if (module_dom->rx3_power_low_warning_threshold) {
-            smap_add(&pm_info, "rx3_power_low_warning_threshold", module_dom->rx3_power_low_warning_threshold);
-        }
-
-
-
-        if (module_dom->tx4_bias) {
-            smap_add(&pm_info, "tx4_bias", module_dom->tx4_bias);
-        }
-        if (module_dom->rx4_power) {
-            smap_add(&pm_info, "rx4_power", module_dom->rx4_power);
-        }
-
-        if (module_dom->tx4_bias_high_alarm) {
-            smap_add(&pm_info, "tx4_bias_high_alarm", module_dom->tx4_bias_high_alarm);
-        }
-        if (module_dom->tx4_bias_low_alarm) {
-            smap_add(&pm_info, "tx4_bias_low_alarm", module_dom->tx4_bias_low_alarm);
-        }
-        if (module_dom->tx4_bias_high_warning) {
-            smap_add(&pm_info, "tx4_bias_high_warning", module_dom->tx4_bias_high_warning);
-        }
-        if (module_dom->tx4_bias_low_warning) {
-            smap_add(&pm_info, "tx4_bias_low_warning", module_dom->tx4_bias_low_warning);
-        }
-        if (module_dom->tx4_bias_high_alarm_threshold) {
-            smap_add(&pm_info, "tx4_bias_high_alarm_threshold", module_dom->tx4_bias_high_alarm_threshold);
-        }
-        if (module_dom->tx4_bias_low_alarm_threshold) {
-            smap_add(&pm_info, "tx4_bias_low_alarm_threshold", module_dom->tx4_bias_low_alarm_threshold);
-        }
-        if (module_dom->tx4_bias_high_warning_threshold) {
-            smap_add(&pm_info, "tx4_bias_high_warning_threshold", module_dom->tx4_bias_high_warning_threshold);
-        }
-        if (module_dom->tx4_bias_low_warning_threshold) {
-            smap_add(&pm_info, "tx4_bias_low_warning_threshold", module_dom->tx4_bias_low_warning_threshold);
+        intf = ovsrec_interface_get_for_uuid(idl, &port->uuid);
+        if (NULL == intf) {
+            static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+
+            // the row is gone and the port goes with it on the next
+            // reconfigure; there is nothing left to publish to
+            VLOG_ERR_RL(&rl, "No DB entry found for hw interface %s",
+                        port->instance);
+            port->module.module_info_changed = false;
+            port->module.module_dom_changed = false;
+            continue;
         }
 
-        if (module_dom->rx4_power_high_alarm) {
-            smap_add(&pm_info, "rx4_power_high_alarm", module_dom->rx4_power_high_alarm);
-        }
-        if (module_dom->rx4_power_low_alarm) {
-            smap_add(&pm_info, "rx4_power_low_alarm", module_dom->rx4_power_low_alarm);
-        }
-        if (module_dom->rx4_power_high_warning) {
-            smap_add(&pm_info, "rx4_power_high_warning", module_dom->rx4_power_high_warning);
-        }
-        if (module_dom->rx4_power_low_warning) {
-            smap_add(&pm_info, "rx4_power_low_warning", module_dom->rx4_power_low_warning);
-        }
-        if (module_dom->rx4_power_high_alarm_threshold) {
-            smap_add(&pm_info, "rx4_power_high_alarm_threshold", module_dom->rx4_power_high_alarm_threshold);
-        }
-        if (module_dom->rx4_power_low_alarm_threshold) {
-            smap_add(&pm_info, "rx4_power_low_alarm_threshold", module_dom->rx4_power_low_alarm_threshold);
-        }
-        if (module_dom->rx4_power_high_warning_threshold) {
-            smap_add(&pm_info, "rx4_power_high_warning_threshold", module_dom->rx4_power_high_warning_threshold);
-        }
-        if (module_dom->rx4_power_low_warning_threshold) {
-            smap_add(&pm_info, "rx4_power_low_warning_threshold", module_dom->rx4_power_low_warning_threshold);
+        // Set pm_info map. It always carries the current identity and DOM
+        // data, so both are up to date once it has been written.
+        smap_init(&pm_info);
+        pm_build_pm_info(&port->module, &pm_info);
+        if (pm_txn_stats_row(dom, &intf->pm_info, &pm_info)) {
+            ovsrec_interface_set_pm_info(intf, &pm_info);
         }
-
-        ovsrec_interface_set_pm_info(intf, &pm_info);
         smap_destroy(&pm_info);
 
         // Clear port's module info update status
-        port->module_info_changed = false;
+        port->module.module_info_changed = false;
+        port->module.module_dom_changed = false;
     }
+}
+
+/*
+ * pm_ovsdb_update: publish identity changes (insertion, removal, new module
+ *                  data) and set cur_hw once initialization is complete
+ */
+void
+pm_ovsdb_update(void)
+{
+    struct ovsdb_idl_txn *txn;
+    const struct ovsrec_daemon *db_daemon;
+    enum ovsdb_idl_txn_status status;
+    uint64_t start;
+
+    txn = ovsdb_idl_txn_create(idl);
+
+    pm_ovsdb_publish(false);
 
     if (!cur_hw_set) {
         OVSREC_DAEMON_FOR_EACH(db_daemon, idl) {
@@ -661,18 +393,96 @@ pm_ovsdb_update(void)
         }
     }
 
-    ovsdb_idl_txn_commit_block(txn);
+    start = pm_perf_now();
+    PM_TRACE1(commit_start, 0);
+    status = ovsdb_idl_txn_commit_block(txn);
+    PM_TRACE3(commit_end, 0, status, pm_perf_now() - start);
+    if (TXN_UNCHANGED != status) {
+        pm_perf_end(PM_PERF_COMMIT_IDENTITY, start);
+    }
+    pm_loop_note_commit(false, status);
+    pm_txn_stats_commit(false, status);
+    pm_latency_commit(status);
+    ovsdb_idl_txn_destroy(txn);
+}
+
+/*
+ * pm_ovsdb_dom_update: publish DOM changes. This runs on the DOM refresh
+ *                      cadence, in its own transaction, so that telemetry
+ *                      never rides along with (or delays) identity updates.
+ */
+void
+pm_ovsdb_dom_update(void)
+{
+    struct ovsdb_idl_txn *txn;
+    enum ovsdb_idl_txn_status status;
+    uint64_t start;
+
+    txn = ovsdb_idl_txn_create(idl);
+
+    pm_ovsdb_publish(true);
+
+    start = pm_perf_now();
+    PM_TRACE1(commit_start, 1);
+    status = ovsdb_idl_txn_commit_block(txn);
+    PM_TRACE3(commit_end, 1, status, pm_perf_now() - start);
+    if (TXN_UNCHANGED != status) {
+        pm_perf_end(PM_PERF_COMMIT_DOM, start);
+    }
+    pm_loop_note_commit(true, status);
+    pm_txn_stats_commit(true, status);
     ovsdb_idl_txn_destroy(txn);
 }
 
 static void
 pmd_free_pm_port(pm_port_t *port)
 {
-    pm_delete_all_data(port);
+    pm_shm_port_remove(port);
+    pm_latency_cancel(port);
+    pm_delete_all_data(&port->module);
+    pm_dom_history_destroy(port);
     free(port->instance);
+    free(port->subsystem);
     free(port);
 }
 
+static void
+ovsdb_if_intf_delete(const struct uuid *uuid)
+{
+    pm_port_t *port;
+
+    port = ovsdb_if_intf_find(uuid);
+    if (NULL == port) {
+        // not a port we manage (e.g. not pluggable)
+        return;
+    }
+
+    VLOG_DBG("Deleted Interface %s\n", port->instance);
+    hmap_remove(&ovs_intfs_by_uuid, &port->uuid_node);
+    shash_find_and_delete(&ovs_intfs, port->instance);
+    pmd_free_pm_port(port);
+}
+
+static void
+ovsdb_if_subsys_delete(const struct uuid *uuid)
+{
+    struct shash_node *node;
+
+    SHASH_FOR_EACH(node, &ovs_subs) {
+        struct pm_subsys *sub = node->data;
+
+        if (uuid_equals(&sub->uuid, uuid)) {
+            VLOG_DBG("Deleted subsystem %s\n", node->name);
+            shash_delete(&ovs_subs, node);
+            free(sub->intfs);
+            free(sub);
+            ovsdb_if_pluggable_intfs_update();
+            // OPS_TODO: remove config subsystem
+            return;
+        }
+    }
+}
+
 static int
 pm_daemon_subscribe(void)
 {
@@ -681,6 +491,18 @@ pm_daemon_subscribe(void)
     ovsdb_idl_add_column(idl, &ovsrec_daemon_col_cur_hw);
     ovsdb_idl_omit_alert(idl, &ovsrec_daemon_col_cur_hw);
 
+#ifdef HAVE_OVSDB_IDL_SET_CONDITION
+    {
+        struct ovsdb_idl_condition cond;
+
+        // We only ever look at our own row.
+        ovsdb_idl_condition_init(&cond);
+        ovsrec_daemon_add_clause_name(&cond, OVSDB_F_EQ, NAME_IN_DAEMON_TABLE);
+        ovsrec_daemon_set_condition(idl, &cond);
+        ovsdb_idl_condition_destroy(&cond);
+    }
+#endif
+
     return 0;
 }
 
@@ -689,6 +511,8 @@ pm_intf_subscribe(void)
 {
     // initialize port data hash
     shash_init(&ovs_intfs);
+    hmap_init(&ovs_intfs_by_uuid);
+    shash_init(&ovs_pluggable_intfs);
 
     ovsdb_idl_add_table(idl, &ovsrec_table_interface);
     ovsdb_idl_add_column(idl, &ovsrec_interface_col_name);
@@ -697,6 +521,22 @@ pm_intf_subscribe(void)
 
     ovsdb_idl_add_column(idl, &ovsrec_interface_col_hw_intf_config);
 
+    // Track inserted/deleted rows and changes to hw_intf_config only, so
+    // that our own pm_info writes never show up as tracked changes.
+    ovsdb_idl_track_add_column(idl, &ovsrec_interface_col_hw_intf_config);
+
+#ifdef HAVE_OVSDB_IDL_SET_CONDITION
+    {
+        struct ovsdb_idl_condition cond;
+
+        // Nothing is replicated until a subsystem tells us which
+        // interfaces are pluggable (see ovsdb_if_pluggable_intfs_update).
+        ovsdb_idl_condition_init(&cond);
+        ovsrec_interface_set_condition(idl, &cond);
+        ovsdb_idl_condition_destroy(&cond);
+    }
+#endif
+
     return 0;
 }
 
@@ -708,8 +548,13 @@ pm_subsystem_subscribe(void)
     ovsdb_idl_add_table(idl, &ovsrec_table_subsystem);
     ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_name);
     ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_hw_desc_dir);
+    // hw_desc_dir is only read when a subsystem first appears
+    ovsdb_idl_omit_alert(idl, &ovsrec_subsystem_col_hw_desc_dir);
     ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_interfaces);
 
+    // Track inserted/deleted subsystems and changes to their interfaces.
+    ovsdb_idl_track_add_column(idl, &ovsrec_subsystem_col_interfaces);
+
     return 0;
 }
 
@@ -733,6 +578,14 @@ pmd_configure(struct ovsdb_idl *idl)
 
 }
 
+/*
+ * pmd_reconfigure: process changes to the tracked Interface and Subsystem
+ *                  rows since the last call.
+ *
+ * Only rows that were inserted, deleted or had a tracked column modified
+ * are visited, so the cost is proportional to the size of the change and
+ * not to the number of ports.
+ */
 void
 pmd_reconfigure(struct ovsdb_idl *idl)
 {
@@ -740,63 +593,61 @@ pmd_reconfigure(struct ovsdb_idl *idl)
     const struct ovsrec_interface *intf;
     unsigned int new_idl_seqno = ovsdb_idl_get_seqno(idl);
     pm_port_t *port;
-    struct shash_node *node;
-    struct shash_node *next;
 
     if (new_idl_seqno == idl_seqno){
         return;
     }
 
     idl_seqno = new_idl_seqno;
+    COVERAGE_INC(pmd_reconfigure);
+    pm_loop_note_wake(PM_LOOP_WAKE_IDL);
 
     // Process deleted interfaces.
-    SHASH_FOR_EACH_SAFE(node, next, &ovs_intfs) {
-        const struct ovsrec_interface *tmp_if;
-        port = (pm_port_t *) node->data;
-
-        tmp_if = ovsrec_interface_get_for_uuid(idl, &port->uuid);
-        if (NULL == tmp_if) {
-            struct shash_node *delete_node;
-            VLOG_DBG("Deleted Interface %s\n", port->instance);
-            delete_node = shash_find(&ovs_intfs, port->instance);
-            port = (pm_port_t *) delete_node->data;
-            shash_delete(&ovs_intfs, delete_node);
-            pmd_free_pm_port(port);
+    OVSREC_INTERFACE_FOR_EACH_TRACKED(intf, idl) {
+        if (ovsrec_interface_row_get_seqno(intf, OVSDB_IDL_CHANGE_DELETE) > 0) {
+            ovsdb_if_intf_delete(&intf->header_.uuid);
         }
     }
 
-    // Process deleted subsystems
-    SHASH_FOR_EACH_SAFE(node, next, &ovs_subs) {
-        const struct ovsrec_subsystem *tmp_sub;
-        struct uuid *uuid;
-
-        uuid = (struct uuid *) node->data;
-
-        tmp_sub = ovsrec_subsystem_get_for_uuid(idl, uuid);
-        if (NULL == tmp_sub) {
-            struct shash_node *delete_node;
-            delete_node = shash_find(&ovs_subs, node->name);
-            VLOG_DBG("Deleted subsystem %s\n", node->name);
-            shash_delete(&ovs_subs, delete_node);
-            free(uuid);
-            // OPS_TODO: remove config subsystem
+    // Process deleted subsystems.
+    OVSREC_SUBSYSTEM_FOR_EACH_TRACKED(subsys, idl) {
+        if (ovsrec_subsystem_row_get_seqno(subsys, OVSDB_IDL_CHANGE_DELETE) > 0) {
+            ovsdb_if_subsys_delete(&subsys->header_.uuid);
         }
     }
 
-    // Process added/deleted subsystems.
-    OVSREC_SUBSYSTEM_FOR_EACH(subsys, idl) {
-        ovsdb_if_subsys_process(subsys);
+    // Process added subsystems and subsystems with changed interfaces.
+    OVSREC_SUBSYSTEM_FOR_EACH_TRACKED(subsys, idl) {
+        if (ovsrec_subsystem_row_get_seqno(subsys, OVSDB_IDL_CHANGE_DELETE) == 0) {
+            ovsdb_if_subsys_process(subsys);
+        }
     }
 
-    // Process modified interfaces.
-    OVSREC_INTERFACE_FOR_EACH(intf, idl) {
-        node = shash_find(&ovs_intfs, intf->name);
-        if (NULL != node) {
-            port = (pm_port_t *) node->data;
-            // Process modified interface.
+    // Process modified interfaces. Re-inserted rows (e.g. after a database
+    // reconnect) are handled here as well, since hw_intf_config may have
+    // changed while we were disconnected.
+    OVSREC_INTERFACE_FOR_EACH_TRACKED(intf, idl) {
+        if (ovsrec_interface_row_get_seqno(intf, OVSDB_IDL_CHANGE_DELETE) > 0) {
+            continue;
+        }
+        port = ovsdb_if_intf_find(&intf->header_.uuid);
+        if (NULL != port) {
             ovsdb_if_intf_modify(intf, port);
+        } else if (ovsrec_interface_row_get_seqno(intf,
+                                                  OVSDB_IDL_CHANGE_INSERT) > 0) {
+            const char *sub_name;
+
+            // The row was replicated after its subsystem was processed
+            // (the monitor condition is widened once a subsystem's YAML
+            // files have been read).
+            sub_name = shash_find_data(&ovs_pluggable_intfs, intf->name);
+            if (NULL != sub_name && NULL == shash_find(&ovs_intfs, intf->name)) {
+                ovsdb_if_intf_create(intf, sub_name);
+            }
         }
     }
+
+    ovsdb_idl_track_clear(idl);
 }
 
 int
@@ -831,7 +682,7 @@ pm_interface_dump(struct ds *ds, pm_port_t *port)
 {
     struct ovs_module_info *module;
 
-    module = &port->ovs_module_columns;
+    module = &port->module.ovs_module_columns;
     ds_put_format(ds, "Pluggable info for Interface %s:\n", port->instance);
     if (module->cable_length) {
         ds_put_format(ds, "    cable_length           = %s\n",
@@ -924,6 +775,10 @@ pm_debug_dump(struct ds *ds, int argc, const char *argv[])
 
         if (!strcmp(table_name, "interface")) {
             pm_interfaces_dump(ds, argc, argv);
+        } else if (!strcmp(table_name, "i2c")) {
+            pm_i2c_dump(ds);
+        } else if (!strcmp(table_name, "events")) {
+            pm_latency_dump(ds);
         }
     } else {
         pm_interfaces_dump(ds, 0, NULL);
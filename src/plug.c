@@ -31,28 +31,22 @@
 #include <fcntl.h>
 #include <time.h>
 
+#include <timeval.h>
 #include <vswitch-idl.h>
 #include <openswitch-idl.h>
 
 #include "pmd.h"
 #include "plug.h"
 #include "pm_dom.h"
+#include "pm_core.h"
+#include "pm_perf.h"
+#include "pm_trace.h"
 
 VLOG_DEFINE_THIS_MODULE(plug);
 
 extern struct shash ovs_intfs;
 extern YamlConfigHandle global_yaml_handle;
 
-extern int sfpp_sum_verify(unsigned char *);
-extern int pm_parse(pm_sfp_serial_id_t *serial_datap, pm_port_t *port);
-
-
-/*
- * Functions to retieve DOM information
- */
-extern void pm_set_a2(pm_port_t *port, pm_sfp_dom_t *a2_data);
-extern void set_a2_read_request(pm_port_t *port, pm_sfp_serial_id_t *serial_datap);
-
 /*
  * Port Reset
  */
@@ -88,38 +82,9 @@ pm_set_enabled(void)
 
 #define MAX_DEVICE_NAME_LEN 1024
 
-//
-// pm_delete_all_data: mark all attributes as deleted
-//                     except for connector, which is always present
-//
-void
-pm_delete_all_data(pm_port_t *port)
-{
-    DELETE(port, connector_status);
-    DELETE_FREE(port, supported_speeds);
-    DELETE(port, cable_technology);
-    DELETE_FREE(port, cable_length);
-    DELETE_FREE(port, max_speed);
-    DELETE(port, power_mode);
-    DELETE_FREE(port, vendor_name);
-    DELETE_FREE(port, vendor_oui);
-    DELETE_FREE(port, vendor_part_number);
-    DELETE_FREE(port, vendor_revision);
-    DELETE_FREE(port, vendor_serial_number);
-    DELETE_FREE(port, a0);
-    DELETE_FREE(port, a2);
-    DELETE_FREE(port, a0_uppers);
-}
-
 static bool
 pm_get_presence(pm_port_t *port)
 {
-#ifdef PLATFORM_SIMULATION
-    if (NULL != port->module_data) {
-        return true;
-    }
-    return false;
-#else
     // presence detection data
     bool                present;
     uint32_t            result;
@@ -147,12 +112,13 @@ pm_get_presence(pm_port_t *port)
 retry_read:
 
     // execute the operation
-    rc = i2c_reg_read(global_yaml_handle, port->subsystem, reg_op, &result);
+    rc = pm_i2c_reg_read(port, reg_op, &result);
 
     if (rc != 0) {
         if (retry_count != 0) {
             VLOG_WARN("module presence read failed, retrying: %s",
                       port->instance);
+            pm_i2c_event(port, PM_I2C_RETRY);
             retry_count--;
             goto retry_read;
         }
@@ -164,28 +130,31 @@ retry_read:
     present = (result != 0);
 
     return present;
-#endif
 }
 
 static int
 pm_read_a0(pm_port_t *port, unsigned char *data, size_t offset)
 {
-#ifdef PLATFORM_SIMULATION
-    memcpy(data, port->module_data, sizeof(pm_sfp_serial_id_t));
-    return 0;
-#else
     // device data
     const YamlDevice *device;
+    const char          *bus;
 
     int                 rc;
+    uint64_t            start;
 
     // OPS_TODO: Need to read ready bit for QSFP modules (?)
 
     // get device for module eeprom
     device = yaml_find_device(global_yaml_handle, port->subsystem, port->module_device->module_eeprom);
+    bus = (NULL == device) ? "" : device->bus;
+
+    start = pm_perf_now();
+    PM_TRACE2(a0_read_start, port->instance, bus);
 
-    rc = i2c_data_read(global_yaml_handle, device, port->subsystem, offset,
-                       sizeof(pm_sfp_serial_id_t), data);
+    rc = pm_i2c_data_read(port, device, offset, sizeof(pm_sfp_serial_id_t),
+                          data);
+
+    PM_TRACE4(a0_read_end, port->instance, bus, rc, pm_perf_now() - start);
 
     if (rc != 0) {
         VLOG_ERR("module read failed: %s", port->instance);
@@ -193,19 +162,17 @@ pm_read_a0(pm_port_t *port, unsigned char *data, size_t offset)
     }
 
     return 0;
-#endif
 }
 
 static int
 pm_read_a2(pm_port_t *port, unsigned char *a2_data)
 {
-#ifdef PLATFORM_SIMULATION
-    return -1;
-#else
     // device data
     const YamlDevice    *device;
+    const char          *bus;
 
     int                 rc;
+    uint64_t            start;
     char                a2_device_name[MAX_DEVICE_NAME_LEN];
 
     VLOG_DBG("Read A2 address from yaml files.");
@@ -219,9 +186,14 @@ pm_read_a2(pm_port_t *port, unsigned char *a2_data)
 
     // get constructed A2 device
     device = yaml_find_device(global_yaml_handle, port->subsystem, a2_device_name);
+    bus = (NULL == device) ? "" : device->bus;
+
+    start = pm_perf_now();
+    PM_TRACE2(a2_read_start, port->instance, bus);
+
+    rc = pm_i2c_data_read(port, device, 0, sizeof(pm_sfp_dom_t), a2_data);
 
-    rc = i2c_data_read(global_yaml_handle, device, port->subsystem, 0,
-                       sizeof(pm_sfp_dom_t), a2_data);
+    PM_TRACE4(a2_read_end, port->instance, bus, rc, pm_perf_now() - start);
 
     if (rc != 0) {
         VLOG_ERR("module dom read failed: %s", port->instance);
@@ -229,7 +201,65 @@ pm_read_a2(pm_port_t *port, unsigned char *a2_data)
     }
 
     return 0;
-#endif
+}
+
+//
+// pm_read_dom: read and decode the DOM page for a pluggable module
+//
+// input: port structure
+//
+// output: success 0, failure !0
+//
+static int
+pm_read_dom(pm_port_t *port)
+{
+    int             rc;
+
+    // a2 page is for SFP+, only
+    pm_sfp_dom_t a2;
+
+    // retry up to 2 times if op fails
+    int             retry_count = 2;
+
+    memset(&a2, 0, sizeof(a2));
+
+retry_read_a2:
+    rc = pm_read_a2(port, (unsigned char *)&a2);
+
+    if (rc != 0) {
+        if (retry_count != 0) {
+            VLOG_DBG("module a2 read failed, retrying: %s", port->instance);
+            pm_i2c_event(port, PM_I2C_RETRY);
+            retry_count--;
+            goto retry_read_a2;
+        }
+
+        VLOG_WARN("module a2 read failed: %s", port->instance);
+
+        // there's no page to decode; the last sample is no longer current,
+        // so it leaves the valid path until a read succeeds
+        if (false == port->module.dom_sample_stale) {
+            pm_sub_dom_unavailable(port);
+        }
+        port->module.dom_sample_valid = false;
+        port->module.dom_sample_stale = true;
+        pm_shm_port_update(port);
+        port->module.a2_read_requested = false;
+
+        return rc;
+    }
+
+    // hand a decoded sample to the DOM history and the subscribers
+    if (0 == pm_set_a2(&port->module, &a2)) {
+        port->module.dom_sample_stale = false;
+        port->dom_sample_time = time_wall_msec();
+        pm_dom_history_add(port);
+        pm_sub_dom_sample(port);
+    }
+
+    port->module.a2_read_requested = false;
+
+    return rc;
 }
 
 //
@@ -243,6 +273,7 @@ pm_read_a2(pm_port_t *port, unsigned char *a2_data)
 int
 pm_read_module_state(pm_port_t *port)
 {
+    pm_module_t     *module = &port->module;
     int             rc;
 
     // presence detection data
@@ -251,16 +282,11 @@ pm_read_module_state(pm_port_t *port)
     // serial id data (SFP+ structure)
     pm_sfp_serial_id_t a0;
 
-    // a2 page is for SFP+, only
-    pm_sfp_dom_t a2;
-    // unsigned char   a2[PM_SFP_A2_PAGE_SIZE];
-
     // retry up to 2 times if data is invalid or op fails
     int             retry_count = 2;
     unsigned char   offset;
 
     memset(&a0, 0, sizeof(a0));
-    memset(&a2, 0, sizeof(a2));
 
     // SFP+ and QSFP serial id data are at different offsets
     // take this opportunity to get the correct presence detection operation
@@ -279,18 +305,23 @@ pm_read_module_state(pm_port_t *port)
 
 retry_read:
     present = pm_get_presence(port);
+    port->presence_time = time_wall_msec();
 
     if (!present) {
         // Update only if the module was previously present or
         // the entry is uninitialized.
         if ((port->present == true) ||
-            (NULL == port->ovs_module_columns.connector)) {
+            (NULL == module->ovs_module_columns.connector)) {
+            if (port->present == true) {
+                PM_TRACE2(presence, port->instance, 0);
+                pm_latency_start(port, false);
+            }
             // delete current data from entry
             port->present = false;
-            pm_delete_all_data(port);
+            pm_delete_all_data(module);
             // set presence enum
-            SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_ABSENT);
-            SET_STATIC_STRING(port, connector_status,
+            SET_STATIC_STRING(module, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_ABSENT);
+            SET_STATIC_STRING(module, connector_status,
                               OVSREC_INTERFACE_PM_INFO_CONNECTOR_STATUS_UNRECOGNIZED);
             VLOG_DBG("module is not present for port: %s", port->instance);
         }
@@ -302,30 +333,42 @@ retry_read:
 
         VLOG_DBG("module is present for port: %s", port->instance);
 
+        // a retry after a reset is part of the same insertion
+        if (port->present == false && false == pm_latency_pending(port, true)) {
+            PM_TRACE2(presence, port->instance, 1);
+            pm_latency_start(port, true);
+        }
+
         rc = pm_read_a0(port, (unsigned char *)&a0, offset);
 
         if (rc != 0) {
             if (retry_count != 0) {
                 VLOG_DBG("module serial ID data read failed, resetting and retrying: %s",
                          port->instance);
+                pm_i2c_event(port, PM_I2C_RETRY);
                 pm_reset_port(port);
                 retry_count--;
                 goto retry_read;
             }
             VLOG_WARN("module serial ID data read failed: %s", port->instance);
-            pm_delete_all_data(port);
+            pm_delete_all_data(module);
             port->present = true;
             port->retry = true;
-            SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_UNKNOWN);
-            SET_STATIC_STRING(port, connector_status,
+            SET_STATIC_STRING(module, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_UNKNOWN);
+            SET_STATIC_STRING(module, connector_status,
                               OVSREC_INTERFACE_PM_INFO_CONNECTOR_STATUS_UNRECOGNIZED);
             return -1;
         }
+        port->a0_time = time_wall_msec();
+        pm_latency_stage(port, PM_LATENCY_A0);
 
         // do checksum validation
         if (sfpp_sum_verify((unsigned char *)&a0) != 0) {
+            PM_TRACE2(checksum_fail, port->instance, retry_count);
+            pm_i2c_event(port, PM_I2C_CHECKSUM_FAILURE);
             if (retry_count != 0) {
                 VLOG_DBG("module serial ID data failed checksum, resetting and retrying: %s", port->instance);
+                pm_i2c_event(port, PM_I2C_RETRY);
                 pm_reset_port(port);
                 retry_count--;
                 goto retry_read;
@@ -335,21 +378,25 @@ retry_read:
             port->present = true;
             port->retry = true;
             // delete all attributes, set "unknown" value
-            pm_delete_all_data(port);
-            SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_UNKNOWN);
-            SET_STATIC_STRING(port, connector_status,
+            pm_delete_all_data(module);
+            SET_STATIC_STRING(module, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_UNKNOWN);
+            SET_STATIC_STRING(module, connector_status,
                               OVSREC_INTERFACE_PM_INFO_CONNECTOR_STATUS_UNRECOGNIZED);
             return -1;
         }
+        pm_latency_stage(port, PM_LATENCY_CHECKSUM);
 
         // parse the data into important fields, and set it as pending data
-        rc = pm_parse(&a0, port);
+        module->dom_supported = false;
+        rc = pm_parse(&a0, module);
+        PM_TRACE2(parse, port->instance, rc);
+        pm_latency_stage(port, PM_LATENCY_PARSE);
 
         if (rc == 0) {
             // mark port as present
             port->present = true;
             port->retry = false;
-            set_a2_read_request(port, &a0);
+            set_a2_read_request(module, &a0);
         } else {
             port->retry = true;
             // note: in failure case, pm_parse will already have logged
@@ -358,29 +405,16 @@ retry_read:
         }
     }
 
-    if (port->a2_read_requested == false) {
+    if (module->a2_read_requested == false) {
         return 0;
     }
 
-retry_read_a2:
-    rc = pm_read_a2(port, (unsigned char *)&a2);
-
-    if (rc != 0) {
-        if (retry_count != 0) {
-            VLOG_DBG("module a2 read failed, retrying: %s", port->instance);
-            retry_count--;
-            goto retry_read_a2;
-        }
-
-        VLOG_WARN("module a2 read failed: %s", port->instance);
-
-        memset(&a2, 0xff, sizeof(a2));
+    // a failed read leaves the stage unstamped: its time belongs to the
+    // read that eventually succeeds
+    if (0 == pm_read_dom(port)) {
+        pm_latency_stage(port, PM_LATENCY_A2);
     }
 
-    pm_set_a2(port, &a2);
-
-    port->a2_read_requested = false;
-
     return 0;
 }
 
@@ -426,6 +460,34 @@ pm_read_state(void)
     return 0;
 }
 
+//
+// pm_read_dom_state: refresh the DOM data of all modules that support it
+//
+// input: none
+//
+// output: none
+//
+int
+pm_read_dom_state(void)
+{
+    struct shash_node *node;
+
+    SHASH_FOR_EACH(node, &ovs_intfs) {
+        pm_port_t *port;
+
+        port = (pm_port_t *)node->data;
+
+        if (NULL == port || false == port->present ||
+            false == port->module.dom_supported || true == port->retry) {
+            continue;
+        }
+
+        pm_read_dom(port);
+    }
+
+    return 0;
+}
+
 //
 // pm_configure_qsfp: enable/disable qsfp module
 //
@@ -438,27 +500,6 @@ pm_configure_qsfp(pm_port_t *port)
 {
     uint8_t             data = 0x00;
     unsigned int        idx;
-
-#ifdef PLATFORM_SIMULATION
-    if (true == port->split) {
-        data = 0x00;
-        for (idx = 0; idx < MAX_SPLIT_COUNT; idx++) {
-
-            if (false == port->hw_enable_subport[idx]) {
-                data |= (1 << idx);
-            }
-        }
-    } else {
-        if (false == port->hw_enable) {
-            data = 0x0f;
-        } else {
-            data = 0x00;
-        }
-    }
-
-    port->port_enable = data;
-    return;
-#else
     const YamlDevice    *device;
 
     int                 rc;
@@ -467,7 +508,7 @@ pm_configure_qsfp(pm_port_t *port)
         return;
     }
 
-    if (false == port->optical) {
+    if (false == port->module.optical) {
         return;
     }
 
@@ -490,8 +531,9 @@ pm_configure_qsfp(pm_port_t *port)
 
     device = yaml_find_device(global_yaml_handle, port->subsystem, port->module_device->module_eeprom);
 
-    rc = i2c_data_write(global_yaml_handle, device, port->subsystem,
-                        QSFP_DISABLE_OFFSET, sizeof(data), &data);
+    rc = pm_i2c_data_write(port, device, QSFP_DISABLE_OFFSET, sizeof(data),
+                           &data);
+    PM_TRACE3(tx_enable, port->instance, data, rc);
 
     if (0 != rc) {
         VLOG_WARN("Failed to write QSFP enable/disable: %s (%d)",
@@ -502,7 +544,6 @@ pm_configure_qsfp(pm_port_t *port)
     }
 
     return;
-#endif
 }
 
 
@@ -533,8 +574,13 @@ pm_reset(pm_port_t *port, clear_reset_t clear)
         return;
     }
 
+    if (!clear) {
+        pm_i2c_event(port, PM_I2C_RESET);
+    }
+
     data = clear ? 0 : 0xffu;
-    rc = i2c_reg_write(global_yaml_handle, port->subsystem, reg_op, data);
+    rc = pm_i2c_reg_write(port, reg_op, data);
+    PM_TRACE3(reset, port->instance, clear ? 0 : 1, rc);
 
     if (rc != 0) {
         VLOG_WARN("Unable to %s reset for port: %s (%d)",
@@ -587,24 +633,6 @@ pm_reset_port(pm_port_t *port)
 void
 pm_configure_port(pm_port_t *port)
 {
-#ifdef PLATFORM_SIMULATION
-    bool                enabled;
-
-    if ((0 == strcmp(port->module_device->connector, CONNECTOR_QSFP_PLUS)) ||
-        (0 == strcmp(port->module_device->connector, CONNECTOR_QSFP28))) {
-        pm_configure_qsfp(port);
-    } else {
-        enabled = port->hw_enable;
-
-        if (enabled) {
-            port->port_enable = 1;
-        } else {
-            port->port_enable = 0;
-        }
-    }
-
-    return;
-#else
     int                 rc;
     uint32_t            data;
     i2c_bit_op          *reg_op;
@@ -622,10 +650,16 @@ pm_configure_port(pm_port_t *port)
 
     reg_op = port->module_device->module_signals.sfp.sfpp_tx_disable;
 
+    if (NULL == reg_op) {
+        VLOG_DBG("port %s does not have a tx disable", port->instance);
+        return;
+    }
+
     enabled = port->hw_enable;
     data = enabled ? 0: reg_op->bit_mask;
 
-    rc = i2c_reg_write(global_yaml_handle, port->subsystem, reg_op, data);
+    rc = pm_i2c_reg_write(port, reg_op, data);
+    PM_TRACE3(tx_enable, port->instance, data, rc);
 
     if (rc != 0) {
         VLOG_WARN("Unable to set module disable for port: %s (%d)",
@@ -635,77 +669,4 @@ pm_configure_port(pm_port_t *port)
 
     VLOG_DBG("set port %s to %s",
              port->instance, enabled ? "enabled" : "disabled");
-#endif
-}
-
-#ifdef PLATFORM_SIMULATION
-int
-pmd_sim_insert(const char *name, const char *file, struct ds *ds)
-{
-    struct shash_node *node;
-    pm_port_t *port;
-    FILE *fp;
-    unsigned char *data;
-
-    node = shash_find(&ovs_intfs, name);
-    if (NULL == node) {
-        ds_put_cstr(ds, "No such interface");
-        return -1;
-    }
-    port = (pm_port_t *)node->data;
-
-    if (NULL != port->module_data) {
-        free((void *)port->module_data);
-        port->module_data = NULL;
-    }
-
-    fp = fopen(file, "r");
-
-    if (NULL == fp) {
-        ds_put_cstr(ds, "Can't open file");
-        return -1;
-    }
-
-    data = (unsigned char *)malloc(sizeof(pm_sfp_serial_id_t));
-
-    if (1 != fread(data, sizeof(pm_sfp_serial_id_t), 1, fp)) {
-        ds_put_cstr(ds, "Unable to read data");
-        free(data);
-        fclose(fp);
-        return -1;
-    }
-
-    fclose(fp);
-
-    port->module_data = data;
-
-    ds_put_cstr(ds, "Pluggable module inserted");
-
-    return 0;
-}
-
-int
-pmd_sim_remove(const char *name, struct ds *ds)
-{
-    struct shash_node *node;
-    pm_port_t *port;
-
-    node = shash_find(&ovs_intfs, name);
-    if (NULL == node) {
-        ds_put_cstr(ds, "No such interface");
-        return -1;
-    }
-    port = (pm_port_t *)node->data;
-
-    if (NULL == port->module_data) {
-        ds_put_cstr(ds, "Pluggable module not present");
-        return -1;
-    }
-
-    free((void *)port->module_data);
-    port->module_data = NULL;
-
-    ds_put_cstr(ds, "Pluggable module removed");
-    return 0;
 }
-#endif
@@ -28,12 +28,14 @@
 #include <stdarg.h>
 #include <ctype.h>
 #include <math.h>
+#include <stdlib.h>
 
+#include <openvswitch/vlog.h>
 #include <vswitch-idl.h>
 #include <openswitch-idl.h>
 
-#include "pmd.h"
 #include "plug.h"
+#include "pm_core.h"
 
 VLOG_DEFINE_THIS_MODULE(pm_detect);
 
@@ -76,7 +78,7 @@ hex_to_ascii(char *buf, int buf_size)
 }
 
 STATIC void
-set_supported_speeds(pm_port_t *port, size_t count, ...)
+set_supported_speeds(pm_module_t *port, size_t count, ...)
 {
     va_list args;
     size_t idx;
@@ -120,13 +122,37 @@ pm_oui_format(char *ascii_oui, unsigned char *binary_oui)
         binary_oui[2]);
 }
 
+//
+// pm_delete_all_data: mark all attributes as deleted
+//                     except for connector, which is always present
+//
+void
+pm_delete_all_data(pm_module_t *port)
+{
+    DELETE(port, connector_status);
+    DELETE_FREE(port, supported_speeds);
+    DELETE(port, cable_technology);
+    DELETE_FREE(port, cable_length);
+    DELETE_FREE(port, max_speed);
+    DELETE(port, power_mode);
+    DELETE_FREE(port, vendor_name);
+    DELETE_FREE(port, vendor_oui);
+    DELETE_FREE(port, vendor_part_number);
+    DELETE_FREE(port, vendor_revision);
+    DELETE_FREE(port, vendor_serial_number);
+    DELETE_FREE(port, a0);
+    DELETE_FREE(port, a2);
+    DELETE_FREE(port, a0_uppers);
+    pm_delete_all_dom_data(port);
+}
+
 //
 // pm_parse: get important data out of serial id data
 //
 int
 pm_parse(
     pm_sfp_serial_id_t  *serial_datap,
-    pm_port_t           *port)
+    pm_module_t         *port)
 {
     int                     type;
     char                    vendor_name[PM_VENDOR_NAME_LEN+1];
@@ -138,27 +164,27 @@ pm_parse(
     pm_qsfp_serial_id_t*    qsfpp_serial_id;
 
     // ignore modules that aren't pluggable
-    if (false == port->module_device->pluggable) {
-        VLOG_DBG("port is not pluggable: %s", port->instance);
+    if (false == port->pluggable) {
+        VLOG_DBG("port is not pluggable: %s", port->name);
         return 0;
     }
 
     // ignore modules that don't have connector data
-    if (NULL == port->module_device->connector) {
-        VLOG_WARN("no connector info for port: %s", port->instance);
+    if (NULL == port->connector) {
+        VLOG_WARN("no connector info for port: %s", port->name);
         return -1;
     }
 
     // prepare for handling SFP+, QSFP+ and QSFP28 differently
-    if (strcmp(port->module_device->connector, CONNECTOR_SFP_PLUS) == 0) {
+    if (strcmp(port->connector, CONNECTOR_SFP_PLUS) == 0) {
         type = MODULE_TYPE_SFP_PLUS;
-    } else if (strcmp(port->module_device->connector, CONNECTOR_QSFP_PLUS) == 0) {
+    } else if (strcmp(port->connector, CONNECTOR_QSFP_PLUS) == 0) {
         type = MODULE_TYPE_QSFP_PLUS;
-    } else if (strcmp(port->module_device->connector, CONNECTOR_QSFP28) == 0) {
+    } else if (strcmp(port->connector, CONNECTOR_QSFP28) == 0) {
         type = MODULE_TYPE_QSFP28;
     } else {
         VLOG_WARN("unknown connector type for port: %s (%s)",
-                  port->instance, port->module_device->connector);
+                  port->name, port->connector);
         pm_delete_all_data(port);
         SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_UNKNOWN);
         return -1;
@@ -166,7 +192,7 @@ pm_parse(
 
     switch (type) {
         case MODULE_TYPE_SFP_PLUS:
-            VLOG_DBG("port is SFP plus pluggable: %s", port->instance);
+            VLOG_DBG("port is SFP plus pluggable: %s", port->name);
             // Supported SFP module types
             if (PM_CONNECTOR_COPPER_PIGTAIL == serial_datap->connector) {
                 unsigned int speed = 0;
@@ -177,13 +203,13 @@ pm_parse(
                 SET_STATIC_STRING(port, connector_status,
                                   OVSREC_INTERFACE_PM_INFO_CONNECTOR_STATUS_SUPPORTED);
                 VLOG_DBG("bit rate for %s is 0x%x",
-                         port->instance, serial_datap->bit_rate_nominal);
+                         port->name, serial_datap->bit_rate_nominal);
                 if (serial_datap->bit_rate_nominal >= SFP_BIT_RATE_NOMINAL_10G) {
                     speed = 10000;
                 } else {
                     speed = 1000;
                 }
-                VLOG_DBG("module is DAC at %d: %s", speed, port->instance);
+                VLOG_DBG("module is DAC at %d: %s", speed, port->name);
                 SET_INT_STRING(port, max_speed, speed);
                 set_supported_speeds(port, 1, speed);
                 // determine active/passive
@@ -195,7 +221,7 @@ pm_parse(
                 SET_STATIC_STRING(port, cable_technology, cable_tech);
                 SET_INT_STRING(port, cable_length, serial_datap->length_copper);
             } else if (0 != serial_datap->transceiver.enet_1000base_sx) {
-                VLOG_DBG("module is 1G_SX: %s", port->instance);
+                VLOG_DBG("module is 1G_SX: %s", port->name);
                 // handle sx type
                 port->optical = true;
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_SFP_SX);
@@ -207,7 +233,7 @@ pm_parse(
                 DELETE_FREE(port, cable_length);
             } else if (0 != serial_datap->transceiver.enet_1000base_lx) {
                 // handle lx type
-                VLOG_DBG("module is 1G_LX: %s", port->instance);
+                VLOG_DBG("module is 1G_LX: %s", port->name);
                 port->optical = true;
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_SFP_LX);
                 SET_STATIC_STRING(port, connector_status,
@@ -219,7 +245,7 @@ pm_parse(
             } else if (0 != serial_datap->transceiver.enet_1000base_cx) {
                 // handle cx type
                 port->optical = false;
-                VLOG_DBG("module is 1G_CX: %s", port->instance);
+                VLOG_DBG("module is 1G_CX: %s", port->name);
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_SFP_CX);
                 SET_STATIC_STRING(port, connector_status,
                                   OVSREC_INTERFACE_PM_INFO_CONNECTOR_STATUS_SUPPORTED);
@@ -230,7 +256,7 @@ pm_parse(
             } else if (0 != serial_datap->transceiver.enet_1000base_t) {
                 // handle RJ45 type
                 port->optical = false;
-                VLOG_DBG("module is 1G RJ45: %s", port->instance);
+                VLOG_DBG("module is 1G RJ45: %s", port->name);
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_SFP_RJ45);
                 SET_STATIC_STRING(port, connector_status,
                                   OVSREC_INTERFACE_PM_INFO_CONNECTOR_STATUS_SUPPORTED);
@@ -240,7 +266,7 @@ pm_parse(
                 DELETE_FREE(port, cable_length);
             } else if (0 != serial_datap->transceiver.enet_10gbase_sr) {
                 // handle sr type
-                VLOG_DBG("module is 10G SR: %s", port->instance);
+                VLOG_DBG("module is 10G SR: %s", port->name);
                 port->optical = true;
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_SFP_SR);
                 SET_STATIC_STRING(port, connector_status,
@@ -250,7 +276,7 @@ pm_parse(
                 DELETE(port, cable_technology);
                 DELETE_FREE(port, cable_length);
             } else if (0 != serial_datap->transceiver.enet_10gbase_lr) {
-                VLOG_DBG("module is 10G LR: %s", port->instance);
+                VLOG_DBG("module is 10G LR: %s", port->name);
                 port->optical = true;
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_SFP_LR);
                 SET_STATIC_STRING(port, connector_status,
@@ -260,7 +286,7 @@ pm_parse(
                 DELETE(port, cable_technology);
                 DELETE_FREE(port, cable_length);
             } else if (0 != serial_datap->transceiver.enet_10gbase_lrm) {
-                VLOG_DBG("module is 10G LRM: %s", port->instance);
+                VLOG_DBG("module is 10G LRM: %s", port->name);
                 port->optical = true;
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_SFP_LRM);
                 SET_STATIC_STRING(port, connector_status,
@@ -270,7 +296,7 @@ pm_parse(
                 DELETE(port, cable_technology);
                 DELETE_FREE(port, cable_length);
             } else {
-                VLOG_DBG("module is unrecognized: %s", port->instance);
+                VLOG_DBG("module is unrecognized: %s", port->name);
                 port->optical = false;
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_UNKNOWN);
                 SET_STATIC_STRING(port, connector_status,
@@ -343,12 +369,12 @@ pm_parse(
 
             // QSFP has a different structure definition (similar, but not
             // the same)
-            VLOG_DBG("port is QSFP plus pluggable: %s", port->instance);
+            VLOG_DBG("port is QSFP plus pluggable: %s", port->name);
 
             qsfpp_serial_id = (pm_qsfp_serial_id_t *)serial_datap;
 
             if (0 != qsfpp_serial_id->spec_compliance.enet_40gbase_lr4) {
-                VLOG_DBG("module is 40G_LR4: %s", port->instance);
+                VLOG_DBG("module is 40G_LR4: %s", port->name);
                 // handle LR4 type
                 port->optical = true;
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP_LR4);
@@ -359,7 +385,7 @@ pm_parse(
                 DELETE(port, cable_technology);
                 DELETE_FREE(port, cable_length);
             } else if (0 != qsfpp_serial_id->spec_compliance.enet_40gbase_sr4) {
-                VLOG_DBG("module is 40G_SR4: %s", port->instance);
+                VLOG_DBG("module is 40G_SR4: %s", port->name);
                 // handle SR4 type
                 port->optical = true;
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP_SR4);
@@ -370,7 +396,7 @@ pm_parse(
                 DELETE(port, cable_technology);
                 DELETE_FREE(port, cable_length);
             } else if (0 != qsfpp_serial_id->spec_compliance.enet_40gbase_cr4) {
-                VLOG_DBG("module is 40G_CR4: %s", port->instance);
+                VLOG_DBG("module is 40G_CR4: %s", port->name);
                 // handle CR4 type
                 port->optical = false;
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP_CR4);
@@ -381,7 +407,7 @@ pm_parse(
                 DELETE(port, cable_technology);
                 DELETE_FREE(port, cable_length);
             } else {
-                VLOG_DBG("module is unsupported: %s", port->instance);
+                VLOG_DBG("module is unsupported: %s", port->name);
                 port->optical = false;
                 SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_UNKNOWN);
                 SET_STATIC_STRING(port, connector_status,
@@ -454,14 +480,14 @@ pm_parse(
         case MODULE_TYPE_QSFP28:
 
             // Use the same structure definition used for MODULE_TYPE_QSFP_PLUS case
-            VLOG_DBG("port is QSFP 28 pluggable: %s", port->instance);
+            VLOG_DBG("port is QSFP 28 pluggable: %s", port->name);
 
             qsfpp_serial_id = (pm_qsfp_serial_id_t *)serial_datap;
 
             if (0 != qsfpp_serial_id->spec_compliance.enet_extended) {
                 switch (qsfpp_serial_id->options.ext_compliance_code) {
                     case PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_SR4:
-                        VLOG_DBG("module is 100G_SR4: %s", port->instance);
+                        VLOG_DBG("module is 100G_SR4: %s", port->name);
                         // handle SR4 type
                         port->optical = true;
                         SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP28_SR4);
@@ -473,7 +499,7 @@ pm_parse(
                         DELETE_FREE(port, cable_length);
                         break;
                     case PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_LR4:
-                        VLOG_DBG("module is 100G_LR4: %s", port->instance);
+                        VLOG_DBG("module is 100G_LR4: %s", port->name);
                         // handle LR4 type
                         port->optical = true;
                         SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP28_LR4);
@@ -485,7 +511,7 @@ pm_parse(
                         DELETE_FREE(port, cable_length);
                         break;
                     case PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_CWDM4:
-                        VLOG_DBG("module is 100G_CWDM4: %s", port->instance);
+                        VLOG_DBG("module is 100G_CWDM4: %s", port->name);
                         // handle CWDM4 type
                         port->optical = true;
                         SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP28_CWDM4);
@@ -497,7 +523,7 @@ pm_parse(
                         DELETE_FREE(port, cable_length);
                         break;
                     case PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_PSM4:
-                        VLOG_DBG("module is 100G_PSM4: %s", port->instance);
+                        VLOG_DBG("module is 100G_PSM4: %s", port->name);
                         // handle PSM4 type
                         port->optical = true;
                         SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP28_PSM4);
@@ -509,7 +535,7 @@ pm_parse(
                         DELETE_FREE(port, cable_length);
                         break;
                     case PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_CR4:
-                        VLOG_DBG("module is 100G_CR4: %s", port->instance);
+                        VLOG_DBG("module is 100G_CR4: %s", port->name);
                         // handle CR4 type
                         port->optical = false;
                         SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP28_CR4);
@@ -521,7 +547,7 @@ pm_parse(
                         DELETE_FREE(port, cable_length);
                         break;
                     case PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_CLR4:
-                        VLOG_DBG("module is 100G_CLR4: %s", port->instance);
+                        VLOG_DBG("module is 100G_CLR4: %s", port->name);
                         // handle CLR4 type
                         port->optical = true;
                         SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP28_CLR4);
@@ -533,7 +559,7 @@ pm_parse(
                         DELETE_FREE(port, cable_length);
                         break;
                     default:
-                        VLOG_DBG("module is unsupported: %s", port->instance);
+                        VLOG_DBG("module is unsupported: %s", port->name);
                         port->optical = false;
                         SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_UNKNOWN);
                         SET_STATIC_STRING(port, connector_status,
@@ -546,7 +572,7 @@ pm_parse(
                 }
             } else {
                 if (0 != qsfpp_serial_id->spec_compliance.enet_40gbase_lr4) {
-                    VLOG_DBG("module is 40G_LR4: %s", port->instance);
+                    VLOG_DBG("module is 40G_LR4: %s", port->name);
                     // handle LR4 type
                     port->optical = true;
                     SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP_LR4);
@@ -557,7 +583,7 @@ pm_parse(
                     DELETE(port, cable_technology);
                     DELETE_FREE(port, cable_length);
                 } else if (0 != qsfpp_serial_id->spec_compliance.enet_40gbase_sr4) {
-                    VLOG_DBG("module is 40G_SR4: %s", port->instance);
+                    VLOG_DBG("module is 40G_SR4: %s", port->name);
                     // handle SR4 type
                     port->optical = true;
                     SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP_SR4);
@@ -568,7 +594,7 @@ pm_parse(
                     DELETE(port, cable_technology);
                     DELETE_FREE(port, cable_length);
                 } else if (0 != qsfpp_serial_id->spec_compliance.enet_40gbase_cr4) {
-                    VLOG_DBG("module is 40G_CR4: %s", port->instance);
+                    VLOG_DBG("module is 40G_CR4: %s", port->name);
                     // handle CR4 type
                     port->optical = false;
                     SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_QSFP_CR4);
@@ -579,7 +605,7 @@ pm_parse(
                     DELETE(port, cable_technology);
                     DELETE_FREE(port, cable_length);
                 } else {
-                    VLOG_DBG("module is unsupported: %s", port->instance);
+                    VLOG_DBG("module is unsupported: %s", port->name);
                     port->optical = false;
                     SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_UNKNOWN);
                     SET_STATIC_STRING(port, connector_status,
@@ -651,7 +677,7 @@ pm_parse(
             SET_BINARY(port, a0, (char *) qsfpp_serial_id, sizeof(pm_qsfp_serial_id_t));
             break;
         default:
-            VLOG_WARN("port is unrecognized pluggable type: %s", port->instance);
+            VLOG_WARN("port is unrecognized pluggable type: %s", port->name);
             break;
     }
 
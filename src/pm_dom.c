@@ -28,39 +28,46 @@
 #include <stdarg.h>
 #include <ctype.h>
 #include <math.h>
+#include <stdlib.h>
 
+#include <openvswitch/vlog.h>
 #include <vswitch-idl.h>
 #include <openswitch-idl.h>
 
-#include "pmd.h"
 #include "plug.h"
 #include "pm_dom.h"
+#include "pm_core.h"
 
 VLOG_DEFINE_THIS_MODULE(dom);
 
+// combine a big-endian DOM register pair into its raw 16 bit value
+#define DOM_RAW(msb, lsb)   ((uint16_t)(((unsigned char)(msb) << 8) | (lsb)))
+
 /*
  * set_a2_read_request: sets a2_read_requested if DOM info is present and is complicant
  */
 void
-set_a2_read_request(pm_port_t *port, pm_sfp_serial_id_t *serial_datap)
+set_a2_read_request(pm_module_t *port, pm_sfp_serial_id_t *serial_datap)
 {
-    if (0 == strcmp(port->module_device->connector, CONNECTOR_SFP_PLUS)) {
+    if (0 == strcmp(port->connector, CONNECTOR_SFP_PLUS)) {
         if (serial_datap->diag_monitor_type.implemented_digital &&
                 serial_datap->diag_monitor_type.internally_calibrated &&
                 serial_datap->diag_monitor_type.power_measurement_type &&
                 !serial_datap->diag_monitor_type.addr_change_required) {
+            port->dom_supported = true;
             port->a2_read_requested = true;
             VLOG_DBG("sfpp serial id data indicates that the DOM info is present");
         }
-    } else if ((0 == strcmp(port->module_device->connector,
+    } else if ((0 == strcmp(port->connector,
                             CONNECTOR_QSFP_PLUS)) ||
-               (0 == strcmp(port->module_device->connector,
+               (0 == strcmp(port->connector,
                             CONNECTOR_QSFP28))) {
         pm_qsfp_serial_id_t *qsfpp_serial_id;
 
         qsfpp_serial_id = (pm_qsfp_serial_id_t *)serial_datap;
 
         if (qsfpp_serial_id->diag_monitor_type.average_input_optical_power) {
+            port->dom_supported = true;
             port->a2_read_requested = true;
             VLOG_DBG("qsfpp serial id data indicates that the DOM info is present");
         }
@@ -69,10 +76,175 @@ set_a2_read_request(pm_port_t *port, pm_sfp_serial_id_t *serial_datap)
 
 
 /*
- * pm_set_a2: set the a2 value (force, since it's on demand)
+ * pm_delete_all_dom_data: delete all DOM attributes
  */
 void
-pm_set_a2(pm_port_t *port, pm_sfp_dom_t *a2_data)
+pm_delete_all_dom_data(pm_module_t *port)
+{
+    // struct ovs_module_dom_info only holds string pointers
+    char **fields = (char **)&port->ovs_module_dom_columns;
+    size_t n_fields = sizeof(struct ovs_module_dom_info) / sizeof(char *);
+    size_t idx;
+
+    for (idx = 0; idx < n_fields; idx++) {
+        if (NULL != fields[idx]) {
+            free(fields[idx]);
+            fields[idx] = NULL;
+            port->module_dom_changed = true;
+        }
+    }
+    port->dom_supported = false;
+    port->dom_sample_valid = false;
+    port->dom_sample_stale = false;
+    memset(&port->dom_sample, 0, sizeof(port->dom_sample));
+}
+
+/*
+ * pm_dom_flags: pack one measurement's alarm/warning bits into PM_DOM_FLAG()s
+ */
+static uint32_t
+pm_dom_flags(int measure, bool high_alarm, bool low_alarm,
+             bool high_warning, bool low_warning)
+{
+    uint32_t flags = 0;
+
+    if (high_alarm) {
+        flags |= PM_DOM_FLAG(measure, PM_DOM_HIGH_ALARM);
+    }
+    if (low_alarm) {
+        flags |= PM_DOM_FLAG(measure, PM_DOM_LOW_ALARM);
+    }
+    if (high_warning) {
+        flags |= PM_DOM_FLAG(measure, PM_DOM_HIGH_WARNING);
+    }
+    if (low_warning) {
+        flags |= PM_DOM_FLAG(measure, PM_DOM_LOW_WARNING);
+    }
+
+    return flags;
+}
+
+/*
+ * pm_set_dom_sample: keep the DOM reading in raw units, for consumers that
+ *                    don't want to parse the pm_info strings
+ */
+static void
+pm_set_dom_sample(pm_module_t *port, int type, pm_sfp_dom_t *a2_data)
+{
+    pm_dom_sample_t *sample = &port->dom_sample;
+    pm_qsfp_dom_t *qsfp_a2_data;
+    pm_sfp_alarm_warning_bits_t *bits;
+    pm_qsfp_interrupt_flags_t *flags;
+    pm_qsfp_channel_monitors_t *chan;
+
+    memset(sample, 0, sizeof(*sample));
+
+    if (MODULE_TYPE_SFP_PLUS == type) {
+        bits = &a2_data->alarm_warning_bits;
+
+        sample->n_lanes = 1;
+        sample->temperature = (int16_t)DOM_RAW(a2_data->temperature_msb,
+                                               a2_data->temperature_lsb);
+        sample->vcc = DOM_RAW(a2_data->vcc_msb, a2_data->vcc_lsb);
+        sample->tx_bias[0] = DOM_RAW(a2_data->tx_bias_msb,
+                                     a2_data->tx_bias_lsb);
+        sample->tx_power[0] = DOM_RAW(a2_data->tx_power_msb,
+                                      a2_data->tx_power_lsb);
+        sample->rx_power[0] = DOM_RAW(a2_data->rx_power_msb,
+                                      a2_data->rx_power_lsb);
+
+        sample->flags =
+            pm_dom_flags(PM_DOM_TEMP, bits->temp_high_alarm,
+                         bits->temp_low_alarm, bits->temp_high_warning,
+                         bits->temp_low_warning) |
+            pm_dom_flags(PM_DOM_VCC, bits->vcc_high_alarm,
+                         bits->vcc_low_alarm, bits->vcc_high_warning,
+                         bits->vcc_low_warning) |
+            pm_dom_flags(PM_DOM_TX_BIAS, bits->tx_bias_high_alarm,
+                         bits->tx_bias_low_alarm, bits->tx_bias_high_warning,
+                         bits->tx_bias_low_warning) |
+            pm_dom_flags(PM_DOM_TX_POWER, bits->tx_pwr_high_alarm,
+                         bits->tx_pwr_low_alarm, bits->tx_pwr_high_warning,
+                         bits->tx_pwr_low_warning) |
+            pm_dom_flags(PM_DOM_RX_POWER, bits->rx_pwr_high_alarm,
+                         bits->rx_pwr_low_alarm, bits->rx_pwr_high_warning,
+                         bits->rx_pwr_low_warning);
+    } else {
+        qsfp_a2_data = (pm_qsfp_dom_t *)a2_data;
+        flags = &qsfp_a2_data->interrupt_flags;
+        chan = &qsfp_a2_data->channel_monitors;
+
+        // QSFP lower page has no tx power monitors; tx_power stays 0
+        sample->n_lanes = PM_DOM_MAX_LANES;
+        sample->temperature =
+            (int16_t)DOM_RAW(qsfp_a2_data->module_monitors.temp_msb,
+                             qsfp_a2_data->module_monitors.temp_lsb);
+        sample->vcc = DOM_RAW(qsfp_a2_data->module_monitors.voltage_msb,
+                              qsfp_a2_data->module_monitors.voltage_lsb);
+        sample->tx_bias[0] = DOM_RAW(chan->tx1_bias_msb, chan->tx1_bias_lsb);
+        sample->tx_bias[1] = DOM_RAW(chan->tx2_bias_msb, chan->tx2_bias_lsb);
+        sample->tx_bias[2] = DOM_RAW(chan->tx3_bias_msb, chan->tx3_bias_lsb);
+        sample->tx_bias[3] = DOM_RAW(chan->tx4_bias_msb, chan->tx4_bias_lsb);
+        sample->rx_power[0] = DOM_RAW(chan->rx1_power_msb, chan->rx1_power_lsb);
+        sample->rx_power[1] = DOM_RAW(chan->rx2_power_msb, chan->rx2_power_lsb);
+        sample->rx_power[2] = DOM_RAW(chan->rx3_power_msb, chan->rx3_power_lsb);
+        sample->rx_power[3] = DOM_RAW(chan->rx4_power_msb, chan->rx4_power_lsb);
+
+        sample->flags =
+            pm_dom_flags(PM_DOM_TEMP, flags->latched_temp_high_alarm,
+                         flags->latched_temp_low_alarm,
+                         flags->latched_temp_high_warning,
+                         flags->latched_temp_low_warning) |
+            pm_dom_flags(PM_DOM_VCC, flags->latched_vcc_high_alarm,
+                         flags->latched_vcc_low_alarm,
+                         flags->latched_vcc_high_warning,
+                         flags->latched_vcc_low_warning) |
+            pm_dom_flags(PM_DOM_TX_BIAS,
+                         flags->latched_tx1_bias_high_alarm |
+                         flags->latched_tx2_bias_high_alarm |
+                         flags->latched_tx3_bias_high_alarm |
+                         flags->latched_tx4_bias_high_alarm,
+                         flags->latched_tx1_bias_low_alarm |
+                         flags->latched_tx2_bias_low_alarm |
+                         flags->latched_tx3_bias_low_alarm |
+                         flags->latched_tx4_bias_low_alarm,
+                         flags->latched_tx1_bias_high_warning |
+                         flags->latched_tx2_bias_high_warning |
+                         flags->latched_tx3_bias_high_warning |
+                         flags->latched_tx4_bias_high_warning,
+                         flags->latched_tx1_bias_low_warning |
+                         flags->latched_tx2_bias_low_warning |
+                         flags->latched_tx3_bias_low_warning |
+                         flags->latched_tx4_bias_low_warning) |
+            pm_dom_flags(PM_DOM_RX_POWER,
+                         flags->latched_rx1_power_high_alarm |
+                         flags->latched_rx2_power_high_alarm |
+                         flags->latched_rx3_power_high_alarm |
+                         flags->latched_rx4_power_high_alarm,
+                         flags->latched_rx1_power_low_alarm |
+                         flags->latched_rx2_power_low_alarm |
+                         flags->latched_rx3_power_low_alarm |
+                         flags->latched_rx4_power_low_alarm,
+                         flags->latched_rx1_power_high_warning |
+                         flags->latched_rx2_power_high_warning |
+                         flags->latched_rx3_power_high_warning |
+                         flags->latched_rx4_power_high_warning,
+                         flags->latched_rx1_power_low_warning |
+                         flags->latched_rx2_power_low_warning |
+                         flags->latched_rx3_power_low_warning |
+                         flags->latched_rx4_power_low_warning);
+    }
+
+    port->dom_sample_valid = true;
+}
+
+/*
+ * pm_set_a2: set the a2 value (force, since it's on demand)
+ *
+ * returns 0 if the page was decoded, -1 if the port can't have DOM data
+ */
+int
+pm_set_a2(pm_module_t *port, pm_sfp_dom_t *a2_data)
 {
     int type;
     float temperature, temp_high_alarm, temp_low_alarm,
@@ -90,32 +262,32 @@ pm_set_a2(pm_port_t *port, pm_sfp_dom_t *a2_data)
     pm_qsfp_dom_t *qsfp_a2_data;
 
     // ignore modules that aren't pluggable
-    if (false == port->module_device->pluggable) {
-        VLOG_DBG("port is not pluggable: %s", port->instance);
-        return;
+    if (false == port->pluggable) {
+        VLOG_DBG("port is not pluggable: %s", port->name);
+        return -1;
     }
 
     // ignore modules that don't have connector data
-    if (NULL == port->module_device->connector) {
-        VLOG_WARN("no connector info for port: %s", port->instance);
-        return;
+    if (NULL == port->connector) {
+        VLOG_WARN("no connector info for port: %s", port->name);
+        return -1;
     }
 
     // prepare for handling SFP+ and QSFP differently
-    if (strcmp(port->module_device->connector, CONNECTOR_SFP_PLUS) == 0) {
+    if (strcmp(port->connector, CONNECTOR_SFP_PLUS) == 0) {
         type = MODULE_TYPE_SFP_PLUS;
-    } else if (strcmp(port->module_device->connector, CONNECTOR_QSFP_PLUS) == 0) {
+    } else if (strcmp(port->connector, CONNECTOR_QSFP_PLUS) == 0) {
         type = MODULE_TYPE_QSFP_PLUS;
-    } else if (strcmp(port->module_device->connector, CONNECTOR_QSFP28) == 0) {
+    } else if (strcmp(port->connector, CONNECTOR_QSFP28) == 0) {
         type = MODULE_TYPE_QSFP28;
     } else {
         VLOG_WARN("unknown connector type for port: %s (%s)",
-                  port->instance, port->module_device->connector);
+                  port->name, port->connector);
 
         // to-do: delete the dom information when the connector type is unknown
         // pm_delete_all_dom_data(port);
         SET_STATIC_STRING(port, connector, OVSREC_INTERFACE_PM_INFO_CONNECTOR_UNKNOWN);
-        return;
+        return -1;
     }
 
     switch (type) {
@@ -277,7 +449,7 @@ pm_set_a2(pm_port_t *port, pm_sfp_dom_t *a2_data)
             SET_FLOAT_STRING(port, tx_power_low_warning_threshold, tx_power_low_warning);
 
 
-            SET_BINARY(port, a2, (char *)a2_data, sizeof(pm_sfp_dom_t));
+            SET_DOM_BINARY(port, a2, (char *)a2_data, sizeof(pm_sfp_dom_t));
             break;
         case MODULE_TYPE_QSFP_PLUS:
         case MODULE_TYPE_QSFP28:
@@ -419,7 +591,11 @@ pm_set_a2(pm_port_t *port, pm_sfp_dom_t *a2_data)
                             qsfp_a2_data->interrupt_flags.latched_rx4_power_low_warning);
 
 
-            SET_BINARY(port, a2, (char *)qsfp_a2_data, sizeof(pm_qsfp_dom_t));
+            SET_DOM_BINARY(port, a2, (char *)qsfp_a2_data, sizeof(pm_qsfp_dom_t));
             break;
     }
+
+    pm_set_dom_sample(port, type, a2_data);
+
+    return 0;
 }
@@ -0,0 +1,172 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for the per-port DOM sample history.
+ *
+ * Every port owns a ring of the last pm_dom_history_depth DOM samples. The
+ * ring is allocated when the port is created, so recording a sample never
+ * allocates.
+ ***************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <util.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+
+VLOG_DEFINE_THIS_MODULE(pm_dom_history);
+
+extern struct shash ovs_intfs;
+
+// number of samples kept per port, set with --dom-history
+unsigned int pm_dom_history_depth = PM_DOM_HISTORY_DEPTH;
+
+/*
+ * pm_dom_history_init: allocate the sample ring of a new port
+ */
+void
+pm_dom_history_init(pm_port_t *port)
+{
+    port->dom_history = NULL;
+    port->dom_history_next = 0;
+    port->dom_history_count = 0;
+
+    if (0 != pm_dom_history_depth) {
+        port->dom_history = xcalloc(pm_dom_history_depth,
+                                    sizeof(pm_dom_history_entry_t));
+    }
+}
+
+/*
+ * pm_dom_history_destroy: free the sample ring of a deleted port
+ */
+void
+pm_dom_history_destroy(pm_port_t *port)
+{
+    free(port->dom_history);
+    port->dom_history = NULL;
+    port->dom_history_count = 0;
+}
+
+/*
+ * pm_dom_history_add: record the port's current DOM sample, overwriting the
+ *                     oldest one once the ring is full
+ */
+void
+pm_dom_history_add(pm_port_t *port)
+{
+    pm_dom_history_entry_t *entry;
+
+    if (NULL == port->dom_history) {
+        return;
+    }
+
+    entry = &port->dom_history[port->dom_history_next];
+    entry->time = port->dom_sample_time;
+    entry->sample = port->module.dom_sample;
+
+    port->dom_history_next = (port->dom_history_next + 1) %
+                             pm_dom_history_depth;
+    if (port->dom_history_count < pm_dom_history_depth) {
+        port->dom_history_count++;
+    }
+}
+
+// put lane values of one measurement, e.g. "1.23/1.20/1.25/1.22"
+static void
+pm_dom_history_put_lanes(struct ds *ds, const uint16_t *raw, int n_lanes,
+                         double scale)
+{
+    int lane;
+
+    for (lane = 0; lane < n_lanes; lane++) {
+        ds_put_format(ds, "%s%.4f", lane ? "/" : "", raw[lane] * scale);
+    }
+}
+
+static void
+pm_dom_history_put_entry(struct ds *ds, const pm_dom_history_entry_t *entry)
+{
+    const pm_dom_sample_t *sample = &entry->sample;
+    time_t secs = entry->time / 1000;
+    struct tm tm;
+    char buf[32];
+
+    localtime_r(&secs, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+
+    // convert to the units used in pm_info
+    ds_put_format(ds, "    %s.%03lld temperature=%.2f vcc=%.4f tx_bias=",
+                  buf, entry->time % 1000, sample->temperature / 256.0,
+                  sample->vcc * 0.0001);
+    pm_dom_history_put_lanes(ds, sample->tx_bias, sample->n_lanes, 0.002);
+    ds_put_cstr(ds, " tx_power=");
+    pm_dom_history_put_lanes(ds, sample->tx_power, sample->n_lanes, 0.0001);
+    ds_put_cstr(ds, " rx_power=");
+    pm_dom_history_put_lanes(ds, sample->rx_power, sample->n_lanes, 0.0001);
+    ds_put_format(ds, " flags=0x%05x\n", sample->flags);
+}
+
+/*
+ * pm_dom_history_dump: show the most recent DOM samples of an interface
+ *
+ * input: output string, interface name, number of samples (0 for all)
+ *
+ * output: 0 on success, -1 if the interface is unknown
+ */
+int
+pm_dom_history_dump(struct ds *ds, const char *name, unsigned int n)
+{
+    pm_port_t *port;
+    unsigned int idx;
+    unsigned int slot;
+
+    port = shash_find_data(&ovs_intfs, name);
+    if (NULL == port) {
+        ds_put_format(ds, "no pluggable interface named %s", name);
+        return -1;
+    }
+
+    if (0 == pm_dom_history_depth) {
+        ds_put_cstr(ds, "DOM history is disabled (--dom-history=0)");
+        return 0;
+    }
+
+    if (0 == n || n > port->dom_history_count) {
+        n = port->dom_history_count;
+    }
+
+    ds_put_format(ds, "DOM history for Interface %s (%u of %u samples):\n",
+                  port->instance, n, pm_dom_history_depth);
+
+    // oldest first
+    for (idx = 0; idx < n; idx++) {
+        slot = (port->dom_history_next + pm_dom_history_depth - n + idx) %
+               pm_dom_history_depth;
+        pm_dom_history_put_entry(ds, &port->dom_history[slot]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,423 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for pluggable module I2C access.
+ *
+ * All bus traffic of the daemon goes through the functions in this file, so
+ * that every operation is timed and accounted per bus and per port, and can
+ * be recorded to or replayed from an I2C trace (pm_i2c_trace.c). In the
+ * simulation they drive the simulated bus (pm_sim_bus.c) instead.
+ ***************************************************************************/
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <coverage.h>
+#include <shash.h>
+#include <timeval.h>
+#include <util.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+#include "pm_perf.h"
+
+VLOG_DEFINE_THIS_MODULE(pm_i2c);
+
+COVERAGE_DEFINE(pm_i2c_op);
+COVERAGE_DEFINE(pm_i2c_failure);
+COVERAGE_DEFINE(pm_i2c_retry);
+COVERAGE_DEFINE(pm_i2c_checksum_failure);
+COVERAGE_DEFINE(pm_i2c_reset);
+
+extern YamlConfigHandle global_yaml_handle;
+extern struct shash ovs_intfs;
+
+// bus name -> struct pm_i2c_stats
+static struct shash pm_i2c_buses = SHASH_INITIALIZER(&pm_i2c_buses);
+
+// all operations, on every bus
+static uint64_t pm_i2c_ops = 0;
+
+static struct pm_i2c_stats *
+pm_i2c_bus_stats(const char *bus)
+{
+    struct pm_i2c_stats *stats;
+
+    if (NULL == bus) {
+        bus = "unknown";
+    }
+
+    stats = shash_find_data(&pm_i2c_buses, bus);
+    if (NULL == stats) {
+        stats = xzalloc(sizeof(*stats));
+        shash_add(&pm_i2c_buses, bus, stats);
+    }
+
+    return stats;
+}
+
+static const YamlDevice *
+pm_i2c_reg_device(const pm_port_t *port, const i2c_bit_op *reg_op)
+{
+    if (NULL == reg_op) {
+        return NULL;
+    }
+
+    return yaml_find_device(global_yaml_handle, port->subsystem,
+                            reg_op->device);
+}
+
+// describe a register operation for the I2C trace
+static void
+pm_i2c_reg_xfer(struct pm_i2c_xfer *xfer, enum pm_i2c_op op,
+                const YamlDevice *device, const i2c_bit_op *reg_op,
+                uint32_t *value)
+{
+    xfer->op = op;
+    xfer->bus = (NULL == device) ? NULL : device->bus;
+    xfer->address = (NULL == device) ? 0 : device->address;
+    xfer->offset = (NULL == reg_op) ? 0 : reg_op->register_address;
+    xfer->mask = (NULL == reg_op) ? 0 : reg_op->bit_mask;
+    xfer->len = sizeof(*value);
+    xfer->data = value;
+}
+
+// describe a data operation for the I2C trace
+static void
+pm_i2c_data_xfer(struct pm_i2c_xfer *xfer, enum pm_i2c_op op,
+                 const YamlDevice *device, size_t offset, size_t len,
+                 void *data)
+{
+    xfer->op = op;
+    xfer->bus = (NULL == device) ? NULL : device->bus;
+    xfer->address = (NULL == device) ? 0 : device->address;
+    xfer->offset = offset;
+    xfer->mask = 0;
+    xfer->len = len;
+    xfer->data = data;
+}
+
+// bus of the module eeprom; used for events that aren't a single operation
+static const char *
+pm_i2c_port_bus(const pm_port_t *port)
+{
+    const YamlDevice *device;
+
+    device = yaml_find_device(global_yaml_handle, port->subsystem,
+                              port->module_device->module_eeprom);
+
+    return (NULL == device) ? NULL : device->bus;
+}
+
+static uint64_t
+pm_i2c_account(pm_port_t *port, const char *bus, enum pm_perf_id id,
+               size_t bytes, int rc, uint64_t start)
+{
+    struct pm_i2c_stats *stats[2];
+    long long int now = time_wall_msec();
+    uint64_t usecs;
+    int idx;
+
+    usecs = pm_perf_now() - start;
+    pm_perf_record(id, usecs);
+
+    COVERAGE_INC(pm_i2c_op);
+    pm_i2c_ops++;
+    if (0 != rc) {
+        COVERAGE_INC(pm_i2c_failure);
+    }
+
+    stats[0] = &port->i2c_stats;
+    stats[1] = pm_i2c_bus_stats(bus);
+
+    for (idx = 0; idx < ARRAY_SIZE(stats); idx++) {
+        stats[idx]->ops++;
+        stats[idx]->usecs += usecs;
+        stats[idx]->last_op = now;
+        if (0 == rc) {
+            stats[idx]->bytes += bytes;
+        } else {
+            stats[idx]->failures++;
+        }
+    }
+
+    return usecs;
+}
+
+int
+pm_i2c_reg_read(pm_port_t *port, const i2c_bit_op *reg_op, uint32_t *result)
+{
+    const YamlDevice *device = pm_i2c_reg_device(port, reg_op);
+    struct pm_i2c_xfer xfer;
+    uint64_t start = pm_perf_now();
+    uint64_t usecs;
+    int rc;
+
+    pm_i2c_reg_xfer(&xfer, PM_I2C_REG_READ, device, reg_op, result);
+    if (false == pm_i2c_replay_op(&xfer, &rc)) {
+#ifdef PLATFORM_SIMULATION
+        rc = pm_sim_bus_reg_read(port, xfer.bus, reg_op, result);
+#else
+        rc = i2c_reg_read(global_yaml_handle, port->subsystem, reg_op,
+                          result);
+#endif
+    }
+    usecs = pm_i2c_account(port, xfer.bus, PM_PERF_I2C_REG_READ,
+                           (NULL == reg_op) ? 0 : reg_op->register_size, rc,
+                           start);
+    pm_i2c_trace_op(&xfer, rc, start, usecs);
+
+    return rc;
+}
+
+int
+pm_i2c_reg_write(pm_port_t *port, const i2c_bit_op *reg_op, uint32_t data)
+{
+    const YamlDevice *device = pm_i2c_reg_device(port, reg_op);
+    struct pm_i2c_xfer xfer;
+    uint64_t start = pm_perf_now();
+    uint64_t usecs;
+    int rc;
+
+    pm_i2c_reg_xfer(&xfer, PM_I2C_REG_WRITE, device, reg_op, &data);
+    if (false == pm_i2c_replay_op(&xfer, &rc)) {
+#ifdef PLATFORM_SIMULATION
+        rc = pm_sim_bus_reg_write(port, xfer.bus, reg_op, data);
+#else
+        rc = i2c_reg_write(global_yaml_handle, port->subsystem, reg_op, data);
+#endif
+    }
+    usecs = pm_i2c_account(port, xfer.bus, PM_PERF_I2C_REG_WRITE,
+                           (NULL == reg_op) ? 0 : reg_op->register_size, rc,
+                           start);
+    pm_i2c_trace_op(&xfer, rc, start, usecs);
+
+    return rc;
+}
+
+int
+pm_i2c_data_read(pm_port_t *port, const YamlDevice *device, size_t offset,
+                 size_t len, void *data)
+{
+    struct pm_i2c_xfer xfer;
+    uint64_t start = pm_perf_now();
+    uint64_t usecs;
+    int rc;
+
+    pm_i2c_data_xfer(&xfer, PM_I2C_DATA_READ, device, offset, len, data);
+    if (false == pm_i2c_replay_op(&xfer, &rc)) {
+#ifdef PLATFORM_SIMULATION
+        rc = pm_sim_bus_data_read(port, xfer.bus, device, offset, len, data);
+#else
+        rc = i2c_data_read(global_yaml_handle, device, port->subsystem,
+                           offset, len, data);
+#endif
+    }
+    usecs = pm_i2c_account(port, xfer.bus, PM_PERF_I2C_DATA_READ, len, rc,
+                           start);
+    pm_i2c_trace_op(&xfer, rc, start, usecs);
+
+    return rc;
+}
+
+int
+pm_i2c_data_write(pm_port_t *port, const YamlDevice *device, size_t offset,
+                  size_t len, void *data)
+{
+    struct pm_i2c_xfer xfer;
+    uint64_t start = pm_perf_now();
+    uint64_t usecs;
+    int rc;
+
+    pm_i2c_data_xfer(&xfer, PM_I2C_DATA_WRITE, device, offset, len, data);
+    if (false == pm_i2c_replay_op(&xfer, &rc)) {
+#ifdef PLATFORM_SIMULATION
+        rc = pm_sim_bus_data_write(port, xfer.bus, device, offset, len, data);
+#else
+        rc = i2c_data_write(global_yaml_handle, device, port->subsystem,
+                            offset, len, data);
+#endif
+    }
+    usecs = pm_i2c_account(port, xfer.bus, PM_PERF_I2C_DATA_WRITE, len, rc,
+                           start);
+    pm_i2c_trace_op(&xfer, rc, start, usecs);
+
+    return rc;
+}
+
+uint64_t
+pm_i2c_op_count(void)
+{
+    return pm_i2c_ops;
+}
+
+/*
+ * pm_i2c_event: account an event that isn't a single bus operation
+ *               (a retry, a checksum failure or a module reset)
+ */
+void
+pm_i2c_event(pm_port_t *port, enum pm_i2c_event event)
+{
+    struct pm_i2c_stats *stats[2];
+    int idx;
+
+    stats[0] = &port->i2c_stats;
+    stats[1] = pm_i2c_bus_stats(pm_i2c_port_bus(port));
+
+    for (idx = 0; idx < ARRAY_SIZE(stats); idx++) {
+        switch (event) {
+        case PM_I2C_RETRY:
+            stats[idx]->retries++;
+            break;
+        case PM_I2C_CHECKSUM_FAILURE:
+            stats[idx]->checksum_failures++;
+            break;
+        case PM_I2C_RESET:
+            stats[idx]->resets++;
+            break;
+        }
+    }
+
+    switch (event) {
+    case PM_I2C_RETRY:
+        COVERAGE_INC(pm_i2c_retry);
+        break;
+    case PM_I2C_CHECKSUM_FAILURE:
+        COVERAGE_INC(pm_i2c_checksum_failure);
+        break;
+    case PM_I2C_RESET:
+        COVERAGE_INC(pm_i2c_reset);
+        break;
+    }
+}
+
+static void
+pm_i2c_stats_dump(struct ds *ds, const char *name,
+                  const struct pm_i2c_stats *stats)
+{
+    ds_put_format(ds, "%-20s %10llu %10llu %8llu %8llu %8llu %8llu %12llu\n",
+                  name,
+                  (unsigned long long)stats->ops,
+                  (unsigned long long)stats->bytes,
+                  (unsigned long long)stats->retries,
+                  (unsigned long long)stats->failures,
+                  (unsigned long long)stats->checksum_failures,
+                  (unsigned long long)stats->resets,
+                  (unsigned long long)stats->usecs);
+}
+
+static void
+pm_i2c_header_dump(struct ds *ds, const char *title)
+{
+    ds_put_format(ds, "%-20s %10s %10s %8s %8s %8s %8s %12s\n",
+                  title, "ops", "bytes", "retries", "failures",
+                  "checksum", "resets", "usecs");
+}
+
+/*
+ * pm_i2c_dump: show I2C accounting by bus and by port
+ */
+void
+pm_i2c_dump(struct ds *ds)
+{
+    const struct shash_node **nodes;
+    size_t idx;
+
+    ds_put_cstr(ds, "================ I2C by bus ================\n");
+    pm_i2c_header_dump(ds, "bus");
+    nodes = shash_sort(&pm_i2c_buses);
+    for (idx = 0; idx < shash_count(&pm_i2c_buses); idx++) {
+        pm_i2c_stats_dump(ds, nodes[idx]->name, nodes[idx]->data);
+    }
+    free(nodes);
+
+    ds_put_cstr(ds, "================ I2C by port ===============\n");
+    pm_i2c_header_dump(ds, "port");
+    nodes = shash_sort(&ovs_intfs);
+    for (idx = 0; idx < shash_count(&ovs_intfs); idx++) {
+        const pm_port_t *port = nodes[idx]->data;
+
+        if (NULL != port) {
+            pm_i2c_stats_dump(ds, port->instance, &port->i2c_stats);
+        }
+    }
+    free(nodes);
+}
+
+/*
+ * pm_i2c_metrics: per-bus I2C counters in the Prometheus text format
+ */
+void
+pm_i2c_metrics(struct ds *ds)
+{
+    static const struct {
+        const char *name;
+        size_t offset;
+        const char *help;
+    } counters[] = {
+        { "ops_pmd_i2c_operations_total",
+          offsetof(struct pm_i2c_stats, ops), "I2C operations." },
+        { "ops_pmd_i2c_bytes_total",
+          offsetof(struct pm_i2c_stats, bytes), "Bytes transferred." },
+        { "ops_pmd_i2c_failures_total",
+          offsetof(struct pm_i2c_stats, failures), "Failed operations." },
+        { "ops_pmd_i2c_retries_total",
+          offsetof(struct pm_i2c_stats, retries),
+          "Operations repeated after a failure." },
+        { "ops_pmd_i2c_checksum_failures_total",
+          offsetof(struct pm_i2c_stats, checksum_failures),
+          "Serial ID checksum mismatches." },
+        { "ops_pmd_i2c_resets_total",
+          offsetof(struct pm_i2c_stats, resets), "Module resets." },
+    };
+    const struct shash_node **nodes;
+    const struct pm_i2c_stats *stats;
+    size_t count = shash_count(&pm_i2c_buses);
+    size_t metric;
+    size_t idx;
+
+    nodes = shash_sort(&pm_i2c_buses);
+
+    for (metric = 0; metric < ARRAY_SIZE(counters); metric++) {
+        ds_put_format(ds, "# HELP %s %s\n# TYPE %s counter\n",
+                      counters[metric].name, counters[metric].help,
+                      counters[metric].name);
+        for (idx = 0; idx < count; idx++) {
+            stats = nodes[idx]->data;
+            ds_put_format(ds, "%s{bus=\"", counters[metric].name);
+            pm_metrics_label(ds, nodes[idx]->name);
+            ds_put_format(ds, "\"} %llu\n", (unsigned long long)
+                          *(const uint64_t *)((const char *)stats +
+                                              counters[metric].offset));
+        }
+    }
+
+    ds_put_cstr(ds, "# HELP ops_pmd_i2c_seconds_total Time spent on the bus."
+                "\n# TYPE ops_pmd_i2c_seconds_total counter\n");
+    for (idx = 0; idx < count; idx++) {
+        stats = nodes[idx]->data;
+        ds_put_cstr(ds, "ops_pmd_i2c_seconds_total{bus=\"");
+        pm_metrics_label(ds, nodes[idx]->name);
+        ds_put_format(ds, "\"} %.6f\n", stats->usecs * 1e-6);
+    }
+
+    free(nodes);
+}
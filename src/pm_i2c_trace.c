@@ -0,0 +1,685 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for I2C trace recording and replay.
+ *
+ * Recording ("--i2c-trace=FILE" or "ops-pmd/i2c-trace start FILE") writes
+ * every bus operation made through pm_i2c.c to a binary trace file: when it
+ * started and how long it took, the bus, the device address, the register
+ * or EEPROM offset, the length, the data and the result.
+ *
+ * Replay ("--i2c-replay=FILE") answers the daemon's bus operations from a
+ * trace instead of the hardware (or the simulated bus). Each operation is
+ * matched by bus, type, device address, offset, register bit mask and
+ * length, and gets the result and data that were recorded last for it at
+ * the same time into the trace, after the same delay. Modules therefore
+ * come and go, and buses fail, when they did on the recorded system,
+ * however often the daemon looks. Operations the trace has no record of
+ * fail. Before the first record of an operation its first record is used,
+ * after the last its last. A replay lasts until the daemon exits;
+ * "ops-pmd/i2c-trace stop" only ends a recording.
+ *
+ * The file is a header followed by records, in host byte order (the
+ * header's byte_order tells a reader if it doesn't match):
+ *
+ *      header  magic "PMDI2CT", version, byte_order, wall clock start
+ *      record  40 bytes (struct pm_i2c_trace_rec), then n_data bytes
+ *
+ * A bus is named by a PM_I2C_TRACE_BUS record, whose data is the name,
+ * before the first record that uses its number.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <shash.h>
+#include <timeval.h>
+#include <util.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+#include "pm_perf.h"
+
+VLOG_DEFINE_THIS_MODULE(pm_i2c_trace);
+
+#define PM_I2C_TRACE_MAGIC          "PMDI2CT"
+#define PM_I2C_TRACE_VERSION        1
+#define PM_I2C_TRACE_BYTE_ORDER     0x01020304
+
+// record type naming a bus; the others are enum pm_i2c_op
+#define PM_I2C_TRACE_BUS            0xff
+
+// default size limit of a recording
+#define PM_I2C_TRACE_MAX_MB         64
+
+// how often a recording is flushed to the file
+#define PM_I2C_TRACE_FLUSH_USECS    1000000
+
+struct pm_i2c_trace_header {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    byte_order;
+    int64_t     start;          // wall clock msecs at time 0
+};
+
+struct pm_i2c_trace_rec {
+    uint64_t    time;           // usecs from the start of the trace
+    uint32_t    address;        // device address
+    uint32_t    offset;         // register address, or EEPROM offset
+    uint32_t    mask;           // register bit mask; 0 for data
+    int32_t     rc;             // result
+    uint32_t    usecs;          // time the operation took
+    uint16_t    len;            // bytes read or written
+    uint16_t    bus;            // bus number
+    uint16_t    op;             // enum pm_i2c_op, or PM_I2C_TRACE_BUS
+    uint16_t    n_data;         // bytes of data following the record
+    uint32_t    reserved;
+};
+
+// recording
+struct pm_i2c_recording {
+    char        *file;
+    FILE        *fp;
+    uint64_t    start;          // pm_perf_now() at time 0
+    uint64_t    flushed;        // pm_perf_now() of the last flush
+    uint64_t    bytes;          // written so far
+    uint64_t    max_bytes;
+    uint64_t    ops;
+    struct shash buses;         // name -> bus number (as a pointer)
+};
+
+// one recorded result of an operation
+struct pm_i2c_replay_rec {
+    uint64_t    time;
+    uint32_t    usecs;
+    int32_t     rc;
+    uint16_t    n_data;
+    unsigned char *data;
+};
+
+// all the recorded results of one operation, in time order
+struct pm_i2c_replay_op {
+    struct pm_i2c_replay_rec *recs;
+    size_t      n_recs;
+    size_t      allocated_recs;
+    size_t      cur;
+};
+
+// replay
+struct pm_i2c_replay {
+    char        *file;
+    uint64_t    start;          // pm_perf_now() at time 0
+    uint64_t    end;            // time of the last record
+    size_t      n_recs;
+    uint64_t    ops;            // answered from the trace
+    uint64_t    unmatched;      // with no record; failed
+    struct shash ops_by_key;    // pm_i2c_replay_key() -> replay_op
+};
+
+static struct pm_i2c_recording *pm_i2c_recording = NULL;
+static struct pm_i2c_replay *pm_i2c_replay = NULL;
+
+static const char *pm_i2c_op_names[] = {
+    [PM_I2C_REG_READ]   = "reg-read",
+    [PM_I2C_REG_WRITE]  = "reg-write",
+    [PM_I2C_DATA_READ]  = "data-read",
+    [PM_I2C_DATA_WRITE] = "data-write",
+};
+
+static bool
+pm_i2c_op_reads(enum pm_i2c_op op)
+{
+    return PM_I2C_REG_READ == op || PM_I2C_DATA_READ == op;
+}
+
+/*
+ * pm_i2c_replay_key: the key matching an operation to its records;
+ *                    valid until the next call
+ */
+static const char *
+pm_i2c_replay_key(enum pm_i2c_op op, const char *bus, uint32_t address,
+                  uint32_t offset, uint32_t mask, size_t len)
+{
+    static struct ds key = DS_EMPTY_INITIALIZER;
+
+    ds_clear(&key);
+    ds_put_format(&key, "%s %d %"PRIu32" %"PRIu32" %"PRIx32" %"PRIuSIZE,
+                  (NULL == bus) ? "unknown" : bus, op, address, offset, mask,
+                  len);
+
+    return ds_cstr(&key);
+}
+
+static int
+pm_i2c_trace_write(const void *data, size_t len)
+{
+    if (len != fwrite(data, 1, len, pm_i2c_recording->fp)) {
+        return -1;
+    }
+    pm_i2c_recording->bytes += len;
+
+    return 0;
+}
+
+static void
+pm_i2c_trace_close(const char *why)
+{
+    struct pm_i2c_recording *rec = pm_i2c_recording;
+
+    if (NULL == rec) {
+        return;
+    }
+
+    if (0 != fclose(rec->fp)) {
+        VLOG_WARN("%s: close failed (%s)", rec->file, ovs_strerror(errno));
+    }
+    VLOG_INFO("stopped recording I2C trace %s (%s): %"PRIu64" operations, "
+              "%"PRIu64" bytes", rec->file, why, rec->ops, rec->bytes);
+
+    shash_destroy(&rec->buses);
+    free(rec->file);
+    free(rec);
+    pm_i2c_recording = NULL;
+}
+
+/*
+ * pm_i2c_trace_start: start recording bus operations to file, up to
+ *                     max_mb megabytes
+ */
+int
+pm_i2c_trace_start(const char *file, unsigned int max_mb, struct ds *ds)
+{
+    struct pm_i2c_trace_header header;
+    struct pm_i2c_recording *rec;
+    FILE *fp;
+
+    if (NULL != pm_i2c_replay) {
+        ds_put_cstr(ds, "Can't record while replaying a trace");
+        return -1;
+    }
+
+    // finish the current recording first: it may be the same file
+    pm_i2c_trace_close("restarted");
+
+    fp = fopen(file, "wb");
+    if (NULL == fp) {
+        ds_put_format(ds, "%s: %s", file, ovs_strerror(errno));
+        return -1;
+    }
+
+    rec = xzalloc(sizeof(*rec));
+    rec->file = xstrdup(file);
+    rec->fp = fp;
+    rec->start = pm_perf_now();
+    rec->flushed = rec->start;
+    rec->max_bytes = (uint64_t)(max_mb ? max_mb : PM_I2C_TRACE_MAX_MB)
+                     * 1024 * 1024;
+    shash_init(&rec->buses);
+    pm_i2c_recording = rec;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PM_I2C_TRACE_MAGIC, sizeof(PM_I2C_TRACE_MAGIC));
+    header.version = PM_I2C_TRACE_VERSION;
+    header.byte_order = PM_I2C_TRACE_BYTE_ORDER;
+    header.start = time_wall_msec();
+
+    if (0 != pm_i2c_trace_write(&header, sizeof(header))) {
+        ds_put_format(ds, "%s: %s", file, ovs_strerror(errno));
+        pm_i2c_trace_close("write failed");
+        return -1;
+    }
+
+    VLOG_INFO("recording I2C trace %s, up to %"PRIu64" MB", file,
+              rec->max_bytes / (1024 * 1024));
+    ds_put_format(ds, "Recording to %s", file);
+
+    return 0;
+}
+
+/*
+ * pm_i2c_trace_bus: the number of a bus in the recording; names it in the
+ *                   file the first time
+ */
+static int
+pm_i2c_trace_bus(const char *bus)
+{
+    struct pm_i2c_recording *rec = pm_i2c_recording;
+    struct pm_i2c_trace_rec trace;
+    struct shash_node *node;
+    size_t number;
+
+    if (NULL == bus) {
+        bus = "unknown";
+    }
+
+    node = shash_find(&rec->buses, bus);
+    if (NULL != node) {
+        return (int)(uintptr_t)node->data;
+    }
+
+    number = shash_count(&rec->buses);
+    if (number > UINT16_MAX) {
+        return -1;
+    }
+
+    memset(&trace, 0, sizeof(trace));
+    trace.op = PM_I2C_TRACE_BUS;
+    trace.bus = number;
+    trace.n_data = strlen(bus);
+    if (0 != pm_i2c_trace_write(&trace, sizeof(trace)) ||
+        0 != pm_i2c_trace_write(bus, trace.n_data)) {
+        return -1;
+    }
+
+    shash_add(&rec->buses, bus, (void *)(uintptr_t)number);
+
+    return number;
+}
+
+/*
+ * pm_i2c_trace_op: record an operation that began at start (pm_perf_now())
+ *                  and took usecs, if recording
+ */
+void
+pm_i2c_trace_op(const struct pm_i2c_xfer *xfer, int rc, uint64_t start,
+                uint64_t usecs)
+{
+    struct pm_i2c_recording *rec = pm_i2c_recording;
+    struct pm_i2c_trace_rec trace;
+    int number;
+
+    if (OVS_LIKELY(NULL == rec)) {
+        return;
+    }
+
+    number = pm_i2c_trace_bus(xfer->bus);
+    if (number < 0) {
+        pm_i2c_trace_close("write failed");
+        return;
+    }
+
+    memset(&trace, 0, sizeof(trace));
+    trace.time = start - rec->start;
+    trace.address = xfer->address;
+    trace.offset = xfer->offset;
+    trace.mask = xfer->mask;
+    trace.rc = rc;
+    trace.usecs = MIN(usecs, UINT32_MAX);
+    trace.len = MIN(xfer->len, UINT16_MAX);
+    trace.bus = number;
+    trace.op = xfer->op;
+
+    // a failed read has no data worth keeping
+    if (NULL != xfer->data &&
+        (0 == rc || false == pm_i2c_op_reads(xfer->op))) {
+        trace.n_data = trace.len;
+    }
+
+    if (0 != pm_i2c_trace_write(&trace, sizeof(trace)) ||
+        0 != pm_i2c_trace_write(xfer->data, trace.n_data)) {
+        pm_i2c_trace_close("write failed");
+        return;
+    }
+    rec->ops++;
+
+    if (rec->bytes >= rec->max_bytes) {
+        pm_i2c_trace_close("size limit reached");
+    } else if (start - rec->flushed >= PM_I2C_TRACE_FLUSH_USECS) {
+        // keep what's recorded if the daemon goes down
+        fflush(rec->fp);
+        rec->flushed = start;
+    }
+}
+
+static void
+pm_i2c_replay_free(struct pm_i2c_replay *replay)
+{
+    struct shash_node *node;
+    size_t idx;
+
+    if (NULL == replay) {
+        return;
+    }
+
+    SHASH_FOR_EACH (node, &replay->ops_by_key) {
+        struct pm_i2c_replay_op *replay_op = node->data;
+
+        for (idx = 0; idx < replay_op->n_recs; idx++) {
+            free(replay_op->recs[idx].data);
+        }
+        free(replay_op->recs);
+        free(replay_op);
+    }
+    shash_destroy(&replay->ops_by_key);
+    free(replay->file);
+    free(replay);
+}
+
+static int
+pm_i2c_replay_read(FILE *fp, void *data, size_t len)
+{
+    return (len == fread(data, 1, len, fp)) ? 0 : -1;
+}
+
+/*
+ * pm_i2c_replay_load: read a trace file into replay
+ */
+static int
+pm_i2c_replay_load(struct pm_i2c_replay *replay, FILE *fp, struct ds *ds)
+{
+    struct pm_i2c_trace_header header;
+    struct pm_i2c_trace_rec trace;
+    struct pm_i2c_replay_op *replay_op;
+    struct pm_i2c_replay_rec *rec;
+    char **buses = NULL;
+    size_t n_buses = 0;
+    size_t allocated_buses = 0;
+    const char *key;
+    int rc = -1;
+    size_t idx;
+
+    if (0 != pm_i2c_replay_read(fp, &header, sizeof(header)) ||
+        0 != memcmp(header.magic, PM_I2C_TRACE_MAGIC,
+                    sizeof(PM_I2C_TRACE_MAGIC))) {
+        ds_put_cstr(ds, "not an I2C trace");
+        return -1;
+    }
+    if (PM_I2C_TRACE_BYTE_ORDER != header.byte_order) {
+        ds_put_cstr(ds, "recorded on a system of the other byte order");
+        return -1;
+    }
+    if (PM_I2C_TRACE_VERSION != header.version) {
+        ds_put_format(ds, "version %"PRIu32", expected %d", header.version,
+                      PM_I2C_TRACE_VERSION);
+        return -1;
+    }
+
+    while (0 == pm_i2c_replay_read(fp, &trace, sizeof(trace))) {
+        unsigned char *data = NULL;
+
+        if (trace.n_data > 0) {
+            data = xmalloc(trace.n_data);
+            if (0 != pm_i2c_replay_read(fp, data, trace.n_data)) {
+                free(data);
+                ds_put_cstr(ds, "truncated");
+                goto out;
+            }
+        }
+
+        if (PM_I2C_TRACE_BUS == trace.op) {
+            if (trace.bus != n_buses) {
+                free(data);
+                ds_put_format(ds, "bus %d named out of order", trace.bus);
+                goto out;
+            }
+            if (n_buses >= allocated_buses) {
+                buses = x2nrealloc(buses, &allocated_buses, sizeof *buses);
+            }
+            buses[n_buses++] = xmemdup0((char *)data, trace.n_data);
+            free(data);
+            continue;
+        }
+
+        if (trace.op >= ARRAY_SIZE(pm_i2c_op_names) ||
+            trace.bus >= n_buses ||
+            (trace.n_data > 0 && trace.n_data != trace.len)) {
+            free(data);
+            ds_put_format(ds, "invalid record at %"PRIu64" usecs",
+                          trace.time);
+            goto out;
+        }
+
+        key = pm_i2c_replay_key(trace.op, buses[trace.bus], trace.address,
+                                trace.offset, trace.mask, trace.len);
+        replay_op = shash_find_data(&replay->ops_by_key, key);
+        if (NULL == replay_op) {
+            replay_op = xzalloc(sizeof(*replay_op));
+            shash_add(&replay->ops_by_key, key, replay_op);
+        }
+        if (replay_op->n_recs >= replay_op->allocated_recs) {
+            replay_op->recs = x2nrealloc(replay_op->recs,
+                                         &replay_op->allocated_recs,
+                                         sizeof *replay_op->recs);
+        }
+        rec = &replay_op->recs[replay_op->n_recs++];
+        rec->time = trace.time;
+        rec->usecs = trace.usecs;
+        rec->rc = trace.rc;
+        rec->n_data = trace.n_data;
+        rec->data = data;
+
+        replay->end = MAX(replay->end, trace.time);
+        replay->n_recs++;
+    }
+
+    if (!feof(fp)) {
+        ds_put_format(ds, "%s", ovs_strerror(errno));
+        goto out;
+    }
+    rc = 0;
+
+out:
+    for (idx = 0; idx < n_buses; idx++) {
+        free(buses[idx]);
+    }
+    free(buses);
+
+    return rc;
+}
+
+/*
+ * pm_i2c_replay_start: answer bus operations from a trace file from now on
+ */
+int
+pm_i2c_replay_start(const char *file, struct ds *ds)
+{
+    struct pm_i2c_replay *replay;
+    FILE *fp;
+
+    if (NULL != pm_i2c_recording) {
+        ds_put_cstr(ds, "Can't replay while recording a trace");
+        return -1;
+    }
+
+    fp = fopen(file, "rb");
+    if (NULL == fp) {
+        ds_put_format(ds, "%s: %s", file, ovs_strerror(errno));
+        return -1;
+    }
+
+    replay = xzalloc(sizeof(*replay));
+    replay->file = xstrdup(file);
+    shash_init(&replay->ops_by_key);
+
+    if (0 != pm_i2c_replay_load(replay, fp, ds)) {
+        fclose(fp);
+        ds_put_format(ds, " (%s)", file);
+        pm_i2c_replay_free(replay);
+        return -1;
+    }
+    fclose(fp);
+
+    pm_i2c_replay_free(pm_i2c_replay);
+    pm_i2c_replay = replay;
+    replay->start = pm_perf_now();
+
+    VLOG_INFO("replaying I2C trace %s: %"PRIuSIZE" records of %"PRIuSIZE
+              " operations over %"PRIu64" msecs", file, replay->n_recs,
+              shash_count(&replay->ops_by_key), replay->end / 1000);
+    ds_put_format(ds, "Replaying %s", file);
+
+    return 0;
+}
+
+static void
+pm_i2c_replay_delay(uint32_t usecs)
+{
+    struct timespec req;
+
+    if (0 == usecs) {
+        return;
+    }
+
+    req.tv_sec = usecs / 1000000;
+    req.tv_nsec = (usecs % 1000000) * 1000;
+    while (0 != nanosleep(&req, &req)) {
+        // interrupted; sleep for the rest
+    }
+}
+
+/*
+ * pm_i2c_replay_op: if replaying, answer an operation from the trace
+ *
+ * output: false if not replaying (the caller goes to the bus); otherwise
+ *         true, with *rc and, for a successful read, xfer->data filled in
+ */
+bool
+pm_i2c_replay_op(const struct pm_i2c_xfer *xfer, int *rc)
+{
+    struct pm_i2c_replay *replay = pm_i2c_replay;
+    struct pm_i2c_replay_op *replay_op;
+    struct pm_i2c_replay_rec *rec;
+    uint64_t now;
+
+    if (OVS_LIKELY(NULL == replay)) {
+        return false;
+    }
+
+    replay_op = shash_find_data(&replay->ops_by_key,
+                                pm_i2c_replay_key(xfer->op, xfer->bus,
+                                                  xfer->address, xfer->offset,
+                                                  xfer->mask, xfer->len));
+    if (NULL == replay_op) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+
+        VLOG_DBG_RL(&rl, "no record of %s on %s at 0x%"PRIx32" offset "
+                    "%"PRIu32" length %"PRIuSIZE, pm_i2c_op_names[xfer->op],
+                    (NULL == xfer->bus) ? "unknown" : xfer->bus,
+                    xfer->address, xfer->offset, xfer->len);
+        replay->unmatched++;
+        *rc = -1;
+        return true;
+    }
+
+    // the last record made by now, or the first one
+    now = pm_perf_now() - replay->start;
+    while (replay_op->cur + 1 < replay_op->n_recs &&
+           replay_op->recs[replay_op->cur + 1].time <= now) {
+        replay_op->cur++;
+    }
+    rec = &replay_op->recs[replay_op->cur];
+
+    pm_i2c_replay_delay(rec->usecs);
+
+    *rc = rec->rc;
+    if (pm_i2c_op_reads(xfer->op) && 0 == rec->rc &&
+        rec->n_data == xfer->len) {
+        memcpy(xfer->data, rec->data, xfer->len);
+    }
+    replay->ops++;
+
+    return true;
+}
+
+static void
+pm_i2c_trace_status(struct ds *ds)
+{
+    struct pm_i2c_recording *rec = pm_i2c_recording;
+    struct pm_i2c_replay *replay = pm_i2c_replay;
+
+    if (NULL != rec) {
+        ds_put_format(ds, "recording: %s\n", rec->file);
+        ds_put_format(ds, "operations: %"PRIu64"\n", rec->ops);
+        ds_put_format(ds, "bytes: %"PRIu64" of %"PRIu64"\n", rec->bytes,
+                      rec->max_bytes);
+        ds_put_format(ds, "buses: %"PRIuSIZE"\n", shash_count(&rec->buses));
+        ds_put_format(ds, "elapsed: %"PRIu64" msecs\n",
+                      (pm_perf_now() - rec->start) / 1000);
+    } else if (NULL != replay) {
+        ds_put_format(ds, "replaying: %s\n", replay->file);
+        ds_put_format(ds, "records: %"PRIuSIZE" of %"PRIuSIZE
+                      " operations\n", replay->n_recs,
+                      shash_count(&replay->ops_by_key));
+        ds_put_format(ds, "answered: %"PRIu64"\n", replay->ops);
+        ds_put_format(ds, "unmatched: %"PRIu64"\n", replay->unmatched);
+        ds_put_format(ds, "elapsed: %"PRIu64" of %"PRIu64" msecs\n",
+                      (pm_perf_now() - replay->start) / 1000,
+                      replay->end / 1000);
+    } else {
+        ds_put_cstr(ds, "state: idle\n");
+    }
+}
+
+/*
+ * pm_i2c_trace_command: "ops-pmd/i2c-trace [start <file> [<max-mb>] | stop]"
+ */
+int
+pm_i2c_trace_command(int argc, const char *argv[], struct ds *ds)
+{
+    unsigned int max_mb = 0;
+
+    if (0 == argc) {
+        pm_i2c_trace_status(ds);
+        return 0;
+    }
+
+    // stop only ends a recording; a replay lasts as long as the daemon,
+    // as switching to the real bus midway would mix two systems' modules
+    if (1 == argc && 0 == strcmp(argv[0], "stop")) {
+        if (NULL != pm_i2c_replay) {
+            ds_put_format(ds, "Replaying %s; a replay can't be stopped",
+                          pm_i2c_replay->file);
+            return -1;
+        }
+        if (NULL == pm_i2c_recording) {
+            ds_put_cstr(ds, "Not recording");
+            return -1;
+        }
+        pm_i2c_trace_close("stopped");
+        return 0;
+    }
+
+    if ((2 == argc || 3 == argc) && 0 == strcmp(argv[0], "start")) {
+        if (3 == argc && (!str_to_uint(argv[2], 10, &max_mb) || 0 == max_mb)) {
+            ds_put_format(ds, "Invalid size limit %s", argv[2]);
+            return -1;
+        }
+        return pm_i2c_trace_start(argv[1], max_mb, ds);
+    }
+
+    ds_put_cstr(ds, "Invalid usage: ... ops-pmd/i2c-trace [start <file> "
+                "[<max-mb>] | stop]");
+    return -1;
+}
+
+/*
+ * pm_i2c_trace_exit: finish a recording
+ */
+void
+pm_i2c_trace_exit(void)
+{
+    pm_i2c_trace_close("exiting");
+    pm_i2c_replay_free(pm_i2c_replay);
+    pm_i2c_replay = NULL;
+}
@@ -0,0 +1,452 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for building the pm_info map of an interface.
+ *
+ * This only needs the module structure, not the IDL or a transaction; it is
+ * part of libpmd-core (see pm_core.h).
+ ***************************************************************************/
+
+#include <smap.h>
+#include <vswitch-idl.h>
+
+#include "pm_core.h"
+
+/*
+ * pm_build_pm_info: fill in the pm_info map for a port from its identity
+ *                   and DOM data
+ */
+void
+pm_build_pm_info(pm_module_t *port, struct smap *pm_info)
+{
+    struct ovs_module_info *module;
+    struct ovs_module_dom_info *module_dom;
+
+    module = &port->ovs_module_columns;
+    if (module->cable_length) {
+        smap_add(pm_info, "cable_length", module->cable_length);
+    }
+    if (module->cable_technology) {
+        smap_add(pm_info, "cable_technology", module->cable_technology);
+    }
+    if (module->connector) {
+        smap_add(pm_info, "connector", module->connector);
+    }
+    if (module->connector_status) {
+        smap_add(pm_info, "connector_status", module->connector_status);
+    }
+    if (module->supported_speeds) {
+        smap_add(pm_info, "supported_speeds", module->supported_speeds);
+    }
+    if (module->max_speed) {
+        smap_add(pm_info, "max_speed", module->max_speed);
+    }
+    if (module->power_mode) {
+        smap_add(pm_info, "power_mode", module->power_mode);
+    }
+    if (module->vendor_name) {
+        smap_add(pm_info, "vendor_name", module->vendor_name);
+    }
+    if (module->vendor_oui) {
+        smap_add(pm_info, "vendor_oui", module->vendor_oui);
+    }
+    if (module->vendor_part_number) {
+        smap_add(pm_info, "vendor_part_number",
+                 module->vendor_part_number);
+    }
+    if (module->vendor_revision) {
+        smap_add(pm_info, "vendor_revision", module->vendor_revision);
+    }
+    if (module->vendor_serial_number) {
+        smap_add(pm_info, "vendor_serial_number",
+                 module->vendor_serial_number);
+    }
+
+    // Update diagnostics key values
+    module_dom = &port->ovs_module_dom_columns;
+
+    if (module_dom->temperature) {
+        smap_add(pm_info, "temperature", module_dom->temperature);
+    }
+    if (module_dom->temperature_high_alarm) {
+        smap_add(pm_info, "temperature_high_alarm", module_dom->temperature_high_alarm);
+    }
+    if (module_dom->temperature_low_alarm) {
+        smap_add(pm_info, "temperature_low_alarm", module_dom->temperature_low_alarm);
+    }
+    if (module_dom->temperature_high_warning) {
+        smap_add(pm_info, "temperature_high_warning", module_dom->temperature_high_warning);
+    }
+    if (module_dom->temperature_low_warning) {
+        smap_add(pm_info, "temperature_low_warning", module_dom->temperature_low_warning);
+    }
+    if (module_dom->temperature_high_alarm_threshold) {
+        smap_add(pm_info, "temperature_high_alarm_threshold", module_dom->temperature_high_alarm_threshold);
+    }
+    if (module_dom->temperature_low_alarm_threshold) {
+        smap_add(pm_info, "temperature_low_alarm_threshold", module_dom->temperature_low_alarm_threshold);
+    }
+    if (module_dom->temperature_high_warning_threshold) {
+        smap_add(pm_info, "temperature_high_warning_threshold", module_dom->temperature_high_warning_threshold);
+    }
+    if (module_dom->temperature_low_warning_threshold) {
+        smap_add(pm_info, "temperature_low_warning_threshold", module_dom->temperature_low_warning_threshold);
+    }
+
+    if (module_dom->vcc) {
+        smap_add(pm_info, "vcc", module_dom->vcc);
+    }
+    if (module_dom->vcc_high_alarm) {
+        smap_add(pm_info, "vcc_high_alarm", module_dom->vcc_high_alarm);
+    }
+    if (module_dom->vcc_low_alarm) {
+        smap_add(pm_info, "vcc_low_alarm", module_dom->vcc_low_alarm);
+    }
+    if (module_dom->vcc_high_warning) {
+        smap_add(pm_info, "vcc_high_warning", module_dom->vcc_high_warning);
+    }
+    if (module_dom->vcc_low_warning) {
+        smap_add(pm_info, "vcc_low_warning", module_dom->vcc_low_warning);
+    }
+    if (module_dom->vcc_high_alarm_threshold) {
+        smap_add(pm_info, "vcc_high_alarm_threshold", module_dom->vcc_high_alarm_threshold);
+    }
+    if (module_dom->vcc_low_alarm_threshold) {
+        smap_add(pm_info, "vcc_low_alarm_threshold", module_dom->vcc_low_alarm_threshold);
+    }
+    if (module_dom->vcc_high_warning_threshold) {
+        smap_add(pm_info, "vcc_high_warning_threshold", module_dom->vcc_high_warning_threshold);
+    }
+    if (module_dom->vcc_low_warning_threshold) {
+        smap_add(pm_info, "vcc_low_warning_threshold", module_dom->vcc_low_warning_threshold);
+    }
+
+    if (module_dom->tx_bias) {
+        smap_add(pm_info, "tx_bias", module_dom->tx_bias);
+    }
+    if (module_dom->tx_bias_high_alarm) {
+        smap_add(pm_info, "tx_bias_high_alarm", module_dom->tx_bias_high_alarm);
+    }
+    if (module_dom->tx_bias_low_alarm) {
+        smap_add(pm_info, "tx_bias_low_alarm", module_dom->tx_bias_low_alarm);
+    }
+    if (module_dom->tx_bias_high_warning) {
+        smap_add(pm_info, "tx_bias_high_warning", module_dom->tx_bias_high_warning);
+    }
+    if (module_dom->tx_bias_low_warning) {
+        smap_add(pm_info, "tx_bias_low_warning", module_dom->tx_bias_low_warning);
+    }
+    if (module_dom->tx_bias_high_alarm_threshold) {
+        smap_add(pm_info, "tx_bias_high_alarm_threshold", module_dom->tx_bias_high_alarm_threshold);
+    }
+    if (module_dom->tx_bias_low_alarm_threshold) {
+        smap_add(pm_info, "tx_bias_low_alarm_threshold", module_dom->tx_bias_low_alarm_threshold);
+    }
+    if (module_dom->tx_bias_high_warning_threshold) {
+        smap_add(pm_info, "tx_bias_high_warning_threshold", module_dom->tx_bias_high_warning_threshold);
+    }
+    if (module_dom->tx_bias_low_warning_threshold) {
+        smap_add(pm_info, "tx_bias_low_warning_threshold", module_dom->tx_bias_low_warning_threshold);
+    }
+
+    if (module_dom->rx_power) {
+        smap_add(pm_info, "rx_power", module_dom->rx_power);
+    }
+    if (module_dom->rx_power_high_alarm) {
+        smap_add(pm_info, "rx_power_high_alarm", module_dom->rx_power_high_alarm);
+    }
+    if (module_dom->rx_power_low_alarm) {
+        smap_add(pm_info, "rx_power_low_alarm", module_dom->rx_power_low_alarm);
+    }
+    if (module_dom->rx_power_high_warning) {
+        smap_add(pm_info, "rx_power_high_warning", module_dom->rx_power_high_warning);
+    }
+    if (module_dom->rx_power_low_warning) {
+        smap_add(pm_info, "rx_power_low_warning", module_dom->rx_power_low_warning);
+    }
+    if (module_dom->rx_power_high_alarm_threshold) {
+        smap_add(pm_info, "rx_power_high_alarm_threshold", module_dom->rx_power_high_alarm_threshold);
+    }
+    if (module_dom->rx_power_low_alarm_threshold) {
+        smap_add(pm_info, "rx_power_low_alarm_threshold", module_dom->rx_power_low_alarm_threshold);
+    }
+    if (module_dom->rx_power_high_warning_threshold) {
+        smap_add(pm_info, "rx_power_high_warning_threshold", module_dom->rx_power_high_warning_threshold);
+    }
+    if (module_dom->rx_power_low_warning_threshold) {
+        smap_add(pm_info, "rx_power_low_warning_threshold", module_dom->rx_power_low_warning_threshold);
+    }
+
+    if (module_dom->tx_power) {
+        smap_add(pm_info, "tx_power", module_dom->tx_power);
+    }
+    if (module_dom->rx_power_high_alarm) {
+        smap_add(pm_info, "tx_power_high_alarm", module_dom->tx_power_high_alarm);
+    }
+    if (module_dom->tx_power_low_alarm) {
+        smap_add(pm_info, "tx_power_low_alarm", module_dom->tx_power_low_alarm);
+    }
+    if (module_dom->tx_power_high_warning) {
+        smap_add(pm_info, "tx_power_high_warning", module_dom->tx_power_high_warning);
+    }
+    if (module_dom->tx_power_low_warning) {
+        smap_add(pm_info, "tx_power_low_warning", module_dom->tx_power_low_warning);
+    }
+    if (module_dom->tx_power_high_alarm_threshold) {
+        smap_add(pm_info, "tx_power_high_alarm_threshold", module_dom->tx_power_high_alarm_threshold);
+    }
+    if (module_dom->tx_power_low_alarm_threshold) {
+        smap_add(pm_info, "tx_power_low_alarm_threshold", module_dom->tx_power_low_alarm_threshold);
+    }
+    if (module_dom->tx_power_high_warning_threshold) {
+        smap_add(pm_info, "tx_power_high_warning_threshold", module_dom->tx_power_high_warning_threshold);
+    }
+    if (module_dom->tx_power_low_warning_threshold) {
+        smap_add(pm_info, "tx_power_low_warning_threshold", module_dom->tx_power_low_warning_threshold);
+    }
+
+    if (module_dom->tx1_bias) {
+        smap_add(pm_info, "tx1_bias", module_dom->tx1_bias);
+    }
+    if (module_dom->rx1_power) {
+        smap_add(pm_info, "rx1_power", module_dom->rx1_power);
+    }
+
+    if (module_dom->tx1_bias_high_alarm) {
+        smap_add(pm_info, "tx1_bias_high_alarm", module_dom->tx1_bias_high_alarm);
+    }
+    if (module_dom->tx1_bias_low_alarm) {
+        smap_add(pm_info, "tx1_bias_low_alarm", module_dom->tx1_bias_low_alarm);
+    }
+    if (module_dom->tx1_bias_high_warning) {
+        smap_add(pm_info, "tx1_bias_high_warning", module_dom->tx1_bias_high_warning);
+    }
+    if (module_dom->tx1_bias_low_warning) {
+        smap_add(pm_info, "tx1_bias_low_warning", module_dom->tx1_bias_low_warning);
+    }
+    if (module_dom->tx1_bias_high_alarm_threshold) {
+        smap_add(pm_info, "tx1_bias_high_alarm_threshold", module_dom->tx1_bias_high_alarm_threshold);
+    }
+    if (module_dom->tx1_bias_low_alarm_threshold) {
+        smap_add(pm_info, "tx1_bias_low_alarm_threshold", module_dom->tx1_bias_low_alarm_threshold);
+    }
+    if (module_dom->tx1_bias_high_warning_threshold) {
+        smap_add(pm_info, "tx1_bias_high_warning_threshold", module_dom->tx1_bias_high_warning_threshold);
+    }
+    if (module_dom->tx1_bias_low_warning_threshold) {
+        smap_add(pm_info, "tx1_bias_low_warning_threshold", module_dom->tx1_bias_low_warning_threshold);
+    }
+
+    if (module_dom->rx1_power_high_alarm) {
+        smap_add(pm_info, "rx1_power_high_alarm", module_dom->rx1_power_high_alarm);
+    }
+    if (module_dom->rx1_power_low_alarm) {
+        smap_add(pm_info, "rx1_power_low_alarm", module_dom->rx1_power_low_alarm);
+    }
+    if (module_dom->rx1_power_high_warning) {
+        smap_add(pm_info, "rx1_power_high_warning", module_dom->rx1_power_high_warning);
+    }
+    if (module_dom->rx1_power_low_warning) {
+        smap_add(pm_info, "rx1_power_low_warning", module_dom->rx1_power_low_warning);
+    }
+    if (module_dom->rx1_power_high_alarm_threshold) {
+        smap_add(pm_info, "rx1_power_high_alarm_threshold", module_dom->rx1_power_high_alarm_threshold);
+    }
+    if (module_dom->rx1_power_low_alarm_threshold) {
+        smap_add(pm_info, "rx1_power_low_alarm_threshold", module_dom->rx1_power_low_alarm_threshold);
+    }
+    if (module_dom->rx1_power_high_warning_threshold) {
+        smap_add(pm_info, "rx1_power_high_warning_threshold", module_dom->rx1_power_high_warning_threshold);
+    }
+    if (module_dom->rx1_power_low_warning_threshold) {
+        smap_add(pm_info, "rx1_power_low_warning_threshold", module_dom->rx1_power_low_warning_threshold);
+    }
+
+    if (module_dom->tx2_bias) {
+        smap_add(pm_info, "tx2_bias", module_dom->tx2_bias);
+    }
+    if (module_dom->rx2_power) {
+        smap_add(pm_info, "rx2_power", module_dom->rx2_power);
+    }
+
+    if (module_dom->tx2_bias_high_alarm) {
+        smap_add(pm_info, "tx2_bias_high_alarm", module_dom->tx2_bias_high_alarm);
+    }
+    if (module_dom->tx2_bias_low_alarm) {
+        smap_add(pm_info, "tx2_bias_low_alarm", module_dom->tx2_bias_low_alarm);
+    }
+    if (module_dom->tx2_bias_high_warning) {
+        smap_add(pm_info, "tx2_bias_high_warning", module_dom->tx2_bias_high_warning);
+    }
+    if (module_dom->tx2_bias_low_warning) {
+        smap_add(pm_info, "tx2_bias_low_warning", module_dom->tx2_bias_low_warning);
+    }
+    if (module_dom->tx2_bias_high_alarm_threshold) {
+        smap_add(pm_info, "tx2_bias_high_alarm_threshold", module_dom->tx2_bias_high_alarm_threshold);
+    }
+    if (module_dom->tx2_bias_low_alarm_threshold) {
+        smap_add(pm_info, "tx2_bias_low_alarm_threshold", module_dom->tx2_bias_low_alarm_threshold);
+    }
+    if (module_dom->tx2_bias_high_warning_threshold) {
+        smap_add(pm_info, "tx2_bias_high_warning_threshold", module_dom->tx2_bias_high_warning_threshold);
+    }
+    if (module_dom->tx2_bias_low_warning_threshold) {
+        smap_add(pm_info, "tx2_bias_low_warning_threshold", module_dom->tx2_bias_low_warning_threshold);
+    }
+
+    if (module_dom->rx2_power_high_alarm) {
+        smap_add(pm_info, "rx2_power_high_alarm", module_dom->rx2_power_high_alarm);
+    }
+    if (module_dom->rx2_power_low_alarm) {
+        smap_add(pm_info, "rx2_power_low_alarm", module_dom->rx2_power_low_alarm);
+    }
+    if (module_dom->rx2_power_high_warning) {
+        smap_add(pm_info, "rx2_power_high_warning", module_dom->rx2_power_high_warning);
+    }
+    if (module_dom->rx2_power_low_warning) {
+        smap_add(pm_info, "rx2_power_low_warning", module_dom->rx2_power_low_warning);
+    }
+    if (module_dom->rx2_power_high_alarm_threshold) {
+        smap_add(pm_info, "rx2_power_high_alarm_threshold", module_dom->rx2_power_high_alarm_threshold);
+    }
+    if (module_dom->rx2_power_low_alarm_threshold) {
+        smap_add(pm_info, "rx2_power_low_alarm_threshold", module_dom->rx2_power_low_alarm_threshold);
+    }
+    if (module_dom->rx2_power_high_warning_threshold) {
+        smap_add(pm_info, "rx2_power_high_warning_threshold", module_dom->rx2_power_high_warning_threshold);
+    }
+    if (module_dom->rx2_power_low_warning_threshold) {
+        smap_add(pm_info, "rx2_power_low_warning_threshold", module_dom->rx2_power_low_warning_threshold);
+    }
+
+    if (module_dom->tx3_bias) {
+        smap_add(pm_info, "tx3_bias", module_dom->tx3_bias);
+    }
+    if (module_dom->rx3_power) {
+        smap_add(pm_info, "rx3_power", module_dom->rx3_power);
+    }
+
+    if (module_dom->tx3_bias_high_alarm) {
+        smap_add(pm_info, "tx3_bias_high_alarm", module_dom->tx3_bias_high_alarm);
+    }
+    if (module_dom->tx3_bias_low_alarm) {
+        smap_add(pm_info, "tx3_bias_low_alarm", module_dom->tx3_bias_low_alarm);
+    }
+    if (module_dom->tx3_bias_high_warning) {
+        smap_add(pm_info, "tx3_bias_high_warning", module_dom->tx3_bias_high_warning);
+    }
+    if (module_dom->tx3_bias_low_warning) {
+        smap_add(pm_info, "tx3_bias_low_warning", module_dom->tx3_bias_low_warning);
+    }
+    if (module_dom->tx3_bias_high_alarm_threshold) {
+        smap_add(pm_info, "tx3_bias_high_alarm_threshold", module_dom->tx3_bias_high_alarm_threshold);
+    }
+    if (module_dom->tx3_bias_low_alarm_threshold) {
+        smap_add(pm_info, "tx3_bias_low_alarm_threshold", module_dom->tx3_bias_low_alarm_threshold);
+    }
+    if (module_dom->tx3_bias_high_warning_threshold) {
+        smap_add(pm_info, "tx3_bias_high_warning_threshold", module_dom->tx3_bias_high_warning_threshold);
+    }
+    if (module_dom->tx3_bias_low_warning_threshold) {
+        smap_add(pm_info, "tx3_bias_low_warning_threshold", module_dom->tx3_bias_low_warning_threshold);
+    }
+
+    if (module_dom->rx3_power_high_alarm) {
+        smap_add(pm_info, "rx3_power_high_alarm", module_dom->rx3_power_high_alarm);
+    }
+    if (module_dom->rx3_power_low_alarm) {
+        smap_add(pm_info, "rx3_power_low_alarm", module_dom->rx3_power_low_alarm);
+    }
+    if (module_dom->rx3_power_high_warning) {
+        smap_add(pm_info, "rx3_power_high_warning", module_dom->rx3_power_high_warning);
+    }
+    if (module_dom->rx3_power_low_warning) {
+        smap_add(pm_info, "rx3_power_low_warning", module_dom->rx3_power_low_warning);
+    }
+    if (module_dom->rx3_power_high_alarm_threshold) {
+        smap_add(pm_info, "rx3_power_high_alarm_threshold", module_dom->rx3_power_high_alarm_threshold);
+    }
+    if (module_dom->rx3_power_low_alarm_threshold) {
+        smap_add(pm_info, "rx3_power_low_alarm_threshold", module_dom->rx3_power_low_alarm_threshold);
+    }
+    if (module_dom->rx3_power_high_warning_threshold) {
+        smap_add(pm_info, "rx3_power_high_warning_threshold", module_dom->rx3_power_high_warning_threshold);
+    }
+    if (module_dom->rx3_power_low_warning_threshold) {
+        smap_add(pm_info, "rx3_power_low_warning_threshold", module_dom->rx3_power_low_warning_threshold);
+    }
+
+    if (module_dom->tx4_bias) {
+        smap_add(pm_info, "tx4_bias", module_dom->tx4_bias);
+    }
+    if (module_dom->rx4_power) {
+        smap_add(pm_info, "rx4_power", module_dom->rx4_power);
+    }
+
+    if (module_dom->tx4_bias_high_alarm) {
+        smap_add(pm_info, "tx4_bias_high_alarm", module_dom->tx4_bias_high_alarm);
+    }
+    if (module_dom->tx4_bias_low_alarm) {
+        smap_add(pm_info, "tx4_bias_low_alarm", module_dom->tx4_bias_low_alarm);
+    }
+    if (module_dom->tx4_bias_high_warning) {
+        smap_add(pm_info, "tx4_bias_high_warning", module_dom->tx4_bias_high_warning);
+    }
+    if (module_dom->tx4_bias_low_warning) {
+        smap_add(pm_info, "tx4_bias_low_warning", module_dom->tx4_bias_low_warning);
+    }
+    if (module_dom->tx4_bias_high_alarm_threshold) {
+        smap_add(pm_info, "tx4_bias_high_alarm_threshold", module_dom->tx4_bias_high_alarm_threshold);
+    }
+    if (module_dom->tx4_bias_low_alarm_threshold) {
+        smap_add(pm_info, "tx4_bias_low_alarm_threshold", module_dom->tx4_bias_low_alarm_threshold);
+    }
+    if (module_dom->tx4_bias_high_warning_threshold) {
+        smap_add(pm_info, "tx4_bias_high_warning_threshold", module_dom->tx4_bias_high_warning_threshold);
+    }
+    if (module_dom->tx4_bias_low_warning_threshold) {
+        smap_add(pm_info, "tx4_bias_low_warning_threshold", module_dom->tx4_bias_low_warning_threshold);
+    }
+
+    if (module_dom->rx4_power_high_alarm) {
+        smap_add(pm_info, "rx4_power_high_alarm", module_dom->rx4_power_high_alarm);
+    }
+    if (module_dom->rx4_power_low_alarm) {
+        smap_add(pm_info, "rx4_power_low_alarm", module_dom->rx4_power_low_alarm);
+    }
+    if (module_dom->rx4_power_high_warning) {
+        smap_add(pm_info, "rx4_power_high_warning", module_dom->rx4_power_high_warning);
+    }
+    if (module_dom->rx4_power_low_warning) {
+        smap_add(pm_info, "rx4_power_low_warning", module_dom->rx4_power_low_warning);
+    }
+    if (module_dom->rx4_power_high_alarm_threshold) {
+        smap_add(pm_info, "rx4_power_high_alarm_threshold", module_dom->rx4_power_high_alarm_threshold);
+    }
+    if (module_dom->rx4_power_low_alarm_threshold) {
+        smap_add(pm_info, "rx4_power_low_alarm_threshold", module_dom->rx4_power_low_alarm_threshold);
+    }
+    if (module_dom->rx4_power_high_warning_threshold) {
+        smap_add(pm_info, "rx4_power_high_warning_threshold", module_dom->rx4_power_high_warning_threshold);
+    }
+    if (module_dom->rx4_power_low_warning_threshold) {
+        smap_add(pm_info, "rx4_power_low_warning_threshold", module_dom->rx4_power_low_warning_threshold);
+    }
+}
@@ -0,0 +1,271 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for the machine-readable state dump (ops-pmd/dump --json).
+ *
+ * The document is written straight into the caller's ds: no json tree is
+ * built and nothing is allocated per field. Missing strings are null and
+ * DOM values are in pm_info units, so the schema doesn't change with the
+ * module type.
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <json.h>
+#include <shash.h>
+#include <timeval.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+
+extern struct shash ovs_intfs;
+
+static void
+pm_json_bool(struct ds *ds, const char *key, bool value)
+{
+    ds_put_format(ds, "\"%s\":%s,", key, value ? "true" : "false");
+}
+
+static void
+pm_json_string(struct ds *ds, const char *key, const char *value)
+{
+    ds_put_format(ds, "\"%s\":", key);
+    if (NULL == value) {
+        ds_put_cstr(ds, "null");
+    } else {
+        json_string_escape(value, ds);
+    }
+    ds_put_char(ds, ',');
+}
+
+static void
+pm_json_u64(struct ds *ds, const char *key, uint64_t value)
+{
+    ds_put_format(ds, "\"%s\":%llu,", key, (unsigned long long)value);
+}
+
+// wall clock msecs, null if it never happened
+static void
+pm_json_time(struct ds *ds, const char *key, long long int value)
+{
+    if (0 == value) {
+        ds_put_format(ds, "\"%s\":null,", key);
+    } else {
+        ds_put_format(ds, "\"%s\":%lld,", key, value);
+    }
+}
+
+// drop the ',' left by the last member before closing an object
+static void
+pm_json_close(struct ds *ds, char c)
+{
+    if (ds->length > 0 && ',' == ds->string[ds->length - 1]) {
+        ds->length--;
+    }
+    ds_put_char(ds, c);
+}
+
+static void
+pm_json_lanes(struct ds *ds, const char *key, const uint16_t *raw,
+              int n_lanes, double scale)
+{
+    int lane;
+
+    ds_put_format(ds, "\"%s\":[", key);
+    for (lane = 0; lane < n_lanes; lane++) {
+        ds_put_format(ds, "%s%.4f", lane ? "," : "", raw[lane] * scale);
+    }
+    ds_put_cstr(ds, "],");
+}
+
+static void
+pm_json_identity(struct ds *ds, const struct ovs_module_info *info)
+{
+    ds_put_cstr(ds, "\"identity\":{");
+    pm_json_string(ds, "connector", info->connector);
+    pm_json_string(ds, "connector_status", info->connector_status);
+    pm_json_string(ds, "cable_technology", info->cable_technology);
+    pm_json_string(ds, "cable_length", info->cable_length);
+    pm_json_string(ds, "supported_speeds", info->supported_speeds);
+    pm_json_string(ds, "max_speed", info->max_speed);
+    pm_json_string(ds, "power_mode", info->power_mode);
+    pm_json_string(ds, "vendor_name", info->vendor_name);
+    pm_json_string(ds, "vendor_oui", info->vendor_oui);
+    pm_json_string(ds, "vendor_part_number", info->vendor_part_number);
+    pm_json_string(ds, "vendor_revision", info->vendor_revision);
+    pm_json_string(ds, "vendor_serial_number", info->vendor_serial_number);
+    pm_json_close(ds, '}');
+    ds_put_char(ds, ',');
+
+    ds_put_cstr(ds, "\"raw\":{");
+    pm_json_string(ds, "a0", info->a0);
+    pm_json_string(ds, "a0_uppers", info->a0_uppers);
+    pm_json_string(ds, "a2", info->a2);
+    pm_json_close(ds, '}');
+    ds_put_char(ds, ',');
+}
+
+static void
+pm_json_dom(struct ds *ds, const pm_port_t *port)
+{
+    const pm_dom_sample_t *sample = &port->module.dom_sample;
+
+    if (false == port->module.dom_sample_valid) {
+        ds_put_cstr(ds, "\"dom\":null,");
+        return;
+    }
+
+    ds_put_format(ds, "\"dom\":{\"time\":%lld,", port->dom_sample_time);
+    ds_put_format(ds, "\"temperature\":%.2f,", sample->temperature / 256.0);
+    ds_put_format(ds, "\"vcc\":%.4f,", sample->vcc * 0.0001);
+    pm_json_lanes(ds, "tx_bias", sample->tx_bias, sample->n_lanes, 0.002);
+    pm_json_lanes(ds, "tx_power", sample->tx_power, sample->n_lanes, 0.0001);
+    pm_json_lanes(ds, "rx_power", sample->rx_power, sample->n_lanes, 0.0001);
+    ds_put_format(ds, "\"flags\":%u", sample->flags);
+    ds_put_cstr(ds, "},");
+}
+
+static void
+pm_json_i2c(struct ds *ds, const struct pm_i2c_stats *stats)
+{
+    ds_put_cstr(ds, "\"i2c\":{");
+    pm_json_u64(ds, "ops", stats->ops);
+    pm_json_u64(ds, "bytes", stats->bytes);
+    pm_json_u64(ds, "failures", stats->failures);
+    pm_json_u64(ds, "retries", stats->retries);
+    pm_json_u64(ds, "checksum_failures", stats->checksum_failures);
+    pm_json_u64(ds, "resets", stats->resets);
+    pm_json_u64(ds, "usecs", stats->usecs);
+    pm_json_time(ds, "last_op", stats->last_op);
+    pm_json_close(ds, '}');
+    ds_put_char(ds, ',');
+}
+
+static void
+pm_json_port(struct ds *ds, const pm_port_t *port)
+{
+    int idx;
+
+    json_string_escape(port->instance, ds);
+    ds_put_cstr(ds, ":{");
+
+    pm_json_string(ds, "subsystem", port->subsystem);
+    pm_json_bool(ds, "present", port->present);
+    pm_json_bool(ds, "retry", port->retry);
+    pm_json_time(ds, "presence_time", port->presence_time);
+    pm_json_time(ds, "a0_time", port->a0_time);
+    pm_json_bool(ds, "a2_read_requested", port->module.a2_read_requested);
+    pm_json_bool(ds, "dom_supported", port->module.dom_supported);
+    pm_json_bool(ds, "dom_stale", port->module.dom_sample_stale);
+    pm_json_bool(ds, "optical", port->module.optical);
+    pm_json_bool(ds, "split", port->split);
+    pm_json_bool(ds, "hw_enable", port->hw_enable);
+    ds_put_cstr(ds, "\"hw_enable_subport\":[");
+    for (idx = 0; idx < MAX_SPLIT_COUNT; idx++) {
+        ds_put_format(ds, "%s%s", idx ? "," : "",
+                      port->hw_enable_subport[idx] ? "true" : "false");
+    }
+    ds_put_cstr(ds, "],");
+    pm_json_bool(ds, "module_info_changed", port->module.module_info_changed);
+    pm_json_bool(ds, "module_dom_changed", port->module.module_dom_changed);
+    ds_put_format(ds, "\"shm_slot\":%d,", port->shm_slot);
+    ds_put_format(ds, "\"dom_history\":%u,", port->dom_history_count);
+
+    if (port->latency.active) {
+        ds_put_format(ds, "\"pending_event\":{\"insert\":%s,\"time\":%lld},",
+                      port->latency.insert ? "true" : "false",
+                      port->latency.wall);
+    } else {
+        ds_put_cstr(ds, "\"pending_event\":null,");
+    }
+
+    pm_json_identity(ds, &port->module.ovs_module_columns);
+    pm_json_dom(ds, port);
+    pm_json_i2c(ds, &port->i2c_stats);
+
+    pm_json_close(ds, '}');
+}
+
+/*
+ * pm_json_dump: dump daemon and port state as one JSON object
+ *
+ * input: name of the interface to dump, NULL for all of them
+ *        time_msec() of the next DOM refresh
+ *
+ * output: 0, or -1 (with a message in ds) if the interface doesn't exist
+ */
+int
+pm_json_dump(struct ds *ds, const char *name, long long int dom_next_refresh)
+{
+    const struct shash_node **nodes;
+    const pm_port_t *port;
+    size_t count;
+    size_t idx;
+    long long int now;
+    int wake;
+    bool first = true;
+
+    if (NULL != name) {
+        port = shash_find_data(&ovs_intfs, name);
+        if (NULL == port) {
+            ds_put_format(ds, "No pluggable interface %s", name);
+            return -1;
+        }
+    }
+
+    ds_put_format(ds, "{\"time\":%lld,", time_wall_msec());
+
+    ds_put_cstr(ds, "\"scheduler\":{");
+    ds_put_format(ds, "\"interval\":%d,", PM_TICK_INTERVAL);
+    ds_put_format(ds, "\"dom_interval\":%d,", PM_DOM_INTERVAL);
+    // dom_next_refresh starts at LLONG_MIN, so compare before subtracting
+    now = time_msec();
+    ds_put_format(ds, "\"dom_refresh_in\":%lld,",
+                  dom_next_refresh > now ? dom_next_refresh - now : 0);
+    ds_put_format(ds, "\"dom_history_depth\":%u,", pm_dom_history_depth);
+    ds_put_cstr(ds, "\"wakeups\":{");
+    for (wake = 0; wake < PM_LOOP_N_WAKES; wake++) {
+        pm_json_u64(ds, pm_loop_wake_name(wake), pm_loop_wake_count(wake));
+    }
+    pm_json_close(ds, '}');
+    ds_put_cstr(ds, "},");
+
+    ds_put_cstr(ds, "\"interfaces\":{");
+    nodes = shash_sort(&ovs_intfs);
+    count = shash_count(&ovs_intfs);
+    for (idx = 0; idx < count; idx++) {
+        port = nodes[idx]->data;
+
+        if (NULL == port ||
+            (NULL != name && strcmp(name, port->instance))) {
+            continue;
+        }
+        if (false == first) {
+            ds_put_char(ds, ',');
+        }
+        first = false;
+        pm_json_port(ds, port);
+    }
+    free(nodes);
+    ds_put_cstr(ds, "}}\n");
+
+    return 0;
+}
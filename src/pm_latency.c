@@ -0,0 +1,260 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for insertion-to-publish latency measurement.
+ *
+ * A module insertion or removal is timestamped when the presence change is
+ * seen and at every stage of the detection path, up to the acknowledgement
+ * of the transaction that published it. Each stage and the total go into
+ * the pm_perf histograms; the last PM_LATENCY_HISTORY events are kept with
+ * their stage breakdown for ops-pmd/dump.
+ *
+ * An event that isn't published within PM_LATENCY_MAX_AGE (a port that is
+ * disabled or gone from its subsystem) is dropped, so that it can't be
+ * charged to a later insertion.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <ovsdb-idl.h>
+#include <shash.h>
+#include <timeval.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+#include "pm_perf.h"
+
+VLOG_DEFINE_THIS_MODULE(pm_latency);
+
+#define PM_LATENCY_HISTORY  32
+#define PM_LATENCY_MAX_AGE  (60 * 1000 * 1000)  // usecs
+
+extern struct shash ovs_intfs;
+
+struct pm_latency_record {
+    char        name[32];
+    bool        insert;
+    int         status;                             // commit status
+    long long int wall;
+    uint64_t    delta[PM_LATENCY_N_STAGES];         // usecs since the
+                                                    // previous stage
+    uint64_t    total;
+};
+
+static struct pm_latency_record pm_latency_ring[PM_LATENCY_HISTORY];
+static unsigned int pm_latency_next = 0;
+static unsigned int pm_latency_count = 0;
+
+static const enum pm_perf_id pm_latency_perf_ids[PM_LATENCY_N_STAGES] = {
+    [PM_LATENCY_DETECT]     = PM_PERF_N_IDS,    // start, not timed
+    [PM_LATENCY_A0]         = PM_PERF_STAGE_A0,
+    [PM_LATENCY_CHECKSUM]   = PM_PERF_STAGE_CHECKSUM,
+    [PM_LATENCY_PARSE]      = PM_PERF_STAGE_PARSE,
+    [PM_LATENCY_A2]         = PM_PERF_STAGE_A2,
+    [PM_LATENCY_PUBLISH]    = PM_PERF_STAGE_PUBLISH,
+    [PM_LATENCY_COMMIT]     = PM_PERF_STAGE_COMMIT,
+};
+
+/*
+ * pm_latency_start: a presence change was seen on a port
+ */
+void
+pm_latency_start(pm_port_t *port, bool insert)
+{
+    struct pm_latency_event *event = &port->latency;
+
+    // a removal that is still being published is superseded by the
+    // insertion (and vice versa); the newer event is the one that counts
+    memset(event, 0, sizeof(*event));
+    event->active = true;
+    event->insert = insert;
+    event->wall = time_wall_msec();
+    event->stamp[PM_LATENCY_DETECT] = pm_perf_now();
+}
+
+/*
+ * pm_latency_cancel: forget the pending event of a port, if any
+ */
+void
+pm_latency_cancel(pm_port_t *port)
+{
+    memset(&port->latency, 0, sizeof(port->latency));
+}
+
+static bool
+pm_latency_expired(const struct pm_latency_event *event, uint64_t now)
+{
+    return now - event->stamp[PM_LATENCY_DETECT] > PM_LATENCY_MAX_AGE;
+}
+
+/*
+ * pm_latency_pending: is an event of this kind (insert or not) still being
+ *                     followed on the port
+ */
+bool
+pm_latency_pending(const pm_port_t *port, bool insert)
+{
+    const struct pm_latency_event *event = &port->latency;
+
+    return event->active && event->insert == insert &&
+           false == pm_latency_expired(event, pm_perf_now());
+}
+
+/*
+ * pm_latency_stage: a port with a pending event reached a stage
+ */
+void
+pm_latency_stage(pm_port_t *port, enum pm_latency_stage stage)
+{
+    struct pm_latency_event *event = &port->latency;
+
+    if (event->active && 0 == event->stamp[stage]) {
+        event->stamp[stage] = pm_perf_now();
+    }
+}
+
+static void
+pm_latency_finish(pm_port_t *port, int status, uint64_t now)
+{
+    struct pm_latency_event *event = &port->latency;
+    struct pm_latency_record *rec;
+    uint64_t prev;
+    int stage;
+
+    event->stamp[PM_LATENCY_COMMIT] = now;
+
+    rec = &pm_latency_ring[pm_latency_next];
+    memset(rec, 0, sizeof(*rec));
+    snprintf(rec->name, sizeof(rec->name), "%s", port->instance);
+    rec->insert = event->insert;
+    rec->status = status;
+    rec->wall = event->wall;
+
+    prev = event->stamp[PM_LATENCY_DETECT];
+    for (stage = PM_LATENCY_DETECT + 1; stage < PM_LATENCY_N_STAGES; stage++) {
+        if (0 == event->stamp[stage]) {
+            continue;
+        }
+        rec->delta[stage] = event->stamp[stage] - prev;
+        prev = event->stamp[stage];
+    }
+    rec->total = now - event->stamp[PM_LATENCY_DETECT];
+
+    // the ring keeps every outcome; the histograms only describe events
+    // that actually reached the database
+    if (TXN_SUCCESS == status) {
+        for (stage = PM_LATENCY_DETECT + 1; stage < PM_LATENCY_N_STAGES;
+             stage++) {
+            if (0 != event->stamp[stage]) {
+                pm_perf_record(pm_latency_perf_ids[stage], rec->delta[stage]);
+            }
+        }
+        pm_perf_record(event->insert ? PM_PERF_INSERT : PM_PERF_REMOVE,
+                       rec->total);
+    }
+
+    pm_latency_next = (pm_latency_next + 1) % PM_LATENCY_HISTORY;
+    if (pm_latency_count < PM_LATENCY_HISTORY) {
+        pm_latency_count++;
+    }
+
+    event->active = false;
+}
+
+/*
+ * pm_latency_commit: the transaction carrying the published events was
+ *                    acknowledged
+ *
+ * input: transaction status
+ */
+void
+pm_latency_commit(int status)
+{
+    struct shash_node *node;
+    uint64_t now = pm_perf_now();
+
+    SHASH_FOR_EACH(node, &ovs_intfs) {
+        pm_port_t *port = node->data;
+
+        if (NULL == port || false == port->latency.active) {
+            continue;
+        }
+
+        if (0 != port->latency.stamp[PM_LATENCY_PUBLISH]) {
+            pm_latency_finish(port, status, now);
+        } else if (pm_latency_expired(&port->latency, now)) {
+            VLOG_DBG("dropped the %s event of %s: not published",
+                     port->latency.insert ? "insert" : "remove",
+                     port->instance);
+            pm_latency_cancel(port);
+        }
+    }
+}
+
+static void
+pm_latency_put_delta(struct ds *ds, uint64_t usecs)
+{
+    if (0 == usecs) {
+        ds_put_format(ds, " %8s", "-");
+    } else {
+        ds_put_format(ds, " %8llu", (unsigned long long)usecs);
+    }
+}
+
+/*
+ * pm_latency_dump: show the last events with their stage breakdown
+ */
+void
+pm_latency_dump(struct ds *ds)
+{
+    const struct pm_latency_record *rec;
+    unsigned int idx;
+    time_t secs;
+    struct tm tm;
+    char buf[32];
+
+    ds_put_cstr(ds, "================ Module events ================\n");
+    ds_put_format(ds, "%-23s %-10s %-6s %8s %8s %8s %8s %8s %8s %9s %s\n",
+                  "time", "interface", "event", "a0", "checksum", "parse",
+                  "a2", "publish", "commit", "total(us)", "status");
+
+    // oldest first
+    for (idx = 0; idx < pm_latency_count; idx++) {
+        rec = &pm_latency_ring[(pm_latency_next + PM_LATENCY_HISTORY -
+                                pm_latency_count + idx) % PM_LATENCY_HISTORY];
+
+        secs = rec->wall / 1000;
+        localtime_r(&secs, &tm);
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+
+        ds_put_format(ds, "%s.%03lld %-10s %-6s", buf, rec->wall % 1000,
+                      rec->name, rec->insert ? "insert" : "remove");
+        pm_latency_put_delta(ds, rec->delta[PM_LATENCY_A0]);
+        pm_latency_put_delta(ds, rec->delta[PM_LATENCY_CHECKSUM]);
+        pm_latency_put_delta(ds, rec->delta[PM_LATENCY_PARSE]);
+        pm_latency_put_delta(ds, rec->delta[PM_LATENCY_A2]);
+        pm_latency_put_delta(ds, rec->delta[PM_LATENCY_PUBLISH]);
+        pm_latency_put_delta(ds, rec->delta[PM_LATENCY_COMMIT]);
+        ds_put_format(ds, " %9llu %s\n", (unsigned long long)rec->total,
+                      ovsdb_idl_txn_status_to_string(rec->status));
+    }
+}
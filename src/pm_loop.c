@@ -0,0 +1,501 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for the main loop flight recorder.
+ *
+ * Every iteration of the main loop leaves a fixed-size record in a ring of
+ * the last PM_LOOP_HISTORY iterations: why the loop woke up, how long it
+ * slept, the time spent in each pmd_run phase, the I2C operations issued,
+ * the ports published and the commit status. When an iteration runs over
+ * pm_loop_budget msecs the ring is copied aside (frozen) and logged, so the
+ * iterations that led to the overrun survive until someone looks at them.
+ *
+ * Iterations are also counted by wake reason, in total and per second over
+ * the last PM_LOOP_RATE_WINDOW seconds. A second with more than
+ * pm_loop_max_rate iterations is logged: the loop should mostly sleep
+ * between PM_INTERVAL ticks, and back-to-back wakeups burn CPU unnoticed.
+ ***************************************************************************/
+
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+#include <ovsdb-idl.h>
+#include <timeval.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+#include "pm_perf.h"
+
+VLOG_DEFINE_THIS_MODULE(pm_loop);
+
+// pmd_run phases, a contiguous range of pm_perf ids
+#define PM_LOOP_FIRST_PHASE     PM_PERF_RECONFIGURE
+#define PM_LOOP_N_PHASES        (PM_PERF_DOM_UPDATE - PM_PERF_RECONFIGURE + 1)
+
+struct pm_loop_record {
+    long long int wall;                 // wall clock msecs of the wakeup
+    uint64_t    sleep;                  // usecs blocked before the wakeup
+    uint64_t    total;                  // usecs from wakeup to going idle
+    uint32_t    phase[PM_LOOP_N_PHASES];    // usecs per pmd_run phase
+    uint32_t    i2c_ops;
+    uint16_t    dirty;                  // ports published
+    uint8_t     wake;                   // enum pm_loop_wake
+    int         status;                 // identity commit, -1 if none
+    int         dom_status;             // DOM commit, -1 if none
+};
+
+// seconds of per-second wakeup counts kept
+#define PM_LOOP_RATE_WINDOW     60
+
+unsigned int pm_loop_budget = PM_LOOP_BUDGET;
+unsigned int pm_loop_max_rate = PM_LOOP_MAX_RATE;
+
+static struct pm_loop_record pm_loop_ring[PM_LOOP_HISTORY];
+static unsigned int pm_loop_next = 0;
+static unsigned int pm_loop_count = 0;
+
+static struct pm_loop_record pm_loop_frozen[PM_LOOP_HISTORY];
+static unsigned int pm_loop_frozen_count = 0;
+static long long int pm_loop_frozen_time = 0;
+
+static struct pm_loop_record *pm_loop_cur = NULL;
+static uint64_t pm_loop_start;
+static uint64_t pm_loop_idle = 0;       // when the last iteration ended
+static uint64_t pm_loop_i2c_base;
+static long long int pm_loop_deadline = LLONG_MAX;
+static bool pm_loop_woke[PM_LOOP_N_WAKES];
+
+static uint64_t pm_loop_wakes[PM_LOOP_N_WAKES];
+static uint32_t pm_loop_rate[PM_LOOP_RATE_WINDOW][PM_LOOP_N_WAKES];
+static long long int pm_loop_rate_sec = 0;  // second counted in
+                                            // pm_loop_rate[sec % WINDOW]
+static unsigned int pm_loop_rate_secs = 0;  // ended seconds in the window
+
+static const char *pm_loop_wake_names[PM_LOOP_N_WAKES] = {
+    [PM_LOOP_WAKE_TIMER]        = "timer",
+    [PM_LOOP_WAKE_IDL]          = "idl",
+    [PM_LOOP_WAKE_SUBSCRIBER]   = "subscriber",
+    [PM_LOOP_WAKE_METRICS]      = "metrics",
+    [PM_LOOP_WAKE_UNIXCTL]      = "unixctl",
+    [PM_LOOP_WAKE_IMMEDIATE]    = "immediate",
+};
+
+const char *
+pm_loop_wake_name(enum pm_loop_wake wake)
+{
+    return pm_loop_wake_names[wake];
+}
+
+/*
+ * pm_loop_begin: the main loop woke up
+ */
+void
+pm_loop_begin(void)
+{
+    uint64_t now = pm_perf_now();
+
+    pm_loop_cur = &pm_loop_ring[pm_loop_next];
+    memset(pm_loop_cur, 0, sizeof(*pm_loop_cur));
+    pm_loop_cur->wall = time_wall_msec();
+    pm_loop_cur->sleep = pm_loop_idle ? now - pm_loop_idle : 0;
+    pm_loop_cur->status = -1;
+    pm_loop_cur->dom_status = -1;
+
+    memset(pm_loop_woke, 0, sizeof(pm_loop_woke));
+    if (time_msec() >= pm_loop_deadline) {
+        pm_loop_woke[PM_LOOP_WAKE_TIMER] = true;
+    }
+
+    pm_loop_start = now;
+    pm_loop_i2c_base = pm_i2c_op_count();
+}
+
+/*
+ * pm_loop_note_wake: something this iteration handled explains the wakeup
+ */
+void
+pm_loop_note_wake(enum pm_loop_wake wake)
+{
+    pm_loop_woke[wake] = true;
+}
+
+/*
+ * pm_loop_note_unixctl: the unixctl server just ran
+ *
+ * unixctl_server_run() does not say whether it served a command, ours or a
+ * built-in one (exit, vlog/set, coverage/show, ...). Its sockets are the
+ * only thing left that the loop waits on, so a wakeup after a real sleep
+ * that no other source claimed is put down to it.
+ */
+void
+pm_loop_note_unixctl(void)
+{
+    int wake;
+
+    if (NULL == pm_loop_cur || pm_loop_cur->sleep < 1000) {
+        return;
+    }
+
+    for (wake = 0; wake < PM_LOOP_N_WAKES; wake++) {
+        if (pm_loop_woke[wake]) {
+            return;
+        }
+    }
+
+    pm_loop_woke[PM_LOOP_WAKE_UNIXCTL] = true;
+}
+
+/*
+ * pm_loop_phase_end: a pmd_run phase that started at start is done
+ *
+ * input: pm_perf id of the phase, PM_PERF_RECONFIGURE..PM_PERF_DOM_UPDATE
+ */
+void
+pm_loop_phase_end(enum pm_perf_id id, uint64_t start)
+{
+    uint64_t usecs = pm_perf_now() - start;
+
+    pm_perf_record(id, usecs);
+    if (NULL != pm_loop_cur) {
+        pm_loop_cur->phase[id - PM_LOOP_FIRST_PHASE] += usecs;
+    }
+}
+
+void
+pm_loop_note_dirty(void)
+{
+    if (NULL != pm_loop_cur) {
+        pm_loop_cur->dirty++;
+    }
+}
+
+void
+pm_loop_note_commit(bool dom, int status)
+{
+    if (NULL != pm_loop_cur) {
+        if (dom) {
+            pm_loop_cur->dom_status = status;
+        } else {
+            pm_loop_cur->status = status;
+        }
+    }
+}
+
+/*
+ * pm_loop_set_deadline: the next timed wakeup pmd_wait asked for
+ */
+void
+pm_loop_set_deadline(long long int deadline)
+{
+    pm_loop_deadline = deadline;
+}
+
+// the first reason that applies, in order of certainty
+static enum pm_loop_wake
+pm_loop_classify(void)
+{
+    if (pm_loop_woke[PM_LOOP_WAKE_TIMER]) {
+        return PM_LOOP_WAKE_TIMER;
+    }
+    if (pm_loop_woke[PM_LOOP_WAKE_IDL]) {
+        return PM_LOOP_WAKE_IDL;
+    }
+    if (pm_loop_woke[PM_LOOP_WAKE_SUBSCRIBER]) {
+        return PM_LOOP_WAKE_SUBSCRIBER;
+    }
+    if (pm_loop_woke[PM_LOOP_WAKE_METRICS]) {
+        return PM_LOOP_WAKE_METRICS;
+    }
+    if (pm_loop_woke[PM_LOOP_WAKE_UNIXCTL]) {
+        return PM_LOOP_WAKE_UNIXCTL;
+    }
+    // didn't sleep and nothing to show for it
+    return PM_LOOP_WAKE_IMMEDIATE;
+}
+
+static void
+pm_loop_put_record(struct ds *ds, const struct pm_loop_record *rec)
+{
+    time_t secs = rec->wall / 1000;
+    struct tm tm;
+    char buf[32];
+    int idx;
+
+    localtime_r(&secs, &tm);
+    strftime(buf, sizeof(buf), "%H:%M:%S", &tm);
+
+    ds_put_format(ds, "%s.%03lld %-9s %9llu %9llu", buf, rec->wall % 1000,
+                  pm_loop_wake_names[rec->wake],
+                  (unsigned long long)rec->sleep,
+                  (unsigned long long)rec->total);
+    for (idx = 0; idx < PM_LOOP_N_PHASES; idx++) {
+        ds_put_format(ds, " %8u", rec->phase[idx]);
+    }
+    ds_put_format(ds, " %5u %5u %s %s\n", rec->i2c_ops, rec->dirty,
+                  rec->status < 0 ? "-" :
+                      ovsdb_idl_txn_status_to_string(rec->status),
+                  rec->dom_status < 0 ? "-" :
+                      ovsdb_idl_txn_status_to_string(rec->dom_status));
+}
+
+static void
+pm_loop_put_ring(struct ds *ds, const struct pm_loop_record *ring,
+                 unsigned int next, unsigned int count)
+{
+    unsigned int idx;
+
+    ds_put_format(ds, "%-12s %-9s %9s %9s %8s %8s %8s %8s %8s %5s %5s %s\n",
+                  "time", "wake", "sleep(us)", "busy(us)", "reconfig",
+                  "read", "update", "dom_read", "dom_upd", "i2c", "dirty",
+                  "commit dom_commit");
+
+    // oldest first
+    for (idx = 0; idx < count; idx++) {
+        pm_loop_put_record(ds, &ring[(next + PM_LOOP_HISTORY - count + idx) %
+                                     PM_LOOP_HISTORY]);
+    }
+}
+
+// keep the iterations that led to an overrun; a snapshot that hasn't been
+// cleared yet is not overwritten, so the first overrun of a burst wins
+static void
+pm_loop_freeze(const struct pm_loop_record *rec)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    unsigned int idx;
+
+    VLOG_WARN_RL(&rl, "main loop iteration took %llu msecs "
+                 "(budget %u msecs, woke on %s, %u I2C ops)",
+                 (unsigned long long)(rec->total / 1000), pm_loop_budget,
+                 pm_loop_wake_names[rec->wake], rec->i2c_ops);
+
+    if (0 != pm_loop_frozen_count) {
+        return;
+    }
+
+    // store the snapshot oldest first so it doesn't need its own cursor
+    for (idx = 0; idx < pm_loop_count; idx++) {
+        pm_loop_frozen[idx] = pm_loop_ring[(pm_loop_next + PM_LOOP_HISTORY -
+                                            pm_loop_count + idx) %
+                                           PM_LOOP_HISTORY];
+    }
+    pm_loop_frozen_count = pm_loop_count;
+    pm_loop_frozen_time = rec->wall;
+
+    pm_loop_put_ring(&ds, pm_loop_frozen,
+                     pm_loop_frozen_count % PM_LOOP_HISTORY,
+                     pm_loop_frozen_count);
+    VLOG_WARN("flight recorder frozen (ops-pmd/loop frozen to show, "
+              "ops-pmd/loop clear to re-arm):\n%s", ds_cstr(&ds));
+    ds_destroy(&ds);
+}
+
+static uint32_t
+pm_loop_rate_total(const uint32_t *counts)
+{
+    uint32_t total = 0;
+    int wake;
+
+    for (wake = 0; wake < PM_LOOP_N_WAKES; wake++) {
+        total += counts[wake];
+    }
+
+    return total;
+}
+
+static void
+pm_loop_rate_check(const uint32_t *counts)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 1);
+    uint32_t total = pm_loop_rate_total(counts);
+
+    if (0 == pm_loop_max_rate || total <= pm_loop_max_rate) {
+        return;
+    }
+
+    VLOG_WARN_RL(&rl, "main loop woke %u times in one second (limit %u): "
+                 "timer %u, idl %u, subscriber %u, metrics %u, unixctl %u, "
+                 "immediate %u",
+                 total, pm_loop_max_rate,
+                 counts[PM_LOOP_WAKE_TIMER], counts[PM_LOOP_WAKE_IDL],
+                 counts[PM_LOOP_WAKE_SUBSCRIBER],
+                 counts[PM_LOOP_WAKE_METRICS],
+                 counts[PM_LOOP_WAKE_UNIXCTL],
+                 counts[PM_LOOP_WAKE_IMMEDIATE]);
+}
+
+// move the per-second window up to sec; the seconds in between ended,
+// the ones without any iteration with a count of zero
+static void
+pm_loop_rate_advance(long long int sec)
+{
+    long long int idx;
+
+    if (0 == pm_loop_rate_sec) {
+        pm_loop_rate_sec = sec;
+        return;
+    }
+    if (sec <= pm_loop_rate_sec) {
+        return;
+    }
+
+    pm_loop_rate_check(pm_loop_rate[pm_loop_rate_sec % PM_LOOP_RATE_WINDOW]);
+
+    for (idx = pm_loop_rate_sec + 1;
+         idx <= sec && idx <= pm_loop_rate_sec + PM_LOOP_RATE_WINDOW; idx++) {
+        memset(pm_loop_rate[idx % PM_LOOP_RATE_WINDOW], 0,
+               sizeof(pm_loop_rate[0]));
+    }
+
+    // one slot always holds the second in progress
+    pm_loop_rate_secs = MIN(pm_loop_rate_secs + (sec - pm_loop_rate_sec),
+                            PM_LOOP_RATE_WINDOW - 1);
+    pm_loop_rate_sec = sec;
+}
+
+/*
+ * pm_loop_end: the main loop is about to block
+ */
+void
+pm_loop_end(void)
+{
+    struct pm_loop_record *rec = pm_loop_cur;
+    uint64_t now = pm_perf_now();
+
+    if (NULL == rec) {
+        return;
+    }
+
+    rec->total = now - pm_loop_start;
+    rec->i2c_ops = pm_i2c_op_count() - pm_loop_i2c_base;
+    pm_perf_record(PM_PERF_LOOP, rec->total);
+    rec->wake = pm_loop_classify();
+
+    pm_loop_wakes[rec->wake]++;
+    pm_loop_rate_advance(time_msec() / 1000);
+    pm_loop_rate[pm_loop_rate_sec % PM_LOOP_RATE_WINDOW][rec->wake]++;
+
+    pm_loop_next = (pm_loop_next + 1) % PM_LOOP_HISTORY;
+    if (pm_loop_count < PM_LOOP_HISTORY) {
+        pm_loop_count++;
+    }
+
+    if (0 != pm_loop_budget && rec->total > pm_loop_budget * 1000ULL) {
+        pm_loop_freeze(rec);
+    }
+
+    pm_loop_cur = NULL;
+    pm_loop_idle = now;
+}
+
+/*
+ * pm_loop_dump: show the live ring, or the frozen one
+ *
+ * input: true for the snapshot taken at the last overrun
+ */
+void
+pm_loop_dump(struct ds *ds, bool frozen)
+{
+    time_t secs;
+    struct tm tm;
+    char buf[32];
+
+    if (false == frozen) {
+        pm_loop_put_ring(ds, pm_loop_ring, pm_loop_next, pm_loop_count);
+        return;
+    }
+
+    if (0 == pm_loop_frozen_count) {
+        ds_put_format(ds, "No overrun recorded (budget %u msecs)\n",
+                      pm_loop_budget);
+        return;
+    }
+
+    secs = pm_loop_frozen_time / 1000;
+    localtime_r(&secs, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    ds_put_format(ds, "Frozen at %s (budget %u msecs)\n", buf, pm_loop_budget);
+    pm_loop_put_ring(ds, pm_loop_frozen,
+                     pm_loop_frozen_count % PM_LOOP_HISTORY,
+                     pm_loop_frozen_count);
+}
+
+/*
+ * pm_loop_clear: drop the frozen snapshot so the next overrun is kept
+ */
+void
+pm_loop_clear(void)
+{
+    pm_loop_frozen_count = 0;
+}
+
+/*
+ * pm_loop_wake_count: iterations woken by a source since the daemon started
+ */
+uint64_t
+pm_loop_wake_count(enum pm_loop_wake wake)
+{
+    return pm_loop_wakes[wake];
+}
+
+/*
+ * pm_loop_wakeups_dump: show iterations by wake source, in total, over the
+ *                       last complete second and on average over the window
+ */
+void
+pm_loop_wakeups_dump(struct ds *ds)
+{
+    const uint32_t *last = NULL;
+    uint64_t total = 0;
+    uint32_t sum;
+    unsigned int idx;
+    int wake;
+
+    pm_loop_rate_advance(time_msec() / 1000);
+    if (0 != pm_loop_rate_secs) {
+        last = pm_loop_rate[(pm_loop_rate_sec - 1) % PM_LOOP_RATE_WINDOW];
+    }
+
+    ds_put_format(ds, "%-10s %12s %10s %10s\n", "wake", "total",
+                  "last sec", "avg/sec");
+
+    for (wake = 0; wake < PM_LOOP_N_WAKES; wake++) {
+        sum = 0;
+        for (idx = 1; idx <= pm_loop_rate_secs; idx++) {
+            sum += pm_loop_rate[(pm_loop_rate_sec - idx) %
+                                PM_LOOP_RATE_WINDOW][wake];
+        }
+        total += pm_loop_wakes[wake];
+
+        ds_put_format(ds, "%-10s %12llu %10u %10.2f\n",
+                      pm_loop_wake_names[wake],
+                      (unsigned long long)pm_loop_wakes[wake],
+                      last ? last[wake] : 0,
+                      pm_loop_rate_secs ? (double)sum / pm_loop_rate_secs : 0);
+    }
+
+    ds_put_format(ds, "%-10s %12llu %10u\n", "all",
+                  (unsigned long long)total,
+                  last ? pm_loop_rate_total(last) : 0);
+    ds_put_format(ds, "(average over the last %u seconds, alarm above %u "
+                  "per second)\n", pm_loop_rate_secs, pm_loop_max_rate);
+}
@@ -0,0 +1,470 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for the metrics endpoint.
+ *
+ * The metrics socket answers any HTTP request with the daemon's counters,
+ * latency histograms and per-port DOM gauges in the Prometheus text
+ * exposition format, then closes the connection:
+ *
+ *     curl --unix-socket /var/run/openvswitch/ops-pmd.metrics \
+ *          http://localhost/metrics
+ *
+ * or, with --metrics=ptcp:9105:127.0.0.1, a plain scrape of port 9105.
+ * Everything is rendered from counters the daemon keeps anyway, and the
+ * main loop run that serves a scrape doesn't scan the modules unless the
+ * tick is due (pmd_scan_due()), so a scrape never touches OVSDB or the I2C
+ * buses.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dynamic-string.h>
+#include <list.h>
+#include <poll-loop.h>
+#include <shash.h>
+#include <stream.h>
+#include <timeval.h>
+#include <util.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+#include "pm_perf.h"
+
+VLOG_DEFINE_THIS_MODULE(pm_metrics);
+
+#define PM_METRICS_REQUEST_MAX  4096    // longest request accepted
+#define PM_METRICS_MAX          8       // concurrent scrapes
+
+struct pm_metrics_conn {
+    struct ovs_list list_node;      // in conns
+    struct stream *stream;
+    struct ds request;              // request received so far
+    struct ds response;             // empty until the request is complete
+    size_t sent;
+};
+
+extern struct shash ovs_intfs;
+
+static struct pstream *metrics_pstream = NULL;
+static struct ovs_list conns = OVS_LIST_INITIALIZER(&conns);
+static unsigned int n_conns = 0;
+
+// a per-port counter family taken from struct pm_i2c_stats
+static const struct {
+    const char *name;
+    size_t offset;
+    double scale;
+    const char *help;
+} pm_metrics_i2c_counters[] = {
+    { "ops_pmd_port_i2c_operations_total",
+      offsetof(struct pm_i2c_stats, ops), 1,
+      "I2C operations issued for the port." },
+    { "ops_pmd_port_i2c_failures_total",
+      offsetof(struct pm_i2c_stats, failures), 1,
+      "I2C operations for the port that failed." },
+    { "ops_pmd_port_i2c_retries_total",
+      offsetof(struct pm_i2c_stats, retries), 1,
+      "I2C operations for the port repeated after a failure." },
+    { "ops_pmd_port_i2c_seconds_total",
+      offsetof(struct pm_i2c_stats, usecs), 1e-6,
+      "Time spent on the bus for the port." },
+};
+
+// a per-lane DOM gauge family taken from pm_dom_sample_t, in base units
+static const struct {
+    const char *name;
+    size_t offset;
+    double scale;
+    const char *help;
+} pm_metrics_dom_lanes[] = {
+    { "ops_pmd_dom_tx_bias_amperes",
+      offsetof(pm_dom_sample_t, tx_bias), 2e-6,
+      "Laser bias current per lane." },
+    { "ops_pmd_dom_tx_power_watts",
+      offsetof(pm_dom_sample_t, tx_power), 1e-7,
+      "Transmit power per lane." },
+    { "ops_pmd_dom_rx_power_watts",
+      offsetof(pm_dom_sample_t, rx_power), 1e-7,
+      "Receive power per lane." },
+};
+
+/*
+ * pm_metrics_init: open the metrics socket
+ *
+ * input: passive stream name, e.g. "punix:/var/run/openvswitch/ops-pmd.metrics"
+ *
+ * output: 0 on success, errno value on failure
+ */
+int
+pm_metrics_init(const char *name)
+{
+    int rc;
+
+    rc = pstream_open(name, &metrics_pstream, 0);
+    if (rc) {
+        VLOG_ERR("unable to open metrics socket %s: %s",
+                 name, ovs_strerror(rc));
+        metrics_pstream = NULL;
+    }
+
+    return rc;
+}
+
+static void
+pm_metrics_conn_destroy(struct pm_metrics_conn *conn)
+{
+    ds_destroy(&conn->request);
+    ds_destroy(&conn->response);
+    stream_close(conn->stream);
+    list_remove(&conn->list_node);
+    n_conns--;
+    free(conn);
+}
+
+void
+pm_metrics_exit(void)
+{
+    struct pm_metrics_conn *conn, *next;
+
+    LIST_FOR_EACH_SAFE (conn, next, list_node, &conns) {
+        pm_metrics_conn_destroy(conn);
+    }
+
+    pstream_close(metrics_pstream);
+    metrics_pstream = NULL;
+}
+
+/*
+ * pm_metrics_label: append a label value, escaped as the exposition
+ *                   format wants it
+ */
+void
+pm_metrics_label(struct ds *ds, const char *value)
+{
+    for (; *value; value++) {
+        switch (*value) {
+        case '\\':
+            ds_put_cstr(ds, "\\\\");
+            break;
+        case '"':
+            ds_put_cstr(ds, "\\\"");
+            break;
+        case '\n':
+            ds_put_cstr(ds, "\\n");
+            break;
+        default:
+            ds_put_char(ds, *value);
+            break;
+        }
+    }
+}
+
+static void
+pm_metrics_header(struct ds *ds, const char *name, const char *type,
+                  const char *help)
+{
+    ds_put_format(ds, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// one sample of a metric with a single label
+static void
+pm_metrics_sample(struct ds *ds, const char *name, const char *label,
+                  const char *value, double sample)
+{
+    ds_put_format(ds, "%s{%s=\"", name, label);
+    pm_metrics_label(ds, value);
+    ds_put_format(ds, "\"} %.17g\n", sample);
+}
+
+static void
+pm_metrics_loop(struct ds *ds)
+{
+    int wake;
+
+    pm_metrics_header(ds, "ops_pmd_loop_wakeups_total", "counter",
+                      "Main loop iterations by wake source.");
+    for (wake = 0; wake < PM_LOOP_N_WAKES; wake++) {
+        pm_metrics_sample(ds, "ops_pmd_loop_wakeups_total", "source",
+                          pm_loop_wake_name(wake),
+                          pm_loop_wake_count(wake));
+    }
+}
+
+// per-port counters and gauges; ports are walked once per metric family,
+// as the format wants each family in one block
+static void
+pm_metrics_ports(struct ds *ds)
+{
+    const struct shash_node **nodes;
+    const pm_port_t *port;
+    size_t count;
+    size_t idx;
+    size_t metric;
+    int lane;
+
+    nodes = shash_sort(&ovs_intfs);
+    count = shash_count(&ovs_intfs);
+
+    pm_metrics_header(ds, "ops_pmd_module_present", "gauge",
+                      "1 if a pluggable module is present.");
+    for (idx = 0; idx < count; idx++) {
+        port = nodes[idx]->data;
+        if (NULL != port) {
+            pm_metrics_sample(ds, "ops_pmd_module_present", "interface",
+                              port->instance, port->present);
+        }
+    }
+
+    for (metric = 0; metric < ARRAY_SIZE(pm_metrics_i2c_counters); metric++) {
+        const char *name = pm_metrics_i2c_counters[metric].name;
+
+        pm_metrics_header(ds, name, "counter",
+                          pm_metrics_i2c_counters[metric].help);
+        for (idx = 0; idx < count; idx++) {
+            const uint64_t *value;
+
+            port = nodes[idx]->data;
+            if (NULL == port) {
+                continue;
+            }
+            value = (const uint64_t *)((const char *)&port->i2c_stats +
+                                       pm_metrics_i2c_counters[metric].offset);
+            pm_metrics_sample(ds, name, "interface", port->instance,
+                              *value * pm_metrics_i2c_counters[metric].scale);
+        }
+    }
+
+    // DOM gauges, in base units, for ports with a current sample
+    pm_metrics_header(ds, "ops_pmd_dom_temperature_celsius", "gauge",
+                      "Module temperature.");
+    for (idx = 0; idx < count; idx++) {
+        port = nodes[idx]->data;
+        if (NULL != port && port->module.dom_sample_valid) {
+            pm_metrics_sample(ds, "ops_pmd_dom_temperature_celsius",
+                              "interface", port->instance,
+                              port->module.dom_sample.temperature / 256.0);
+        }
+    }
+
+    pm_metrics_header(ds, "ops_pmd_dom_vcc_volts", "gauge",
+                      "Module supply voltage.");
+    for (idx = 0; idx < count; idx++) {
+        port = nodes[idx]->data;
+        if (NULL != port && port->module.dom_sample_valid) {
+            pm_metrics_sample(ds, "ops_pmd_dom_vcc_volts", "interface",
+                              port->instance,
+                              port->module.dom_sample.vcc * 1e-4);
+        }
+    }
+
+    pm_metrics_header(ds, "ops_pmd_dom_sample_timestamp_seconds", "gauge",
+                      "Wall clock time of the last DOM sample.");
+    for (idx = 0; idx < count; idx++) {
+        port = nodes[idx]->data;
+        if (NULL != port && port->module.dom_sample_valid) {
+            pm_metrics_sample(ds, "ops_pmd_dom_sample_timestamp_seconds",
+                              "interface", port->instance,
+                              port->dom_sample_time / 1000.0);
+        }
+    }
+
+    // per-lane gauges
+    for (metric = 0; metric < ARRAY_SIZE(pm_metrics_dom_lanes); metric++) {
+        const char *name = pm_metrics_dom_lanes[metric].name;
+
+        pm_metrics_header(ds, name, "gauge",
+                          pm_metrics_dom_lanes[metric].help);
+        for (idx = 0; idx < count; idx++) {
+            const uint16_t *values;
+
+            port = nodes[idx]->data;
+            if (NULL == port || false == port->module.dom_sample_valid) {
+                continue;
+            }
+            values = (const uint16_t *)
+                     ((const char *)&port->module.dom_sample +
+                      pm_metrics_dom_lanes[metric].offset);
+            for (lane = 0; lane < port->module.dom_sample.n_lanes; lane++) {
+                ds_put_format(ds, "%s{interface=\"", name);
+                pm_metrics_label(ds, port->instance);
+                ds_put_format(ds, "\",lane=\"%d\"} %.17g\n", lane + 1,
+                              values[lane] * pm_metrics_dom_lanes[metric].scale);
+            }
+        }
+    }
+
+    free(nodes);
+}
+
+/*
+ * pm_metrics_render: the whole exposition, as served on the metrics socket
+ */
+void
+pm_metrics_render(struct ds *ds)
+{
+    pm_perf_metrics(ds);
+    pm_i2c_metrics(ds);
+    pm_txn_stats_metrics(ds);
+    pm_metrics_loop(ds);
+    pm_metrics_ports(ds);
+}
+
+static void
+pm_metrics_accept(struct stream *stream)
+{
+    struct pm_metrics_conn *conn;
+
+    if (n_conns >= PM_METRICS_MAX) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+
+        VLOG_WARN_RL(&rl, "too many metrics connections, closing new one");
+        stream_close(stream);
+        return;
+    }
+
+    conn = xzalloc(sizeof(*conn));
+    conn->stream = stream;
+    ds_init(&conn->request);
+    ds_init(&conn->response);
+
+    list_push_back(&conns, &conn->list_node);
+    n_conns++;
+}
+
+// read the request; once its header is complete, prepare the response.
+// Returns an errno value if the connection must go.
+static int
+pm_metrics_recv(struct pm_metrics_conn *conn)
+{
+    struct ds body = DS_EMPTY_INITIALIZER;
+    char buf[512];
+    int retval;
+
+    if (conn->response.length) {
+        return 0;
+    }
+
+    retval = stream_recv(conn->stream, buf, sizeof(buf));
+    if (-EAGAIN == retval) {
+        return 0;
+    }
+    pm_loop_note_wake(PM_LOOP_WAKE_METRICS);
+    if (retval <= 0) {
+        return retval ? -retval : EOF;
+    }
+
+    ds_put_buffer(&conn->request, buf, retval);
+    if (NULL == strstr(ds_cstr(&conn->request), "\r\n\r\n") &&
+        NULL == strstr(ds_cstr(&conn->request), "\n\n")) {
+        return conn->request.length > PM_METRICS_REQUEST_MAX ? EPROTO : 0;
+    }
+
+    // whatever was asked for, the answer is the metrics
+    pm_metrics_render(&body);
+    ds_put_format(&conn->response,
+                  "HTTP/1.0 200 OK\r\n"
+                  "Content-Type: text/plain; version=0.0.4\r\n"
+                  "Content-Length: %"PRIuSIZE"\r\n"
+                  "Connection: close\r\n"
+                  "\r\n", body.length);
+    ds_put_buffer(&conn->response, body.string, body.length);
+    ds_destroy(&body);
+
+    return 0;
+}
+
+// send the response; returns EOF once it is all out, or an errno value
+static int
+pm_metrics_send(struct pm_metrics_conn *conn)
+{
+    int retval;
+
+    while (conn->sent < conn->response.length) {
+        retval = stream_send(conn->stream, conn->response.string + conn->sent,
+                             conn->response.length - conn->sent);
+        if (-EAGAIN == retval) {
+            return 0;
+        } else if (retval < 0) {
+            return -retval;
+        }
+        pm_loop_note_wake(PM_LOOP_WAKE_METRICS);
+        conn->sent += retval;
+    }
+
+    return conn->response.length ? EOF : 0;
+}
+
+void
+pm_metrics_run(void)
+{
+    struct pm_metrics_conn *conn, *next;
+    struct stream *stream;
+    int rc;
+
+    if (NULL == metrics_pstream) {
+        return;
+    }
+
+    while (0 == pstream_accept(metrics_pstream, &stream)) {
+        pm_loop_note_wake(PM_LOOP_WAKE_METRICS);
+        pm_metrics_accept(stream);
+    }
+
+    LIST_FOR_EACH_SAFE (conn, next, list_node, &conns) {
+        stream_run(conn->stream);
+
+        rc = pm_metrics_recv(conn);
+        if (0 == rc) {
+            rc = pm_metrics_send(conn);
+        }
+        if (0 != rc) {
+            if (EOF != rc) {
+                VLOG_DBG("metrics connection dropped: %s",
+                         ovs_retval_to_string(rc));
+            }
+            pm_metrics_conn_destroy(conn);
+        }
+    }
+}
+
+void
+pm_metrics_wait(void)
+{
+    struct pm_metrics_conn *conn;
+
+    if (NULL == metrics_pstream) {
+        return;
+    }
+
+    pstream_wait(metrics_pstream);
+
+    LIST_FOR_EACH (conn, list_node, &conns) {
+        stream_run_wait(conn->stream);
+        if (conn->response.length) {
+            stream_send_wait(conn->stream);
+        } else {
+            stream_recv_wait(conn->stream);
+        }
+    }
+}
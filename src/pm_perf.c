@@ -0,0 +1,221 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for the ops-pmd latency histograms.
+ *
+ * Each histogram has fixed log-linear buckets: every power of two of
+ * microseconds is split into PM_PERF_SUB_BUCKETS buckets, so a reported
+ * percentile is within 25% of the real value. Recording a value is a
+ * handful of integer operations and never allocates.
+ ***************************************************************************/
+
+#include <string.h>
+
+#include "pm_perf.h"
+
+#define PM_PERF_SUB_BITS        2
+#define PM_PERF_SUB_BUCKETS     (1 << PM_PERF_SUB_BITS)
+#define PM_PERF_MAX_BITS        40      // ~12 days in microseconds
+#define PM_PERF_N_BUCKETS       (PM_PERF_MAX_BITS * PM_PERF_SUB_BUCKETS)
+
+struct pm_perf_hist {
+    uint64_t    count;
+    uint64_t    sum;
+    uint64_t    max;
+    uint64_t    buckets[PM_PERF_N_BUCKETS];
+};
+
+static struct pm_perf_hist pm_perf_hists[PM_PERF_N_IDS];
+
+static const char *pm_perf_names[PM_PERF_N_IDS] = {
+    [PM_PERF_LOOP]              = "loop_busy",
+    [PM_PERF_RUN]               = "pmd_run",
+    [PM_PERF_RECONFIGURE]       = "pmd_reconfigure",
+    [PM_PERF_READ_STATE]        = "pm_read_state",
+    [PM_PERF_OVSDB_UPDATE]      = "pm_ovsdb_update",
+    [PM_PERF_DOM_READ]          = "pm_read_dom_state",
+    [PM_PERF_DOM_UPDATE]        = "pm_ovsdb_dom_update",
+    [PM_PERF_I2C_REG_READ]      = "i2c_reg_read",
+    [PM_PERF_I2C_REG_WRITE]     = "i2c_reg_write",
+    [PM_PERF_I2C_DATA_READ]     = "i2c_data_read",
+    [PM_PERF_I2C_DATA_WRITE]    = "i2c_data_write",
+    [PM_PERF_STAGE_A0]          = "stage_a0",
+    [PM_PERF_STAGE_CHECKSUM]    = "stage_checksum",
+    [PM_PERF_STAGE_PARSE]       = "stage_parse",
+    [PM_PERF_STAGE_A2]          = "stage_a2",
+    [PM_PERF_STAGE_PUBLISH]     = "stage_publish",
+    [PM_PERF_STAGE_COMMIT]      = "stage_commit",
+    [PM_PERF_INSERT]            = "insert_to_commit",
+    [PM_PERF_REMOVE]            = "remove_to_commit",
+    [PM_PERF_COMMIT_IDENTITY]   = "identity_commit",
+    [PM_PERF_COMMIT_DOM]        = "dom_commit",
+};
+
+// values below PM_PERF_SUB_BUCKETS get a bucket each; above that, the
+// bucket is picked by the position of the top bit and the next SUB_BITS bits
+static unsigned int
+pm_perf_bucket(uint64_t value)
+{
+    unsigned int bits;
+    unsigned int idx;
+
+    if (value < PM_PERF_SUB_BUCKETS) {
+        return value;
+    }
+
+    bits = 63 - __builtin_clzll(value);
+    idx = (bits - PM_PERF_SUB_BITS + 1) * PM_PERF_SUB_BUCKETS +
+          ((value >> (bits - PM_PERF_SUB_BITS)) & (PM_PERF_SUB_BUCKETS - 1));
+
+    return idx < PM_PERF_N_BUCKETS ? idx : PM_PERF_N_BUCKETS - 1;
+}
+
+// largest value that falls into a bucket
+static uint64_t
+pm_perf_bucket_limit(unsigned int idx)
+{
+    unsigned int bits;
+    uint64_t sub;
+
+    if (idx < PM_PERF_SUB_BUCKETS) {
+        return idx;
+    }
+
+    bits = idx / PM_PERF_SUB_BUCKETS + PM_PERF_SUB_BITS - 1;
+    sub = idx % PM_PERF_SUB_BUCKETS;
+
+    return ((PM_PERF_SUB_BUCKETS + sub + 1) << (bits - PM_PERF_SUB_BITS)) - 1;
+}
+
+void
+pm_perf_record(enum pm_perf_id id, uint64_t usecs)
+{
+    struct pm_perf_hist *hist = &pm_perf_hists[id];
+
+    hist->count++;
+    hist->sum += usecs;
+    if (usecs > hist->max) {
+        hist->max = usecs;
+    }
+    hist->buckets[pm_perf_bucket(usecs)]++;
+}
+
+void
+pm_perf_reset(void)
+{
+    memset(pm_perf_hists, 0, sizeof(pm_perf_hists));
+}
+
+static uint64_t
+pm_perf_percentile(const struct pm_perf_hist *hist, unsigned int percent)
+{
+    uint64_t rank = (hist->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    uint64_t limit;
+    unsigned int idx;
+
+    for (idx = 0; idx < PM_PERF_N_BUCKETS; idx++) {
+        seen += hist->buckets[idx];
+        if (seen >= rank) {
+            limit = pm_perf_bucket_limit(idx);
+            return limit < hist->max ? limit : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+/*
+ * pm_perf_dump: show count, mean, p50, p99 and max of every histogram
+ */
+void
+pm_perf_dump(struct ds *ds)
+{
+    const struct pm_perf_hist *hist;
+    int id;
+
+    ds_put_format(ds, "%-20s %10s %10s %10s %10s %10s\n",
+                  "(usecs)", "count", "mean", "p50", "p99", "max");
+
+    for (id = 0; id < PM_PERF_N_IDS; id++) {
+        hist = &pm_perf_hists[id];
+
+        if (0 == hist->count) {
+            ds_put_format(ds, "%-20s %10d\n", pm_perf_names[id], 0);
+            continue;
+        }
+
+        ds_put_format(ds, "%-20s %10llu %10llu %10llu %10llu %10llu\n",
+                      pm_perf_names[id],
+                      (unsigned long long)hist->count,
+                      (unsigned long long)(hist->sum / hist->count),
+                      (unsigned long long)pm_perf_percentile(hist, 50),
+                      (unsigned long long)pm_perf_percentile(hist, 99),
+                      (unsigned long long)hist->max);
+    }
+}
+
+/*
+ * pm_perf_metrics: every histogram in the Prometheus text format
+ *
+ * Buckets are reported at one less than every other power of two of
+ * microseconds. Values are whole microseconds and these bounds are the
+ * largest value of one of our buckets, so each reported count is exactly
+ * the number of values <= le.
+ */
+void
+pm_perf_metrics(struct ds *ds)
+{
+    const struct pm_perf_hist *hist;
+    uint64_t cumulative;
+    uint64_t le;
+    unsigned int bits;
+    unsigned int idx;
+    int id;
+
+    ds_put_cstr(ds, "# HELP ops_pmd_latency_seconds Duration of daemon "
+                "operations and insertion/removal stages.\n"
+                "# TYPE ops_pmd_latency_seconds histogram\n");
+
+    for (id = 0; id < PM_PERF_N_IDS; id++) {
+        hist = &pm_perf_hists[id];
+        cumulative = 0;
+        idx = 0;
+
+        // le = 3us, 15us, 63us ... ~16.8s
+        for (bits = 2; bits <= 24; bits += 2) {
+            le = (1ULL << bits) - 1;
+            while (idx < PM_PERF_N_BUCKETS &&
+                   pm_perf_bucket_limit(idx) <= le) {
+                cumulative += hist->buckets[idx++];
+            }
+            ds_put_format(ds, "ops_pmd_latency_seconds_bucket{op=\"%s\","
+                          "le=\"%.6f\"} %llu\n", pm_perf_names[id], le * 1e-6,
+                          (unsigned long long)cumulative);
+        }
+        ds_put_format(ds, "ops_pmd_latency_seconds_bucket{op=\"%s\","
+                      "le=\"+Inf\"} %llu\n", pm_perf_names[id],
+                      (unsigned long long)hist->count);
+        ds_put_format(ds, "ops_pmd_latency_seconds_sum{op=\"%s\"} %.6f\n",
+                      pm_perf_names[id], hist->sum * 1e-6);
+        ds_put_format(ds, "ops_pmd_latency_seconds_count{op=\"%s\"} %llu\n",
+                      pm_perf_names[id], (unsigned long long)hist->count);
+    }
+}
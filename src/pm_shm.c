@@ -0,0 +1,338 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for the shared-memory snapshot of pluggable module state.
+ * The record layout and the reader side live in pm_shm.h.
+ ***************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <timeval.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+#include "pm_shm.h"
+
+VLOG_DEFINE_THIS_MODULE(pm_shm);
+
+// header is padded so that records start on a cache line
+#define PM_SHM_HEADER_SIZE  64
+
+static struct pm_shm_header *shm_hdr = NULL;
+static size_t shm_size;
+
+// slots handed out to ports; the writer is the only user of this map
+static bool shm_slot_used[PM_SHM_MAX_PORTS];
+
+static struct pm_shm_port *
+pm_shm_record(int slot)
+{
+    return (struct pm_shm_port *)((char *)shm_hdr + shm_hdr->header_size +
+                                  (size_t)slot * shm_hdr->record_size);
+}
+
+// seqlock write side: the record is inconsistent between begin and end
+static void
+pm_shm_write_begin(struct pm_shm_port *rec)
+{
+    uint32_t seq = __atomic_load_n(&rec->seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void
+pm_shm_write_end(struct pm_shm_port *rec)
+{
+    uint32_t seq = __atomic_load_n(&rec->seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+static void
+pm_shm_copy_string(char *dst, size_t size, const char *src)
+{
+    if (NULL == src) {
+        dst[0] = 0;
+        return;
+    }
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = 0;
+}
+
+// form factor of the cage, as MODULE_TYPE_*
+static uint32_t
+pm_shm_module_type(const char *connector)
+{
+    if (NULL == connector) {
+        return 0;
+    } else if (strcmp(connector, CONNECTOR_SFP_PLUS) == 0) {
+        return MODULE_TYPE_SFP_PLUS;
+    } else if (strcmp(connector, CONNECTOR_QSFP_PLUS) == 0) {
+        return MODULE_TYPE_QSFP_PLUS;
+    } else if (strcmp(connector, CONNECTOR_QSFP28) == 0) {
+        return MODULE_TYPE_QSFP28;
+    }
+
+    return 0;
+}
+
+/*
+ * pm_shm_init: create (or take over) the shared-memory segment
+ *
+ * input: segment name, PM_SHM_NAME unless --shm-name says otherwise
+ *
+ * output: 0 on success, -1 on failure. Failure is not fatal; the snapshot
+ *         is simply not published.
+ */
+int
+pm_shm_init(const char *name)
+{
+    struct pm_shm_port *rec;
+    bool reuse;
+    void *addr;
+    uint32_t seq;
+    int slot;
+    int fd;
+
+    shm_size = PM_SHM_HEADER_SIZE +
+               (size_t)PM_SHM_MAX_PORTS * sizeof(struct pm_shm_port);
+
+    fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        VLOG_ERR("unable to open shared memory %s: %s",
+                 name, strerror(errno));
+        return -1;
+    }
+
+    if (ftruncate(fd, shm_size) < 0) {
+        VLOG_ERR("unable to size shared memory %s: %s",
+                 name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    addr = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == addr) {
+        VLOG_ERR("unable to map shared memory %s: %s",
+                 name, strerror(errno));
+        return -1;
+    }
+
+    shm_hdr = (struct pm_shm_header *)addr;
+
+    // A segment left behind by a previous instance may still be mapped by
+    // readers. Keep its sequence numbers moving forward so that they never
+    // mistake a stale copy for a current one.
+    reuse = (PM_SHM_MAGIC == shm_hdr->magic &&
+             PM_SHM_VERSION == shm_hdr->version &&
+             PM_SHM_HEADER_SIZE == shm_hdr->header_size &&
+             sizeof(struct pm_shm_port) == shm_hdr->record_size &&
+             PM_SHM_MAX_PORTS == shm_hdr->max_ports);
+
+    if (false == reuse) {
+        memset(shm_hdr, 0, shm_size);
+        shm_hdr->header_size = PM_SHM_HEADER_SIZE;
+        shm_hdr->record_size = sizeof(struct pm_shm_port);
+        shm_hdr->max_ports = PM_SHM_MAX_PORTS;
+        shm_hdr->version = PM_SHM_VERSION;
+        __atomic_store_n(&shm_hdr->magic, PM_SHM_MAGIC, __ATOMIC_RELEASE);
+    } else {
+        // A writer that died mid-update leaves seq odd. Round it up to even
+        // before anything else, or every later update would leave the
+        // record looking busy to readers.
+        for (slot = 0; slot < PM_SHM_MAX_PORTS; slot++) {
+            rec = pm_shm_record(slot);
+            seq = __atomic_load_n(&rec->seq, __ATOMIC_RELAXED);
+            if (seq & 1) {
+                __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+            }
+        }
+        for (slot = 0; slot < PM_SHM_MAX_PORTS; slot++) {
+            rec = pm_shm_record(slot);
+            if (0 == rec->flags) {
+                continue;
+            }
+            pm_shm_write_begin(rec);
+            memset((char *)rec + sizeof(rec->seq), 0,
+                   sizeof(*rec) - sizeof(rec->seq));
+            pm_shm_write_end(rec);
+        }
+    }
+
+    __atomic_add_fetch(&shm_hdr->generation, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&shm_hdr->writer_pid, getpid(), __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/*
+ * pm_shm_exit: mark the snapshot as no longer maintained and unmap it
+ */
+void
+pm_shm_exit(void)
+{
+    if (NULL == shm_hdr) {
+        return;
+    }
+
+    __atomic_store_n(&shm_hdr->writer_pid, 0, __ATOMIC_RELEASE);
+    munmap(shm_hdr, shm_size);
+    shm_hdr = NULL;
+}
+
+/*
+ * pm_shm_port_add: assign a snapshot record to a new port
+ */
+void
+pm_shm_port_add(pm_port_t *port)
+{
+    struct pm_shm_port *rec;
+    int slot;
+
+    port->shm_slot = -1;
+
+    if (NULL == shm_hdr) {
+        return;
+    }
+
+    for (slot = 0; slot < PM_SHM_MAX_PORTS; slot++) {
+        if (false == shm_slot_used[slot]) {
+            break;
+        }
+    }
+
+    if (PM_SHM_MAX_PORTS == slot) {
+        VLOG_WARN_ONCE("no shared memory record left for port %s",
+                       port->instance);
+        return;
+    }
+
+    shm_slot_used[slot] = true;
+    port->shm_slot = slot;
+
+    rec = pm_shm_record(slot);
+    pm_shm_write_begin(rec);
+    memset((char *)rec + sizeof(rec->seq), 0,
+           sizeof(*rec) - sizeof(rec->seq));
+    pm_shm_copy_string(rec->name, sizeof(rec->name), port->instance);
+    rec->flags = PM_SHM_F_IN_USE;
+    rec->update_time = time_wall_msec();
+    pm_shm_write_end(rec);
+
+    __atomic_add_fetch(&shm_hdr->generation, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * pm_shm_port_remove: release the snapshot record of a deleted port
+ */
+void
+pm_shm_port_remove(pm_port_t *port)
+{
+    struct pm_shm_port *rec;
+
+    if (NULL == shm_hdr || port->shm_slot < 0) {
+        return;
+    }
+
+    rec = pm_shm_record(port->shm_slot);
+    pm_shm_write_begin(rec);
+    memset((char *)rec + sizeof(rec->seq), 0,
+           sizeof(*rec) - sizeof(rec->seq));
+    pm_shm_write_end(rec);
+
+    shm_slot_used[port->shm_slot] = false;
+    port->shm_slot = -1;
+
+    __atomic_add_fetch(&shm_hdr->generation, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * pm_shm_port_update: copy the current port state into its record
+ */
+void
+pm_shm_port_update(pm_port_t *port)
+{
+    struct ovs_module_info *info = &port->module.ovs_module_columns;
+    struct pm_shm_port *rec;
+    uint32_t flags = PM_SHM_F_IN_USE;
+    uint32_t module_type = 0;
+
+    if (NULL == shm_hdr || port->shm_slot < 0) {
+        return;
+    }
+
+    if (port->present) {
+        flags |= PM_SHM_F_PRESENT;
+        module_type = pm_shm_module_type(port->module_device->connector);
+    }
+    if (port->module.dom_sample_valid) {
+        flags |= PM_SHM_F_DOM_VALID;
+    }
+    if (port->module.dom_sample_stale) {
+        flags |= PM_SHM_F_DOM_STALE;
+    }
+    if (port->hw_enable) {
+        flags |= PM_SHM_F_HW_ENABLE;
+    }
+    if (port->module.optical) {
+        flags |= PM_SHM_F_OPTICAL;
+    }
+    if (port->retry) {
+        flags |= PM_SHM_F_READ_ERROR;
+    }
+
+    rec = pm_shm_record(port->shm_slot);
+    pm_shm_write_begin(rec);
+
+    rec->flags = flags;
+    rec->update_time = time_wall_msec();
+    rec->dom_time = port->module.dom_sample_valid ? port->dom_sample_time : 0;
+    pm_shm_copy_string(rec->connector, sizeof(rec->connector),
+                       info->connector);
+    pm_shm_copy_string(rec->vendor_name, sizeof(rec->vendor_name),
+                       info->vendor_name);
+    pm_shm_copy_string(rec->vendor_oui, sizeof(rec->vendor_oui),
+                       info->vendor_oui);
+    pm_shm_copy_string(rec->vendor_part_number,
+                       sizeof(rec->vendor_part_number),
+                       info->vendor_part_number);
+    pm_shm_copy_string(rec->vendor_revision, sizeof(rec->vendor_revision),
+                       info->vendor_revision);
+    pm_shm_copy_string(rec->vendor_serial_number,
+                       sizeof(rec->vendor_serial_number),
+                       info->vendor_serial_number);
+    rec->max_speed = (NULL == info->max_speed) ?
+                         0 : strtoul(info->max_speed, NULL, 0);
+    rec->module_type = module_type;
+    if (port->module.dom_sample_valid) {
+        rec->dom = port->module.dom_sample;
+    } else {
+        memset(&rec->dom, 0, sizeof(rec->dom));
+    }
+
+    pm_shm_write_end(rec);
+}
@@ -0,0 +1,890 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for the simulated pluggable modules (PLATFORM_SIMULATION only).
+ *
+ * A simulated module is the memory of a real one: the A0h and A2h devices of
+ * an SFP+ (SFF-8472) or the lower page and upper pages 00h-03h of a QSFP
+ * (SFF-8636). Byte 127 selects the upper page where the device is paged,
+ * the control bytes can be written and the TX disable byte, the TX_DISABLE
+ * signal and the reset signal act on the module.
+ *
+ * The monitors (temperature, vcc and per-lane bias and power) are kept in
+ * engineering units and written into the memory, with the alarm and warning
+ * flags computed from the thresholds in the image, whenever the module is
+ * read. They hold their value, ramp to a value set with "ops-pmd/sim
+ * <interface> dom" or follow a random walk. Flags show the current state;
+ * they aren't latched.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random.h>
+#include <shash.h>
+#include <timeval.h>
+#include <util.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+#include "plug.h"
+
+#ifdef PLATFORM_SIMULATION
+
+VLOG_DEFINE_THIS_MODULE(pm_sim);
+
+extern struct shash ovs_intfs;
+
+#define PM_SIM_PAGE_LEN         128
+#define PM_SIM_UPPER_PAGES      4       // pages 00h to 03h
+#define PM_SIM_PAGE_SELECT      127
+
+// SFF-8472 A2h
+#define SFP_A2_THRESHOLDS       0
+#define SFP_A2_MONITORS         96
+#define SFP_A2_STATUS_CONTROL   110
+#define SFP_A2_ALARMS           112
+#define SFP_A2_WARNINGS         116
+#define SFP_SOFT_TX_DISABLE     0x40
+#define SFP_TX_DISABLE_STATE    0x80
+
+// SFF-8636 lower page, and thresholds in upper page 03h
+#define QSFP_FLAGS              6       // bytes 6 to 14
+#define QSFP_FLAGS_LEN          9
+#define QSFP_TEMPERATURE        22
+#define QSFP_VCC                26
+#define QSFP_CHANNEL_MONITORS   34
+#define QSFP_THRESHOLDS_PAGE    3
+
+// most walk steps caught up in one read, after a long time unread
+#define PM_SIM_MAX_WALK         60
+
+enum pm_sim_monitor_id {
+    PM_SIM_TEMPERATURE,
+    PM_SIM_VCC,
+    PM_SIM_TX_BIAS,
+    PM_SIM_TX_POWER,
+    PM_SIM_RX_POWER,
+    PM_SIM_N_MONITORS
+};
+
+static const struct {
+    const char *name;
+    const char *unit;
+    double  scale;              // raw units per engineering unit
+    double  min;
+    double  max;
+    double  initial;
+    double  step;               // largest random walk step, per second
+    bool    lanes;
+    int     sfp_threshold;      // offset in A2h
+    int     qsfp_threshold;     // offset in upper page 03h
+    int     qsfp_flags;         // flag byte in the lower page
+} pm_sim_monitors[PM_SIM_N_MONITORS] = {
+    [PM_SIM_TEMPERATURE] = { "temperature", "C",  256,   -128, 127.99,
+                             35.0, 0.25,  false, 0,  0,  6 },
+    [PM_SIM_VCC]         = { "vcc",         "V",  10000, 0,    6.5535,
+                             3.3,  0.005, false, 8,  16, 7 },
+    [PM_SIM_TX_BIAS]     = { "tx-bias",     "mA", 500,   0,    131.07,
+                             6.0,  0.05,  true,  16, 56, 11 },
+    [PM_SIM_TX_POWER]    = { "tx-power",    "mW", 10000, 0,    6.5535,
+                             0.5,  0.005, true,  24, 64, 13 },
+    [PM_SIM_RX_POWER]    = { "rx-power",    "mW", 10000, 0,    6.5535,
+                             0.5,  0.005, true,  32, 48, 9 },
+};
+
+struct pm_sim_monitor {
+    double  value;              // engineering units
+    double  target;             // ramp end
+    double  rate;               // units per msec towards target, 0 if none
+};
+
+struct pm_sim_eeprom {
+    unsigned char lower[PM_SIM_PAGE_LEN];
+    unsigned char upper[PM_SIM_UPPER_PAGES][PM_SIM_PAGE_LEN];
+    bool    paged;              // byte 127 selects the upper page
+};
+
+struct pm_sim_module {
+    bool    qsfp;
+    struct pm_sim_eeprom a0;
+    struct pm_sim_eeprom a2;    // SFP+ only
+    bool    tx_disable_pin;     // SFP+ TX_DISABLE signal
+    bool    reset;              // QSFP held in reset
+    bool    walk;
+    long long int update_time;  // time_msec() of the last update
+    long long int walk_time;    // time_msec() of the last walk step
+    struct pm_sim_monitor monitors[PM_SIM_N_MONITORS][PM_DOM_MAX_LANES];
+};
+
+// writable bytes, by device; everything else ignores writes
+struct pm_sim_range {
+    int     first;
+    int     last;
+};
+
+static const struct pm_sim_range pm_sim_sfp_a2_writable[] = {
+    { SFP_A2_STATUS_CONTROL, SFP_A2_STATUS_CONTROL },
+    { 118, 118 },               // extended control
+    { 123, 127 },               // password entry and page select
+    { 128, 247 },               // user eeprom
+};
+
+static const struct pm_sim_range pm_sim_qsfp_writable[] = {
+    { QSFP_DISABLE_OFFSET, 99 }, // tx disable, rate select, power, CDR
+    { 100, 106 },               // masks
+    { 119, 127 },               // passwords and page select
+};
+
+static int
+pm_sim_lanes(const struct pm_sim_module *module, enum pm_sim_monitor_id id)
+{
+    if (false == pm_sim_monitors[id].lanes) {
+        return 1;
+    }
+    return module->qsfp ? PM_DOM_MAX_LANES : 1;
+}
+
+static uint16_t
+pm_sim_raw(enum pm_sim_monitor_id id, double value)
+{
+    double raw = value * pm_sim_monitors[id].scale;
+
+    raw += (raw < 0) ? -0.5 : 0.5;
+    if (PM_SIM_TEMPERATURE == id) {
+        return (uint16_t)(int16_t)MAX(MIN(raw, INT16_MAX), INT16_MIN);
+    }
+    return (uint16_t)MAX(MIN(raw, UINT16_MAX), 0);
+}
+
+static double
+pm_sim_value(enum pm_sim_monitor_id id, const unsigned char *bytes)
+{
+    uint16_t raw = (bytes[0] << 8) | bytes[1];
+
+    if (PM_SIM_TEMPERATURE == id) {
+        return (int16_t)raw / pm_sim_monitors[id].scale;
+    }
+    return raw / pm_sim_monitors[id].scale;
+}
+
+static void
+pm_sim_put16(unsigned char *bytes, uint16_t raw)
+{
+    bytes[0] = raw >> 8;
+    bytes[1] = raw & 0xff;
+}
+
+// where the monitor of a lane is, in the image
+static unsigned char *
+pm_sim_monitor_bytes(struct pm_sim_module *module, enum pm_sim_monitor_id id,
+                     int lane)
+{
+    if (false == module->qsfp) {
+        return &module->a2.lower[SFP_A2_MONITORS + 2 * id];
+    }
+
+    switch (id) {
+    case PM_SIM_TEMPERATURE:
+        return &module->a0.lower[QSFP_TEMPERATURE];
+    case PM_SIM_VCC:
+        return &module->a0.lower[QSFP_VCC];
+    case PM_SIM_RX_POWER:
+        return &module->a0.lower[QSFP_CHANNEL_MONITORS + 2 * lane];
+    case PM_SIM_TX_BIAS:
+        return &module->a0.lower[QSFP_CHANNEL_MONITORS + 8 + 2 * lane];
+    case PM_SIM_TX_POWER:
+    default:
+        return &module->a0.lower[QSFP_CHANNEL_MONITORS + 16 + 2 * lane];
+    }
+}
+
+static const unsigned char *
+pm_sim_thresholds(const struct pm_sim_module *module,
+                  enum pm_sim_monitor_id id)
+{
+    if (module->qsfp) {
+        return &module->a0.upper[QSFP_THRESHOLDS_PAGE]
+                                [pm_sim_monitors[id].qsfp_threshold];
+    }
+    return &module->a2.lower[SFP_A2_THRESHOLDS +
+                             pm_sim_monitors[id].sfp_threshold];
+}
+
+/*
+ * pm_sim_flags: compare a raw monitor with its thresholds (high alarm, low
+ *               alarm, high warning, low warning)
+ *
+ * output: SFF-8636 flag nibble: high alarm, low alarm, high warning and low
+ *         warning from bit 3 down; 0 if the image has no thresholds
+ */
+static unsigned int
+pm_sim_flags(enum pm_sim_monitor_id id, uint16_t raw,
+             const unsigned char *thresholds)
+{
+    int32_t limit[4];
+    int32_t value;
+    unsigned int flags = 0;
+    bool any = false;
+    int idx;
+
+    for (idx = 0; idx < 4; idx++) {
+        uint16_t bytes = (thresholds[2 * idx] << 8) | thresholds[2 * idx + 1];
+
+        limit[idx] = (PM_SIM_TEMPERATURE == id) ? (int16_t)bytes : bytes;
+        any = any || (0 != bytes);
+    }
+    if (false == any) {
+        return 0;
+    }
+
+    value = (PM_SIM_TEMPERATURE == id) ? (int16_t)raw : raw;
+    if (value > limit[0]) {
+        flags |= 0x8;
+    }
+    if (value < limit[1]) {
+        flags |= 0x4;
+    }
+    if (value > limit[2]) {
+        flags |= 0x2;
+    }
+    if (value < limit[3]) {
+        flags |= 0x1;
+    }
+
+    return flags;
+}
+
+static bool
+pm_sim_tx_disabled(const struct pm_sim_module *module, int lane)
+{
+    if (module->qsfp) {
+        return 0 != (module->a0.lower[QSFP_DISABLE_OFFSET] & (1 << lane));
+    }
+    return module->tx_disable_pin ||
+           0 != (module->a2.lower[SFP_A2_STATUS_CONTROL] & SFP_SOFT_TX_DISABLE);
+}
+
+// write the monitors and their flags into the image
+static void
+pm_sim_sync(struct pm_sim_module *module)
+{
+    uint16_t alarms = 0;
+    uint16_t warnings = 0;
+    int id;
+    int lane;
+
+    if (module->qsfp) {
+        memset(&module->a0.lower[QSFP_FLAGS], 0, QSFP_FLAGS_LEN);
+    }
+
+    for (id = 0; id < PM_SIM_N_MONITORS; id++) {
+        for (lane = 0; lane < pm_sim_lanes(module, id); lane++) {
+            uint16_t raw = pm_sim_raw(id, module->monitors[id][lane].value);
+            unsigned int flags;
+
+            // a disabled transmitter has no bias and no output
+            if ((PM_SIM_TX_BIAS == id || PM_SIM_TX_POWER == id) &&
+                pm_sim_tx_disabled(module, lane)) {
+                raw = 0;
+            }
+
+            pm_sim_put16(pm_sim_monitor_bytes(module, id, lane), raw);
+            flags = pm_sim_flags(id, raw, pm_sim_thresholds(module, id));
+
+            if (module->qsfp) {
+                // two lanes per flag byte, lane 1 in the high nibble
+                module->a0.lower[pm_sim_monitors[id].qsfp_flags + lane / 2] |=
+                    flags << ((lane % 2) ? 0 : 4);
+            } else {
+                // A2h 112-113 and 116-117: two bits per monitor, high first
+                alarms |= ((flags >> 2) & 0x3) << (14 - 2 * id);
+                warnings |= (flags & 0x3) << (14 - 2 * id);
+            }
+        }
+    }
+
+    if (false == module->qsfp) {
+        pm_sim_put16(&module->a2.lower[SFP_A2_ALARMS], alarms);
+        pm_sim_put16(&module->a2.lower[SFP_A2_WARNINGS], warnings);
+        if (pm_sim_tx_disabled(module, 0)) {
+            module->a2.lower[SFP_A2_STATUS_CONTROL] |= SFP_TX_DISABLE_STATE;
+        } else {
+            module->a2.lower[SFP_A2_STATUS_CONTROL] &= ~SFP_TX_DISABLE_STATE;
+        }
+    }
+}
+
+static void
+pm_sim_clamp(struct pm_sim_monitor *monitor, enum pm_sim_monitor_id id)
+{
+    monitor->value = MAX(MIN(monitor->value, pm_sim_monitors[id].max),
+                         pm_sim_monitors[id].min);
+}
+
+// advance the monitors to now: ramps, then random walk steps
+static void
+pm_sim_update(struct pm_sim_module *module)
+{
+    long long int now = time_msec();
+    long long int elapsed = now - module->update_time;
+    int id;
+    int lane;
+
+    module->update_time = now;
+
+    for (id = 0; id < PM_SIM_N_MONITORS; id++) {
+        for (lane = 0; lane < pm_sim_lanes(module, id); lane++) {
+            struct pm_sim_monitor *monitor = &module->monitors[id][lane];
+            double delta = monitor->target - monitor->value;
+
+            if (0 == monitor->rate) {
+                continue;
+            }
+            if (monitor->rate * elapsed >= (delta < 0 ? -delta : delta)) {
+                monitor->value = monitor->target;
+                monitor->rate = 0;
+            } else {
+                monitor->value += (delta < 0 ? -1 : 1) *
+                                  monitor->rate * elapsed;
+            }
+        }
+    }
+
+    if (module->walk) {
+        if (now - module->walk_time > PM_SIM_MAX_WALK * 1000) {
+            module->walk_time = now - PM_SIM_MAX_WALK * 1000;
+        }
+        for (; module->walk_time + 1000 <= now; module->walk_time += 1000) {
+            for (id = 0; id < PM_SIM_N_MONITORS; id++) {
+                for (lane = 0; lane < pm_sim_lanes(module, id); lane++) {
+                    struct pm_sim_monitor *monitor =
+                        &module->monitors[id][lane];
+
+                    if (0 != monitor->rate) {
+                        continue;
+                    }
+                    monitor->value += pm_sim_monitors[id].step *
+                        ((double)random_range(2001) / 1000 - 1);
+                    pm_sim_clamp(monitor, id);
+                }
+            }
+        }
+    }
+
+    pm_sim_sync(module);
+}
+
+static struct pm_sim_module *
+pm_sim_module(const pm_port_t *port)
+{
+    if (NULL == port->sim_module || port->sim_module->reset) {
+        return NULL;
+    }
+    return port->sim_module;
+}
+
+static struct pm_sim_eeprom *
+pm_sim_eeprom(struct pm_sim_module *module, bool a2)
+{
+    if (false == a2) {
+        return &module->a0;
+    }
+    return module->qsfp ? NULL : &module->a2;
+}
+
+static unsigned char *
+pm_sim_byte(struct pm_sim_eeprom *eeprom, size_t offset)
+{
+    unsigned int page = 0;
+
+    if (offset < PM_SIM_PAGE_LEN) {
+        return &eeprom->lower[offset];
+    }
+    if (eeprom->paged) {
+        page = eeprom->lower[PM_SIM_PAGE_SELECT];
+    }
+    if (page >= PM_SIM_UPPER_PAGES) {
+        return NULL;
+    }
+    return &eeprom->upper[page][offset - PM_SIM_PAGE_LEN];
+}
+
+/*
+ * pm_sim_present: the presence signal of a port
+ */
+bool
+pm_sim_present(const pm_port_t *port)
+{
+    return NULL != port->sim_module;
+}
+
+/*
+ * pm_sim_read: read the memory of the module in a port
+ *
+ * input: port structure
+ *        A2h (true) or A0h device
+ *        offset and length, within the 256 byte device
+ *
+ * output: 0, or -1 if nothing answers at that address
+ */
+int
+pm_sim_read(pm_port_t *port, bool a2, size_t offset, size_t len, void *data)
+{
+    struct pm_sim_module *module = pm_sim_module(port);
+    struct pm_sim_eeprom *eeprom;
+    unsigned char *out = data;
+    unsigned char *byte;
+    size_t idx;
+
+    if (NULL == module || NULL == (eeprom = pm_sim_eeprom(module, a2)) ||
+        offset + len > 2 * PM_SIM_PAGE_LEN) {
+        return -1;
+    }
+
+    pm_sim_update(module);
+
+    for (idx = 0; idx < len; idx++) {
+        byte = pm_sim_byte(eeprom, offset + idx);
+        out[idx] = (NULL == byte) ? 0xff : *byte;
+    }
+
+    return 0;
+}
+
+static bool
+pm_sim_writable(const struct pm_sim_module *module, bool a2, size_t offset)
+{
+    const struct pm_sim_range *ranges;
+    size_t n_ranges;
+    size_t idx;
+
+    if (module->qsfp) {
+        ranges = pm_sim_qsfp_writable;
+        n_ranges = ARRAY_SIZE(pm_sim_qsfp_writable);
+    } else if (a2) {
+        ranges = pm_sim_sfp_a2_writable;
+        n_ranges = ARRAY_SIZE(pm_sim_sfp_a2_writable);
+    } else {
+        return false;
+    }
+
+    for (idx = 0; idx < n_ranges; idx++) {
+        if (offset >= ranges[idx].first && offset <= ranges[idx].last) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * pm_sim_write: write the memory of the module in a port; bytes that
+ *               aren't writable keep their value, as on a module
+ *
+ * output: 0, or -1 if nothing answers at that address
+ */
+int
+pm_sim_write(pm_port_t *port, bool a2, size_t offset, size_t len,
+             const void *data)
+{
+    struct pm_sim_module *module = pm_sim_module(port);
+    struct pm_sim_eeprom *eeprom;
+    const unsigned char *in = data;
+    unsigned char *byte;
+    size_t idx;
+
+    if (NULL == module || NULL == (eeprom = pm_sim_eeprom(module, a2)) ||
+        offset + len > 2 * PM_SIM_PAGE_LEN) {
+        return -1;
+    }
+
+    for (idx = 0; idx < len; idx++) {
+        if (pm_sim_writable(module, a2, offset + idx)) {
+            byte = pm_sim_byte(eeprom, offset + idx);
+            if (NULL != byte) {
+                *byte = in[idx];
+            }
+        }
+    }
+
+    // TX disable changes show in the monitors right away
+    pm_sim_update(module);
+
+    return 0;
+}
+
+/*
+ * pm_sim_signal: a write to the port's only writable signal, TX_DISABLE on
+ *                SFP+ ports and reset on QSFP ports
+ */
+void
+pm_sim_signal(pm_port_t *port, uint32_t data)
+{
+    struct pm_sim_module *module = port->sim_module;
+
+    if (NULL == module) {
+        return;
+    }
+
+    if (false == module->qsfp) {
+        module->tx_disable_pin = (0 != data);
+        pm_sim_update(module);
+        return;
+    }
+
+    // leaving reset clears the volatile controls
+    if (module->reset && 0 == data) {
+        memset(&module->a0.lower[QSFP_DISABLE_OFFSET], 0,
+               100 - QSFP_DISABLE_OFFSET);
+        module->a0.lower[PM_SIM_PAGE_SELECT] = 0;
+    }
+    module->reset = (0 != data);
+}
+
+// start the monitors from the image, or from typical values if it has none
+static void
+pm_sim_init_monitors(struct pm_sim_module *module)
+{
+    bool loaded = false;
+    int id;
+    int lane;
+
+    for (id = 0; id < PM_SIM_N_MONITORS; id++) {
+        for (lane = 0; lane < pm_sim_lanes(module, id); lane++) {
+            const unsigned char *bytes =
+                pm_sim_monitor_bytes(module, id, lane);
+
+            loaded = loaded || bytes[0] || bytes[1];
+        }
+    }
+
+    for (id = 0; id < PM_SIM_N_MONITORS; id++) {
+        for (lane = 0; lane < PM_DOM_MAX_LANES; lane++) {
+            struct pm_sim_monitor *monitor = &module->monitors[id][lane];
+
+            if (loaded && lane < pm_sim_lanes(module, id)) {
+                monitor->value =
+                    pm_sim_value(id, pm_sim_monitor_bytes(module, id, lane));
+            } else {
+                monitor->value = pm_sim_monitors[id].initial;
+            }
+            monitor->target = monitor->value;
+            monitor->rate = 0;
+        }
+    }
+}
+
+/*
+ * pm_sim_load: lay an image file out in the module memory
+ *
+ * A 128 byte image is a serial ID page. Longer ones are whole pages: for
+ * SFP+, A0h (256 bytes) then the A2h lower page and its upper pages; for
+ * QSFP, the lower page then upper pages 00h to 03h.
+ */
+static int
+pm_sim_load(struct pm_sim_module *module, const unsigned char *image,
+            size_t len, struct ds *ds)
+{
+    unsigned char *pages[2 * (1 + PM_SIM_UPPER_PAGES)];
+    size_t n_pages = 0;
+    size_t idx;
+
+    if (sizeof(pm_sfp_serial_id_t) == len) {
+        if (module->qsfp) {
+            memcpy(module->a0.upper[0], image, len);
+            module->a0.lower[0] = image[0];
+        } else {
+            memcpy(module->a0.lower, image, len);
+        }
+        return 0;
+    }
+
+    pages[n_pages++] = module->a0.lower;
+    if (module->qsfp) {
+        for (idx = 0; idx < PM_SIM_UPPER_PAGES; idx++) {
+            pages[n_pages++] = module->a0.upper[idx];
+        }
+    } else {
+        pages[n_pages++] = module->a0.upper[0];
+        pages[n_pages++] = module->a2.lower;
+        for (idx = 0; idx < PM_SIM_UPPER_PAGES; idx++) {
+            pages[n_pages++] = module->a2.upper[idx];
+        }
+    }
+
+    if (0 != len % PM_SIM_PAGE_LEN || len / PM_SIM_PAGE_LEN > n_pages) {
+        ds_put_format(ds, "Image of %"PRIuSIZE" bytes: expected %"PRIuSIZE
+                      " bytes or whole pages, up to %"PRIuSIZE" bytes",
+                      len, sizeof(pm_sfp_serial_id_t),
+                      n_pages * PM_SIM_PAGE_LEN);
+        return -1;
+    }
+
+    for (idx = 0; idx < len / PM_SIM_PAGE_LEN; idx++) {
+        memcpy(pages[idx], image + idx * PM_SIM_PAGE_LEN, PM_SIM_PAGE_LEN);
+    }
+
+    return 0;
+}
+
+static pm_port_t *
+pm_sim_port(const char *name, struct ds *ds)
+{
+    pm_port_t *port = shash_find_data(&ovs_intfs, name);
+
+    if (NULL == port) {
+        ds_put_cstr(ds, "No such interface");
+    }
+    return port;
+}
+
+int
+pmd_sim_insert(const char *name, const char *file, struct ds *ds)
+{
+    unsigned char image[2 * (1 + PM_SIM_UPPER_PAGES) * PM_SIM_PAGE_LEN + 1];
+    struct pm_sim_module *module;
+    pm_port_t *port;
+    size_t len;
+    FILE *fp;
+
+    port = pm_sim_port(name, ds);
+    if (NULL == port) {
+        return -1;
+    }
+
+    fp = fopen(file, "r");
+
+    if (NULL == fp) {
+        ds_put_cstr(ds, "Can't open file");
+        return -1;
+    }
+
+    len = fread(image, 1, sizeof(image), fp);
+    fclose(fp);
+
+    if (0 == len) {
+        ds_put_cstr(ds, "Unable to read data");
+        return -1;
+    }
+
+    module = xzalloc(sizeof(*module));
+    module->qsfp =
+        (0 == strcmp(port->module_device->connector, CONNECTOR_QSFP_PLUS)) ||
+        (0 == strcmp(port->module_device->connector, CONNECTOR_QSFP28));
+    module->a0.paged = module->qsfp;
+    module->a2.paged = true;
+
+    if (0 != pm_sim_load(module, image, len, ds)) {
+        free(module);
+        return -1;
+    }
+
+    pm_sim_init_monitors(module);
+    module->update_time = module->walk_time = time_msec();
+    pm_sim_sync(module);
+
+    free(port->sim_module);
+    port->sim_module = module;
+
+    ds_put_cstr(ds, "Pluggable module inserted");
+
+    return 0;
+}
+
+int
+pmd_sim_remove(const char *name, struct ds *ds)
+{
+    pm_port_t *port;
+
+    port = pm_sim_port(name, ds);
+    if (NULL == port) {
+        return -1;
+    }
+
+    if (NULL == port->sim_module) {
+        ds_put_cstr(ds, "Pluggable module not present");
+        return -1;
+    }
+
+    free(port->sim_module);
+    port->sim_module = NULL;
+
+    ds_put_cstr(ds, "Pluggable module removed");
+    return 0;
+}
+
+static void
+pm_sim_dom_show(struct ds *ds, struct pm_sim_module *module)
+{
+    int id;
+    int lane;
+
+    pm_sim_update(module);
+
+    ds_put_format(ds, "random walk: %s\n", module->walk ? "on" : "off");
+    for (id = 0; id < PM_SIM_N_MONITORS; id++) {
+        for (lane = 0; lane < pm_sim_lanes(module, id); lane++) {
+            const struct pm_sim_monitor *monitor = &module->monitors[id][lane];
+
+            if (pm_sim_monitors[id].lanes && module->qsfp) {
+                ds_put_format(ds, "%s%d", pm_sim_monitors[id].name, lane + 1);
+            } else {
+                ds_put_cstr(ds, pm_sim_monitors[id].name);
+            }
+            ds_put_format(ds, ": %.4f %s", monitor->value,
+                          pm_sim_monitors[id].unit);
+            if (0 != monitor->rate) {
+                ds_put_format(ds, " (to %.4f)", monitor->target);
+            }
+            if ((PM_SIM_TX_BIAS == id || PM_SIM_TX_POWER == id) &&
+                pm_sim_tx_disabled(module, lane)) {
+                ds_put_cstr(ds, " (tx disabled)");
+            }
+            ds_put_char(ds, '\n');
+        }
+    }
+}
+
+// name[lane]=value: find the monitor and the lane (-1 for all of them)
+static bool
+pm_sim_dom_parse(const struct pm_sim_module *module, const char *setting,
+                 int *id, int *lane, double *value)
+{
+    const char *equal = strchr(setting, '=');
+    size_t len;
+
+    if (NULL == equal || false == str_to_double(equal + 1, value)) {
+        return false;
+    }
+
+    for (*id = 0; *id < PM_SIM_N_MONITORS; (*id)++) {
+        len = strlen(pm_sim_monitors[*id].name);
+        if (strncmp(setting, pm_sim_monitors[*id].name, len)) {
+            continue;
+        }
+        if (setting + len == equal) {
+            *lane = -1;
+        } else if (setting + len + 1 == equal &&
+                   setting[len] >= '1' &&
+                   setting[len] - '1' < pm_sim_lanes(module, *id)) {
+            *lane = setting[len] - '1';
+        } else {
+            continue;
+        }
+        return *value >= pm_sim_monitors[*id].min &&
+               *value <= pm_sim_monitors[*id].max;
+    }
+
+    return false;
+}
+
+/*
+ * pm_sim_dom_command: ops-pmd/sim <interface> dom [walk=on|off]
+ *                     [ramp=<secs>] [<monitor>[<lane>]=<value>...]
+ *
+ * output: 0, or -1 (with a message in ds) on a usage error
+ *
+ * Values are in C, V, mA and mW. Without ramp they apply at once; with it
+ * the monitors move there in a straight line over that many seconds.
+ */
+int
+pm_sim_dom_command(const char *name, int argc, const char *argv[],
+                   struct ds *ds)
+{
+    struct pm_sim_module *module;
+    unsigned int ramp = 0;
+    pm_port_t *port;
+    double value;
+    int each;
+    int lane;
+    int idx;
+    int id;
+
+    port = pm_sim_port(name, ds);
+    if (NULL == port) {
+        return -1;
+    }
+    module = port->sim_module;
+    if (NULL == module) {
+        ds_put_cstr(ds, "Pluggable module not present");
+        return -1;
+    }
+
+    // validate everything before changing anything
+    for (idx = 0; idx < argc; idx++) {
+        if (0 == strcmp(argv[idx], "walk=on") ||
+            0 == strcmp(argv[idx], "walk=off")) {
+            continue;
+        }
+        if (0 == strncmp(argv[idx], "ramp=", 5)) {
+            if (false == str_to_uint(argv[idx] + 5, 10, &ramp)) {
+                ds_put_format(ds, "Invalid ramp \"%s\"", argv[idx]);
+                return -1;
+            }
+            continue;
+        }
+        if (false == pm_sim_dom_parse(module, argv[idx], &id, &lane,
+                                      &value)) {
+            ds_put_format(ds, "Invalid setting \"%s\": expected walk=on|off, "
+                          "ramp=<secs> or temperature=, vcc=, tx-bias[N]=, "
+                          "tx-power[N]=, rx-power[N]= in range", argv[idx]);
+            return -1;
+        }
+    }
+
+    pm_sim_update(module);
+
+    for (idx = 0; idx < argc; idx++) {
+        if (0 == strncmp(argv[idx], "walk=", 5)) {
+            module->walk = (0 == strcmp(argv[idx], "walk=on"));
+            module->walk_time = time_msec();
+            continue;
+        }
+        if (0 == strncmp(argv[idx], "ramp=", 5)) {
+            continue;
+        }
+
+        pm_sim_dom_parse(module, argv[idx], &id, &lane, &value);
+        for (each = 0; each < pm_sim_lanes(module, id); each++) {
+            struct pm_sim_monitor *monitor = &module->monitors[id][each];
+            double delta = value - monitor->value;
+
+            if (lane >= 0 && lane != each) {
+                continue;
+            }
+            monitor->target = value;
+            if (0 == ramp || 0 == delta) {
+                monitor->value = value;
+                monitor->rate = 0;
+            } else {
+                monitor->rate = (delta < 0 ? -delta : delta) / (ramp * 1000.0);
+            }
+        }
+    }
+
+    pm_sim_sync(module);
+    pm_sim_dom_show(ds, module);
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,405 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for the simulated I2C bus (PLATFORM_SIMULATION only).
+ *
+ * pm_i2c.c hands every operation to this file instead of config-yaml. Each
+ * bus has an operation latency, a per-byte cost, jitter, NAK, timeout and
+ * corruption rates and a stuck mode, set with "ops-pmd/sim bus". Operations
+ * block for the modelled time, like a real bus does, so the retry, timing
+ * and scheduling code runs unchanged against it.
+ *
+ * Behind the bus is the simulated module of the port (pm_sim.c): register
+ * reads are its presence signal, register writes its TX_DISABLE or reset
+ * signal, and data operations go to its A0h or A2h memory. Where nothing
+ * answers, the operation NAKs.
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <random.h>
+#include <shash.h>
+#include <util.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+
+#ifdef PLATFORM_SIMULATION
+
+VLOG_DEFINE_THIS_MODULE(pm_sim_bus);
+
+struct pm_sim_bus {
+    // model
+    unsigned int latency;       // usecs per operation
+    unsigned int byte_latency;  // usecs per byte transferred
+    unsigned int jitter;        // up to this many usecs added per operation
+    unsigned int timeout;       // usecs a timed out operation takes
+    double  nak_rate;           // percent of operations NAKed
+    double  timeout_rate;       // percent of operations timed out
+    double  corrupt_rate;       // percent of reads with a flipped bit
+    bool    stuck;              // every operation times out
+
+    // injected so far
+    uint64_t ops;
+    uint64_t naks;
+    uint64_t timeouts;
+    uint64_t corruptions;
+};
+
+// model for buses not configured on their own ("*"); an ideal bus
+static struct pm_sim_bus pm_sim_bus_default = {
+    .timeout = 25000,
+};
+
+// bus name -> struct pm_sim_bus
+static struct shash pm_sim_buses = SHASH_INITIALIZER(&pm_sim_buses);
+
+static struct pm_sim_bus *
+pm_sim_bus_get(const char *name)
+{
+    struct pm_sim_bus *bus;
+
+    if (NULL == name) {
+        name = "unknown";
+    }
+
+    bus = shash_find_data(&pm_sim_buses, name);
+    if (NULL == bus) {
+        bus = xmemdup(&pm_sim_bus_default, sizeof(*bus));
+        bus->ops = bus->naks = bus->timeouts = bus->corruptions = 0;
+        shash_add(&pm_sim_buses, name, bus);
+    }
+
+    return bus;
+}
+
+static bool
+pm_sim_bus_draw(double percent)
+{
+    return percent > 0 && random_uint32() < percent / 100 * UINT32_MAX;
+}
+
+static void
+pm_sim_bus_delay(unsigned int usecs)
+{
+    struct timespec req;
+
+    if (0 == usecs) {
+        return;
+    }
+
+    req.tv_sec = usecs / 1000000;
+    req.tv_nsec = (usecs % 1000000) * 1000;
+    while (0 != nanosleep(&req, &req)) {
+        // interrupted; sleep for the rest
+    }
+}
+
+/*
+ * pm_sim_bus_xfer: run one operation of len bytes on the bus
+ *
+ * output: 0, or -1 if the operation was NAKed or timed out
+ */
+static int
+pm_sim_bus_xfer(struct pm_sim_bus *bus, size_t len)
+{
+    unsigned int usecs;
+
+    bus->ops++;
+
+    usecs = bus->latency;
+    if (0 != bus->jitter) {
+        usecs += random_range(bus->jitter + 1);
+    }
+
+    if (bus->stuck || pm_sim_bus_draw(bus->timeout_rate)) {
+        bus->timeouts++;
+        pm_sim_bus_delay(bus->timeout);
+        return -1;
+    }
+
+    // a NAK ends the operation after the address byte
+    if (pm_sim_bus_draw(bus->nak_rate)) {
+        bus->naks++;
+        pm_sim_bus_delay(usecs);
+        return -1;
+    }
+
+    pm_sim_bus_delay(usecs + bus->byte_latency * len);
+
+    return 0;
+}
+
+static void
+pm_sim_bus_corrupt(struct pm_sim_bus *bus, unsigned char *data, size_t len)
+{
+    if (0 != len && pm_sim_bus_draw(bus->corrupt_rate)) {
+        bus->corruptions++;
+        data[random_range(len)] ^= 1 << random_range(8);
+    }
+}
+
+int
+pm_sim_bus_reg_read(pm_port_t *port, const char *bus_name,
+                    const i2c_bit_op *reg_op OVS_UNUSED, uint32_t *result)
+{
+    struct pm_sim_bus *bus = pm_sim_bus_get(bus_name);
+
+    if (0 != pm_sim_bus_xfer(bus, sizeof(*result))) {
+        return -1;
+    }
+
+    // the presence signal is the only register the daemon reads
+    *result = pm_sim_present(port) ? 1 : 0;
+
+    return 0;
+}
+
+int
+pm_sim_bus_reg_write(pm_port_t *port, const char *bus_name,
+                     const i2c_bit_op *reg_op OVS_UNUSED, uint32_t data)
+{
+    if (0 != pm_sim_bus_xfer(pm_sim_bus_get(bus_name), sizeof(data))) {
+        return -1;
+    }
+
+    pm_sim_signal(port, data);
+
+    return 0;
+}
+
+// the SFP+ A2h device is the one at its own address; the rest is A0h
+static bool
+pm_sim_bus_a2(const YamlDevice *device)
+{
+    return NULL != device && PM_SFP_A2_I2C_ADDRESS == device->address;
+}
+
+int
+pm_sim_bus_data_read(pm_port_t *port, const char *bus_name,
+                     const YamlDevice *device, size_t offset, size_t len,
+                     void *data)
+{
+    struct pm_sim_bus *bus = pm_sim_bus_get(bus_name);
+
+    if (0 != pm_sim_bus_xfer(bus, len)) {
+        return -1;
+    }
+
+    if (0 != pm_sim_read(port, pm_sim_bus_a2(device), offset, len, data)) {
+        bus->naks++;
+        return -1;
+    }
+
+    pm_sim_bus_corrupt(bus, data, len);
+
+    return 0;
+}
+
+int
+pm_sim_bus_data_write(pm_port_t *port, const char *bus_name,
+                      const YamlDevice *device, size_t offset, size_t len,
+                      void *data)
+{
+    struct pm_sim_bus *bus = pm_sim_bus_get(bus_name);
+
+    if (0 != pm_sim_bus_xfer(bus, len)) {
+        return -1;
+    }
+
+    if (0 != pm_sim_write(port, pm_sim_bus_a2(device), offset, len, data)) {
+        bus->naks++;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+pm_sim_bus_show(struct ds *ds, const char *name, const struct pm_sim_bus *bus)
+{
+    ds_put_format(ds, "%-20s %8u %6u %7u %8u %6.2f %6.2f %6.2f %-5s "
+                  "%10llu %8llu %8llu %8llu\n",
+                  name, bus->latency, bus->byte_latency, bus->jitter,
+                  bus->timeout, bus->nak_rate, bus->timeout_rate,
+                  bus->corrupt_rate, bus->stuck ? "yes" : "no",
+                  (unsigned long long)bus->ops,
+                  (unsigned long long)bus->naks,
+                  (unsigned long long)bus->timeouts,
+                  (unsigned long long)bus->corruptions);
+}
+
+static void
+pm_sim_bus_dump(struct ds *ds, const char *name)
+{
+    const struct shash_node **nodes;
+    size_t idx;
+
+    ds_put_format(ds, "%-20s %8s %6s %7s %8s %6s %6s %6s %-5s "
+                  "%10s %8s %8s %8s\n",
+                  "bus", "latency", "byte", "jitter", "timeout", "nak%",
+                  "tmo%", "crpt%", "stuck", "ops", "naks", "timeouts",
+                  "corrupt");
+
+    if (NULL == name || 0 == strcmp(name, "*")) {
+        pm_sim_bus_show(ds, "*", &pm_sim_bus_default);
+    }
+
+    nodes = shash_sort(&pm_sim_buses);
+    for (idx = 0; idx < shash_count(&pm_sim_buses); idx++) {
+        if (NULL == name || 0 == strcmp(name, nodes[idx]->name)) {
+            pm_sim_bus_show(ds, nodes[idx]->name, nodes[idx]->data);
+        }
+    }
+    free(nodes);
+}
+
+static bool
+pm_sim_bus_percent(const char *value, double *percent)
+{
+    return str_to_double(value, percent) && *percent >= 0 && *percent <= 100;
+}
+
+// apply one key=value setting to a bus model
+static bool
+pm_sim_bus_set(struct pm_sim_bus *bus, const char *key, const char *value)
+{
+    if (0 == strcmp(key, "latency")) {
+        return str_to_uint(value, 10, &bus->latency);
+    } else if (0 == strcmp(key, "byte")) {
+        return str_to_uint(value, 10, &bus->byte_latency);
+    } else if (0 == strcmp(key, "jitter")) {
+        return str_to_uint(value, 10, &bus->jitter);
+    } else if (0 == strcmp(key, "timeout")) {
+        return str_to_uint(value, 10, &bus->timeout);
+    } else if (0 == strcmp(key, "nak")) {
+        return pm_sim_bus_percent(value, &bus->nak_rate);
+    } else if (0 == strcmp(key, "timeout-rate")) {
+        return pm_sim_bus_percent(value, &bus->timeout_rate);
+    } else if (0 == strcmp(key, "corrupt")) {
+        return pm_sim_bus_percent(value, &bus->corrupt_rate);
+    } else if (0 == strcmp(key, "stuck")) {
+        if (0 == strcmp(value, "on")) {
+            bus->stuck = true;
+        } else if (0 == strcmp(value, "off")) {
+            bus->stuck = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * pm_sim_bus_command: ops-pmd/sim bus [name [reset | key=value...]]
+ *
+ * input: arguments after "bus"
+ *
+ * output: 0, or -1 (with a message in ds) on a usage error
+ *
+ * Bus "*" is the model for buses without one of their own; setting it
+ * also sets every bus seen so far.
+ */
+int
+pm_sim_bus_command(int argc, const char *argv[], struct ds *ds)
+{
+    struct shash_node *node;
+    struct pm_sim_bus bus;
+    const char *name;
+    int idx;
+
+    if (0 == argc) {
+        pm_sim_bus_dump(ds, NULL);
+        return 0;
+    }
+
+    name = argv[0];
+
+    if (1 == argc) {
+        pm_sim_bus_dump(ds, name);
+        return 0;
+    }
+
+    if (2 == argc && 0 == strcmp(argv[1], "reset")) {
+        SHASH_FOR_EACH (node, &pm_sim_buses) {
+            struct pm_sim_bus *stats = node->data;
+
+            if (0 == strcmp(name, "*") || 0 == strcmp(name, node->name)) {
+                stats->ops = stats->naks = 0;
+                stats->timeouts = stats->corruptions = 0;
+            }
+        }
+        return 0;
+    }
+
+    // validate everything before changing anything
+    bus = strcmp(name, "*") ? *pm_sim_bus_get(name) : pm_sim_bus_default;
+    for (idx = 1; idx < argc; idx++) {
+        char *key = xstrdup(argv[idx]);
+        char *value = strchr(key, '=');
+        bool ok;
+
+        ok = (NULL != value);
+        if (ok) {
+            *value++ = '\0';
+            ok = pm_sim_bus_set(&bus, key, value);
+        }
+        free(key);
+
+        if (false == ok) {
+            ds_put_format(ds, "Invalid setting \"%s\": expected latency=, "
+                          "byte=, jitter=, timeout= (usecs), nak=, "
+                          "timeout-rate=, corrupt= (percent) or "
+                          "stuck=on|off", argv[idx]);
+            return -1;
+        }
+    }
+
+    if (0 == strcmp(name, "*")) {
+        pm_sim_bus_default = bus;
+        SHASH_FOR_EACH (node, &pm_sim_buses) {
+            struct pm_sim_bus *other = node->data;
+
+            bus.ops = other->ops;
+            bus.naks = other->naks;
+            bus.timeouts = other->timeouts;
+            bus.corruptions = other->corruptions;
+            *other = bus;
+        }
+    } else {
+        *pm_sim_bus_get(name) = bus;
+    }
+
+    VLOG_INFO("simulated bus %s: latency %u+%u/byte (+%u) usecs, nak %.2f%%, "
+              "timeout %.2f%% (%u usecs), corrupt %.2f%%%s", name,
+              bus.latency, bus.byte_latency, bus.jitter, bus.nak_rate,
+              bus.timeout_rate, bus.timeout, bus.corrupt_rate,
+              bus.stuck ? ", stuck" : "");
+
+    pm_sim_bus_dump(ds, name);
+
+    return 0;
+}
+
+#endif
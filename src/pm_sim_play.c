@@ -0,0 +1,687 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for simulator scenario playback (PLATFORM_SIMULATION only).
+ *
+ * "ops-pmd/sim play <file> [seed]" reads a scenario, expands it into a
+ * list of timed events and runs them from the main loop, each when it is
+ * due. A scenario is a list of lines:
+ *
+ *      # comment
+ *      seed <n>
+ *      [+]<msecs>[~<jitter>] [<percent>%] <interfaces> <action>
+ *      [+]<msecs>[~<jitter>] [<percent>%] bus <name> <key>=<value>...
+ *      repeat <count> [every <msecs>]
+ *          ...
+ *      end
+ *
+ * Times are from the start of the enclosing block, or with '+' from the
+ * previous line. Interfaces are a comma separated list of names and
+ * numeric ranges (1..48), one event each. Actions are those of
+ * "ops-pmd/sim <interface>": insert <file>, remove and dom <setting>....
+ * A repeated block starts every <msecs>, by default right after the
+ * previous pass. Jitter adds up to that many msecs to each event and a
+ * percentage is the chance that each event happens at all; both are drawn
+ * from the seed (default 1), which also seeds the simulated bus faults, so
+ * a scenario with the same seed plays the same way every time.
+ *
+ * A scenario is refused if it expands to more than PM_SIM_PLAY_MAX_EVENTS
+ * events, or if its repeats read more than PM_SIM_PLAY_MAX_LINES lines
+ * over all their passes.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random.h>
+#include <shash.h>
+#include <timeval.h>
+#include <util.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+
+#ifdef PLATFORM_SIMULATION
+
+VLOG_DEFINE_THIS_MODULE(pm_sim_play);
+
+extern struct shash ovs_intfs;
+
+#define PM_SIM_PLAY_MAX_EVENTS  1000000
+#define PM_SIM_PLAY_MAX_LINES   4000000     // lines read, over all passes
+#define PM_SIM_PLAY_MAX_DEPTH   8
+#define PM_SIM_PLAY_MAX_ARGS    16
+
+struct pm_sim_event {
+    long long int at;           // msecs from the start of the scenario
+    size_t  seq;                // expansion order, for events at the same time
+    char    *interface;         // NULL for bus events
+    int     argc;
+    char    **argv;             // action and its arguments
+};
+
+struct pm_sim_scenario {
+    char    *file;
+    uint32_t seed;
+    struct pm_sim_event *events;
+    size_t  n_events;
+    size_t  allocated;
+    size_t  next;               // next event to run
+    long long int start;        // time_msec() of the start
+    long long int max_late;     // worst lateness of an event, msecs
+    uint64_t failed;            // events whose command failed
+    uint64_t skipped;           // events dropped by their percentage
+};
+
+// parser state, for one scenario file
+struct pm_sim_parser {
+    char    **lines;
+    size_t  n_lines;
+    uint32_t rng;               // xorshift32 state, from the seed
+    size_t  expanded;           // lines read so far, counting each pass
+    struct pm_sim_scenario *scenario;
+    struct ds *error;
+};
+
+// the scenario being played, NULL if none
+static struct pm_sim_scenario *pm_sim_playing = NULL;
+
+static uint32_t
+pm_sim_play_random(struct pm_sim_parser *parser)
+{
+    uint32_t x = parser->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    parser->rng = x;
+
+    return x;
+}
+
+// drop the events from n_events on
+static void
+pm_sim_play_truncate(struct pm_sim_scenario *scenario, size_t n_events)
+{
+    size_t idx;
+    int arg;
+
+    for (idx = n_events; idx < scenario->n_events; idx++) {
+        struct pm_sim_event *event = &scenario->events[idx];
+
+        free(event->interface);
+        for (arg = 0; arg < event->argc; arg++) {
+            free(event->argv[arg]);
+        }
+        free(event->argv);
+    }
+    scenario->n_events = MIN(scenario->n_events, n_events);
+}
+
+static void
+pm_sim_play_free(struct pm_sim_scenario *scenario)
+{
+    if (NULL == scenario) {
+        return;
+    }
+
+    pm_sim_play_truncate(scenario, 0);
+    free(scenario->events);
+    free(scenario->file);
+    free(scenario);
+}
+
+static bool
+pm_sim_play_add(struct pm_sim_parser *parser, long long int at,
+                const char *interface, int argc, char *argv[])
+{
+    struct pm_sim_scenario *scenario = parser->scenario;
+    struct pm_sim_event *event;
+    int arg;
+
+    if (scenario->n_events >= PM_SIM_PLAY_MAX_EVENTS) {
+        ds_put_format(parser->error, "more than %d events",
+                      PM_SIM_PLAY_MAX_EVENTS);
+        return false;
+    }
+
+    if (scenario->n_events >= scenario->allocated) {
+        scenario->events = x2nrealloc(scenario->events, &scenario->allocated,
+                                      sizeof(*scenario->events));
+    }
+
+    event = &scenario->events[scenario->n_events];
+    event->at = at;
+    event->seq = scenario->n_events++;
+    event->interface = (NULL == interface) ? NULL : xstrdup(interface);
+    event->argc = argc;
+    event->argv = xmalloc(argc * sizeof(*event->argv));
+    for (arg = 0; arg < argc; arg++) {
+        event->argv[arg] = xstrdup(argv[arg]);
+    }
+
+    return true;
+}
+
+/*
+ * pm_sim_play_draw: the random part of one event
+ *
+ * output: whether the event happens, and when
+ *
+ * Both draws are made for every event, so that changing the jitter or the
+ * percentage of a line doesn't shift the draws of the lines after it.
+ */
+static bool
+pm_sim_play_draw(struct pm_sim_parser *parser, long long int at,
+                 unsigned int jitter, unsigned int percent,
+                 long long int *when)
+{
+    uint32_t delay = pm_sim_play_random(parser);
+
+    *when = at + (jitter ? delay % (jitter + 1) : 0);
+    if (pm_sim_play_random(parser) % 100 >= percent) {
+        parser->scenario->skipped++;
+        return false;
+    }
+    return true;
+}
+
+static bool
+pm_sim_play_msecs(const char *text, long long int *msecs)
+{
+    return str_to_llong(text, 10, msecs) && *msecs >= 0;
+}
+
+// <interfaces>: expand one list item into events
+static bool
+pm_sim_play_item(struct pm_sim_parser *parser, const char *item,
+                 long long int at, unsigned int jitter, unsigned int percent,
+                 int argc, char *argv[])
+{
+    const char *dots = strstr(item, "..");
+    char name[32];
+    int first;
+    int last;
+    int idx;
+
+    if (NULL == dots) {
+        first = last = 0;
+    } else {
+        char *lower = xmemdup0(item, dots - item);
+        bool ok = str_to_int(lower, 10, &first) &&
+                  str_to_int(dots + 2, 10, &last) && first <= last;
+
+        free(lower);
+        if (false == ok) {
+            ds_put_format(parser->error, "bad interface range %s", item);
+            return false;
+        }
+    }
+
+    for (idx = first; idx <= last; idx++) {
+        const char *interface = item;
+        long long int when;
+
+        if (NULL != dots) {
+            snprintf(name, sizeof(name), "%d", idx);
+            interface = name;
+        }
+        if (NULL == shash_find(&ovs_intfs, interface)) {
+            ds_put_format(parser->error, "no pluggable interface %s",
+                          interface);
+            return false;
+        }
+
+        if (false == pm_sim_play_draw(parser, at, jitter, percent, &when)) {
+            continue;
+        }
+        if (false == pm_sim_play_add(parser, when, interface, argc, argv)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * pm_sim_play_event: one timed line
+ *
+ * input: tokens of the line
+ *        time of the previous line, updated
+ *        start of the enclosing block
+ */
+static bool
+pm_sim_play_event(struct pm_sim_parser *parser, int argc, char *argv[],
+                  long long int *last, long long int base)
+{
+    char *time = argv[0];
+    char *tilde = strchr(time, '~');
+    unsigned int jitter = 0;
+    unsigned int percent = 100;
+    long long int msecs;
+    char *save_ptr = NULL;
+    char *item;
+    int arg = 1;
+
+    if (NULL != tilde) {
+        *tilde++ = '\0';
+        if (false == str_to_uint(tilde, 10, &jitter)) {
+            ds_put_format(parser->error, "bad jitter %s", tilde);
+            return false;
+        }
+    }
+    if (false == pm_sim_play_msecs(time + ('+' == time[0]), &msecs)) {
+        ds_put_format(parser->error, "bad time %s", time);
+        return false;
+    }
+    *last = ('+' == time[0]) ? *last + msecs : base + msecs;
+
+    if (arg < argc && '%' == argv[arg][strlen(argv[arg]) - 1]) {
+        argv[arg][strlen(argv[arg]) - 1] = '\0';
+        if (false == str_to_uint(argv[arg], 10, &percent) || percent > 100) {
+            ds_put_format(parser->error, "bad percentage %s%%", argv[arg]);
+            return false;
+        }
+        arg++;
+    }
+
+    if (argc - arg < 2) {
+        ds_put_cstr(parser->error, "expected <interfaces> <action> or "
+                    "bus <name> <settings>");
+        return false;
+    }
+
+    if (0 == strcmp(argv[arg], "bus")) {
+        long long int when;
+
+        if (false == pm_sim_play_draw(parser, *last, jitter, percent, &when)) {
+            return true;
+        }
+        return pm_sim_play_add(parser, when, NULL, argc - arg - 1,
+                               argv + arg + 1);
+    }
+
+    if (!((0 == strcmp(argv[arg + 1], "insert") && argc - arg == 3) ||
+          (0 == strcmp(argv[arg + 1], "remove") && argc - arg == 2) ||
+          (0 == strcmp(argv[arg + 1], "dom")))) {
+        ds_put_format(parser->error, "bad action %s: expected insert <file>, "
+                      "remove or dom <settings>", argv[arg + 1]);
+        return false;
+    }
+
+    for (item = strtok_r(argv[arg], ",", &save_ptr); NULL != item;
+         item = strtok_r(NULL, ",", &save_ptr)) {
+        if (false == pm_sim_play_item(parser, item, *last, jitter, percent,
+                                      argc - arg - 1, argv + arg + 1)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * pm_sim_play_block: expand lines up to the "end" of the block (or the end
+ *                    of the file at depth 0)
+ *
+ * input: index of the first line, updated past the block
+ *        start of the block
+ *
+ * output: time of the last line of the block, or -1 on an error
+ */
+static long long int
+pm_sim_play_block(struct pm_sim_parser *parser, size_t *line,
+                  long long int base, int depth)
+{
+    long long int last = base;
+
+    while (*line < parser->n_lines) {
+        char *text = xstrdup(parser->lines[(*line)++]);
+        char *argv[PM_SIM_PLAY_MAX_ARGS];
+        char *save_ptr = NULL;
+        char *comment;
+        char *token;
+        int argc = 0;
+        bool ok = true;
+
+        // every pass of a repeat reads at least its "end", so this also
+        // bounds repeats that add few or no events
+        if (++parser->expanded > PM_SIM_PLAY_MAX_LINES) {
+            ds_put_format(parser->error, "repeats expand to more than %d "
+                          "lines", PM_SIM_PLAY_MAX_LINES);
+            free(text);
+            return -1;
+        }
+
+        comment = strchr(text, '#');
+        if (NULL != comment) {
+            *comment = '\0';
+        }
+        for (token = strtok_r(text, " \t\r\n", &save_ptr); NULL != token;
+             token = strtok_r(NULL, " \t\r\n", &save_ptr)) {
+            if (argc == PM_SIM_PLAY_MAX_ARGS) {
+                ds_put_cstr(parser->error, "too many words");
+                ok = false;
+                break;
+            }
+            argv[argc++] = token;
+        }
+
+        if (false == ok || 0 == argc) {
+            free(text);
+            if (false == ok) {
+                return -1;
+            }
+            continue;
+        }
+
+        if (0 == strcmp(argv[0], "end")) {
+            free(text);
+            if (0 == depth) {
+                ds_put_cstr(parser->error, "end without repeat");
+                return -1;
+            }
+            return last;
+        } else if (0 == strcmp(argv[0], "seed")) {
+            // handled before the expansion
+        } else if (0 == strcmp(argv[0], "repeat")) {
+            long long int every = -1;
+            unsigned int count;
+            unsigned int pass;
+            size_t body = *line;
+            size_t n_events = parser->scenario->n_events;
+
+            if (!((2 == argc || (4 == argc && 0 == strcmp(argv[2], "every") &&
+                                 pm_sim_play_msecs(argv[3], &every))) &&
+                  str_to_uint(argv[1], 10, &count))) {
+                ds_put_cstr(parser->error,
+                            "expected repeat <count> [every <msecs>]");
+                ok = false;
+            } else if (depth + 1 >= PM_SIM_PLAY_MAX_DEPTH) {
+                ds_put_cstr(parser->error, "repeats nested too deep");
+                ok = false;
+            }
+
+            for (pass = 0; ok && pass < MAX(count, 1); pass++) {
+                long long int end;
+
+                *line = body;
+                end = pm_sim_play_block(parser, line, last, depth + 1);
+                if (end < 0) {
+                    ok = false;
+                    break;
+                }
+                // a count of 0 skips the block, which is still parsed
+                if (0 == count) {
+                    pm_sim_play_truncate(parser->scenario, n_events);
+                    break;
+                }
+                last = (every >= 0) ? last + every : MAX(end, last + 1);
+            }
+        } else {
+            ok = pm_sim_play_event(parser, argc, argv, &last, base);
+        }
+
+        free(text);
+        if (false == ok) {
+            return -1;
+        }
+    }
+
+    if (0 != depth) {
+        ds_put_cstr(parser->error, "repeat without end");
+        return -1;
+    }
+
+    return last;
+}
+
+static int
+pm_sim_play_compare(const void *a_, const void *b_)
+{
+    const struct pm_sim_event *a = a_;
+    const struct pm_sim_event *b = b_;
+
+    if (a->at != b->at) {
+        return a->at < b->at ? -1 : 1;
+    }
+    return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+// read the lines of a file, and the seed it sets
+static int
+pm_sim_play_read(struct pm_sim_parser *parser, const char *file,
+                 uint32_t *seed, struct ds *ds)
+{
+    size_t allocated = 0;
+    struct ds line = DS_EMPTY_INITIALIZER;
+    FILE *fp;
+
+    fp = fopen(file, "r");
+    if (NULL == fp) {
+        ds_put_format(ds, "Can't open %s: %s", file, ovs_strerror(errno));
+        return -1;
+    }
+
+    while (!ds_get_line(&line, fp)) {
+        unsigned int value;
+
+        if (1 == sscanf(ds_cstr(&line), " seed %u", &value)) {
+            *seed = value;
+        }
+        if (parser->n_lines >= allocated) {
+            parser->lines = x2nrealloc(parser->lines, &allocated,
+                                       sizeof(*parser->lines));
+        }
+        parser->lines[parser->n_lines++] = ds_steal_cstr(&line);
+    }
+    ds_destroy(&line);
+    fclose(fp);
+
+    return 0;
+}
+
+static int
+pm_sim_play_start(const char *file, const char *seed_arg, struct ds *ds)
+{
+    struct pm_sim_parser parser;
+    struct pm_sim_scenario *scenario;
+    uint32_t seed = 1;
+    size_t line = 0;
+    size_t idx;
+    int rc;
+
+    memset(&parser, 0, sizeof(parser));
+    rc = pm_sim_play_read(&parser, file, &seed, ds);
+
+    if (0 == rc && NULL != seed_arg &&
+        false == str_to_uint(seed_arg, 10, &seed)) {
+        ds_put_format(ds, "Invalid seed %s", seed_arg);
+        rc = -1;
+    }
+
+    scenario = xzalloc(sizeof(*scenario));
+    scenario->file = xstrdup(file);
+    scenario->seed = seed;
+
+    if (0 == rc) {
+        parser.scenario = scenario;
+        parser.error = ds;
+        // xorshift has no zero state
+        parser.rng = seed ? seed : 0x9e3779b9;
+
+        if (pm_sim_play_block(&parser, &line, 0, 0) < 0) {
+            ds_put_format(ds, " (%s line %"PRIuSIZE")", file, line);
+            rc = -1;
+        }
+    }
+
+    for (idx = 0; idx < parser.n_lines; idx++) {
+        free(parser.lines[idx]);
+    }
+    free(parser.lines);
+
+    if (0 != rc) {
+        pm_sim_play_free(scenario);
+        return -1;
+    }
+
+    qsort(scenario->events, scenario->n_events, sizeof(*scenario->events),
+          pm_sim_play_compare);
+
+    pm_sim_play_free(pm_sim_playing);
+    pm_sim_playing = scenario;
+    random_set_seed(seed);
+    scenario->start = time_msec();
+
+    VLOG_INFO("playing %s: %"PRIuSIZE" events over %lld msecs, seed %u",
+              file, scenario->n_events,
+              scenario->n_events ?
+              scenario->events[scenario->n_events - 1].at : 0, seed);
+    ds_put_format(ds, "Playing %s: %"PRIuSIZE" events, seed %u", file,
+                  scenario->n_events, seed);
+
+    return 0;
+}
+
+static void
+pm_sim_play_status(struct ds *ds)
+{
+    const struct pm_sim_scenario *scenario = pm_sim_playing;
+
+    if (NULL == scenario) {
+        ds_put_cstr(ds, "No scenario\n");
+        return;
+    }
+
+    ds_put_format(ds, "scenario: %s\n", scenario->file);
+    ds_put_format(ds, "seed: %u\n", scenario->seed);
+    ds_put_format(ds, "state: %s\n",
+                  scenario->next < scenario->n_events ? "playing" : "done");
+    ds_put_format(ds, "events: %"PRIuSIZE" of %"PRIuSIZE" (%llu skipped by "
+                  "chance, %llu failed)\n", scenario->next,
+                  scenario->n_events, (unsigned long long)scenario->skipped,
+                  (unsigned long long)scenario->failed);
+    ds_put_format(ds, "elapsed: %lld msecs\n", time_msec() - scenario->start);
+    ds_put_format(ds, "worst lateness: %lld msecs\n", scenario->max_late);
+}
+
+/*
+ * pm_sim_play_command: ops-pmd/sim play [<file> [<seed>] | stop]
+ *
+ * output: 0, or -1 (with a message in ds) on an error
+ */
+int
+pm_sim_play_command(int argc, const char *argv[], struct ds *ds)
+{
+    if (0 == argc) {
+        pm_sim_play_status(ds);
+        return 0;
+    }
+
+    if (1 == argc && 0 == strcmp(argv[0], "stop")) {
+        if (NULL != pm_sim_playing) {
+            VLOG_INFO("stopped %s after %"PRIuSIZE" of %"PRIuSIZE" events",
+                      pm_sim_playing->file, pm_sim_playing->next,
+                      pm_sim_playing->n_events);
+            pm_sim_play_free(pm_sim_playing);
+            pm_sim_playing = NULL;
+        }
+        return 0;
+    }
+
+    if (argc > 2) {
+        ds_put_cstr(ds, "Invalid usage: ... ops-pmd/sim play [<file> [<seed>] "
+                    "| stop]");
+        return -1;
+    }
+
+    return pm_sim_play_start(argv[0], (2 == argc) ? argv[1] : NULL, ds);
+}
+
+static void
+pm_sim_play_one(struct pm_sim_event *event)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    int rc;
+
+    if (NULL == event->interface) {
+        rc = pm_sim_bus_command(event->argc, (const char **)event->argv, &ds);
+    } else if (0 == strcmp(event->argv[0], "insert")) {
+        rc = pmd_sim_insert(event->interface, event->argv[1], &ds);
+    } else if (0 == strcmp(event->argv[0], "remove")) {
+        rc = pmd_sim_remove(event->interface, &ds);
+    } else {
+        rc = pm_sim_dom_command(event->interface, event->argc - 1,
+                                (const char **)event->argv + 1, &ds);
+    }
+
+    if (rc < 0) {
+        pm_sim_playing->failed++;
+        VLOG_DBG_RL(&rl, "scenario event at %lld msecs on %s: %s",
+                    event->at, event->interface ? event->interface : "bus",
+                    ds_cstr(&ds));
+    }
+    ds_destroy(&ds);
+}
+
+/*
+ * pm_sim_play_run: run the scenario events that are due
+ */
+void
+pm_sim_play_run(void)
+{
+    struct pm_sim_scenario *scenario = pm_sim_playing;
+    long long int now = time_msec();
+
+    if (NULL == scenario) {
+        return;
+    }
+
+    while (scenario->next < scenario->n_events &&
+           scenario->start + scenario->events[scenario->next].at <= now) {
+        struct pm_sim_event *event = &scenario->events[scenario->next++];
+
+        scenario->max_late = MAX(scenario->max_late,
+                                 now - scenario->start - event->at);
+        pm_sim_play_one(event);
+    }
+}
+
+/*
+ * pm_sim_play_next: time_msec() of the next scenario event, LLONG_MAX if
+ *                   none is pending
+ */
+long long int
+pm_sim_play_next(void)
+{
+    const struct pm_sim_scenario *scenario = pm_sim_playing;
+
+    if (NULL == scenario || scenario->next >= scenario->n_events) {
+        return LLONG_MAX;
+    }
+    return scenario->start + scenario->events[scenario->next].at;
+}
+
+#endif
@@ -0,0 +1,584 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for the module event / DOM subscription socket.
+ *
+ * Collectors connect to the subscription socket and receive one JSON object
+ * per line:
+ *
+ *     {"type":"module","interface":"1","time":...,"present":true,...}
+ *     {"type":"dom","interface":"1","time":...,"temperature":31.50,...}
+ *     {"type":"dom_unavailable","interface":"1","time":...}
+ *     {"type":"dropped","count":12}
+ *
+ * Right after connecting, a subscriber may send a single filter line made
+ * of space separated key=value pairs:
+ *
+ *     interfaces=1,2,53   only report these interfaces
+ *     metrics=vcc,rx_power only report these DOM measurements
+ *                          (temperature, vcc, tx_bias, tx_power, rx_power,
+ *                          flags)
+ *     events=off          don't report module insertion/removal
+ *     dom=off             don't report DOM samples
+ *     min_interval=MSECS  report at most one DOM sample per interface every
+ *                         MSECS milliseconds
+ *
+ * A "dom_unavailable" record is sent once when DOM reads of a module start
+ * failing; the next "dom" record means they work again.
+ *
+ * Each subscriber has a bounded queue. When a slow reader lets it fill up,
+ * the oldest records are dropped and a "dropped" record tells the
+ * subscriber how many it missed.
+ ***************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dynamic-string.h>
+#include <json.h>
+#include <list.h>
+#include <poll-loop.h>
+#include <shash.h>
+#include <sset.h>
+#include <stream.h>
+#include <timeval.h>
+#include <util.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+
+VLOG_DEFINE_THIS_MODULE(pm_subscribe);
+
+#define PM_SUB_QUEUE_LEN    256     // records queued per subscriber
+#define PM_SUB_FILTER_MAX   1024    // longest filter line accepted
+#define PM_SUB_MAX          16      // concurrent subscribers
+
+#define PM_SUB_METRIC_TEMPERATURE   0x01
+#define PM_SUB_METRIC_VCC           0x02
+#define PM_SUB_METRIC_TX_BIAS       0x04
+#define PM_SUB_METRIC_TX_POWER      0x08
+#define PM_SUB_METRIC_RX_POWER      0x10
+#define PM_SUB_METRIC_FLAGS         0x20
+#define PM_SUB_METRIC_ALL           0x3f
+
+struct pm_subscriber {
+    struct ovs_list list_node;      // in subscribers
+    struct stream *stream;
+
+    // filter, set by the first line the subscriber sends
+    struct ds filter_line;          // filter line received so far
+    bool filter_done;               // no more filter input is accepted
+    struct sset interfaces;         // empty for all interfaces
+    unsigned int metrics;           // PM_SUB_METRIC_*
+    bool events;
+    bool dom;
+    long long int min_interval;
+    struct shash last_dom;          // interface -> long long int, last sent
+
+    // ring of pending records; queue[head] is partly sent up to head_ofs
+    char *queue[PM_SUB_QUEUE_LEN];
+    unsigned int head;
+    unsigned int count;
+    size_t head_ofs;
+    unsigned long long dropped;
+};
+
+static struct pstream *sub_pstream = NULL;
+static struct ovs_list subscribers = OVS_LIST_INITIALIZER(&subscribers);
+static unsigned int n_subscribers = 0;
+
+static const struct {
+    const char *name;
+    unsigned int bit;
+} pm_sub_metric_names[] = {
+    { "temperature",    PM_SUB_METRIC_TEMPERATURE },
+    { "vcc",            PM_SUB_METRIC_VCC },
+    { "tx_bias",        PM_SUB_METRIC_TX_BIAS },
+    { "tx_power",       PM_SUB_METRIC_TX_POWER },
+    { "rx_power",       PM_SUB_METRIC_RX_POWER },
+    { "flags",          PM_SUB_METRIC_FLAGS },
+};
+
+/*
+ * pm_sub_init: open the subscription socket
+ *
+ * input: passive stream name, e.g. "punix:/var/run/openvswitch/ops-pmd.sub"
+ *
+ * output: 0 on success, errno value on failure
+ */
+int
+pm_sub_init(const char *name)
+{
+    int rc;
+
+    rc = pstream_open(name, &sub_pstream, 0);
+    if (rc) {
+        VLOG_ERR("unable to open subscription socket %s: %s",
+                 name, ovs_strerror(rc));
+        sub_pstream = NULL;
+    }
+
+    return rc;
+}
+
+static void
+pm_sub_destroy(struct pm_subscriber *sub)
+{
+    struct shash_node *node;
+
+    while (sub->count) {
+        free(sub->queue[sub->head]);
+        sub->head = (sub->head + 1) % PM_SUB_QUEUE_LEN;
+        sub->count--;
+    }
+
+    SHASH_FOR_EACH (node, &sub->last_dom) {
+        free(node->data);
+    }
+    shash_destroy(&sub->last_dom);
+    sset_destroy(&sub->interfaces);
+    ds_destroy(&sub->filter_line);
+
+    stream_close(sub->stream);
+    list_remove(&sub->list_node);
+    n_subscribers--;
+    free(sub);
+}
+
+void
+pm_sub_exit(void)
+{
+    struct pm_subscriber *sub, *next;
+
+    LIST_FOR_EACH_SAFE (sub, next, list_node, &subscribers) {
+        pm_sub_destroy(sub);
+    }
+
+    pstream_close(sub_pstream);
+    sub_pstream = NULL;
+}
+
+static void
+pm_sub_accept(struct stream *stream)
+{
+    struct pm_subscriber *sub;
+
+    if (n_subscribers >= PM_SUB_MAX) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+
+        VLOG_WARN_RL(&rl, "too many subscribers, closing new connection");
+        stream_close(stream);
+        return;
+    }
+
+    sub = xzalloc(sizeof(*sub));
+    sub->stream = stream;
+    ds_init(&sub->filter_line);
+    sset_init(&sub->interfaces);
+    shash_init(&sub->last_dom);
+    sub->metrics = PM_SUB_METRIC_ALL;
+    sub->events = true;
+    sub->dom = true;
+
+    list_push_back(&subscribers, &sub->list_node);
+    n_subscribers++;
+}
+
+// parse "key=value key=value ..."; returns false on a malformed line
+static bool
+pm_sub_parse_filter(struct pm_subscriber *sub, char *line)
+{
+    char *save_ptr = NULL;
+    char *token;
+
+    for (token = strtok_r(line, " \t\r", &save_ptr); NULL != token;
+         token = strtok_r(NULL, " \t\r", &save_ptr)) {
+        char *value = strchr(token, '=');
+        char *item_ptr = NULL;
+        char *item;
+        size_t idx;
+
+        if (NULL == value) {
+            return false;
+        }
+        *value++ = 0;
+
+        if (!strcmp(token, "interfaces")) {
+            for (item = strtok_r(value, ",", &item_ptr); NULL != item;
+                 item = strtok_r(NULL, ",", &item_ptr)) {
+                sset_add(&sub->interfaces, item);
+            }
+        } else if (!strcmp(token, "metrics")) {
+            sub->metrics = 0;
+            for (item = strtok_r(value, ",", &item_ptr); NULL != item;
+                 item = strtok_r(NULL, ",", &item_ptr)) {
+                for (idx = 0; idx < ARRAY_SIZE(pm_sub_metric_names); idx++) {
+                    if (!strcmp(item, pm_sub_metric_names[idx].name)) {
+                        sub->metrics |= pm_sub_metric_names[idx].bit;
+                        break;
+                    }
+                }
+                if (ARRAY_SIZE(pm_sub_metric_names) == idx) {
+                    return false;
+                }
+            }
+        } else if (!strcmp(token, "events")) {
+            sub->events = !strcmp(value, "on");
+        } else if (!strcmp(token, "dom")) {
+            sub->dom = !strcmp(value, "on");
+        } else if (!strcmp(token, "min_interval")) {
+            sub->min_interval = strtoll(value, NULL, 10);
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// collect the filter line; returns an errno value if the subscriber must go
+static int
+pm_sub_recv(struct pm_subscriber *sub)
+{
+    char buf[128];
+    char *newline;
+    int retval;
+
+    retval = stream_recv(sub->stream, buf, sizeof(buf));
+    if (-EAGAIN == retval) {
+        return 0;
+    }
+    pm_loop_note_wake(PM_LOOP_WAKE_SUBSCRIBER);
+    if (retval <= 0) {
+        return retval ? -retval : EOF;
+    }
+
+    if (sub->filter_done) {
+        // nothing else is expected from subscribers
+        return 0;
+    }
+
+    ds_put_buffer(&sub->filter_line, buf, retval);
+    newline = strchr(ds_cstr(&sub->filter_line), '\n');
+    if (NULL == newline) {
+        return sub->filter_line.length > PM_SUB_FILTER_MAX ? EPROTO : 0;
+    }
+
+    *newline = 0;
+    sub->filter_done = true;
+    if (!pm_sub_parse_filter(sub, ds_cstr(&sub->filter_line))) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+
+        VLOG_WARN_RL(&rl, "invalid subscription filter, closing connection");
+        return EPROTO;
+    }
+    ds_destroy(&sub->filter_line);
+    ds_init(&sub->filter_line);
+
+    return 0;
+}
+
+// send as much of the queue as the socket takes; returns an errno value if
+// the subscriber must go
+static int
+pm_sub_send(struct pm_subscriber *sub)
+{
+    while (sub->count) {
+        const char *record = sub->queue[sub->head];
+        size_t len = strlen(record) - sub->head_ofs;
+        int retval;
+
+        retval = stream_send(sub->stream, record + sub->head_ofs, len);
+        if (-EAGAIN == retval) {
+            return 0;
+        } else if (retval < 0) {
+            return -retval;
+        }
+        pm_loop_note_wake(PM_LOOP_WAKE_SUBSCRIBER);
+
+        sub->head_ofs += retval;
+        if (retval < len) {
+            return 0;
+        }
+
+        free(sub->queue[sub->head]);
+        sub->head = (sub->head + 1) % PM_SUB_QUEUE_LEN;
+        sub->head_ofs = 0;
+        sub->count--;
+    }
+
+    return 0;
+}
+
+void
+pm_sub_run(void)
+{
+    struct pm_subscriber *sub, *next;
+    struct stream *stream;
+    int rc;
+
+    if (NULL == sub_pstream) {
+        return;
+    }
+
+    while (0 == pstream_accept(sub_pstream, &stream)) {
+        pm_loop_note_wake(PM_LOOP_WAKE_SUBSCRIBER);
+        pm_sub_accept(stream);
+    }
+
+    LIST_FOR_EACH_SAFE (sub, next, list_node, &subscribers) {
+        stream_run(sub->stream);
+
+        rc = pm_sub_recv(sub);
+        if (0 == rc) {
+            rc = pm_sub_send(sub);
+        }
+        if (0 != rc) {
+            if (EOF != rc) {
+                VLOG_DBG("subscriber dropped: %s", ovs_retval_to_string(rc));
+            }
+            pm_sub_destroy(sub);
+        }
+    }
+}
+
+void
+pm_sub_wait(void)
+{
+    struct pm_subscriber *sub;
+
+    if (NULL == sub_pstream) {
+        return;
+    }
+
+    pstream_wait(sub_pstream);
+
+    LIST_FOR_EACH (sub, list_node, &subscribers) {
+        stream_run_wait(sub->stream);
+        stream_recv_wait(sub->stream);
+        if (sub->count) {
+            stream_send_wait(sub->stream);
+        }
+    }
+}
+
+// queue a record, dropping the oldest one if the queue is full. Takes
+// ownership of record.
+static void
+pm_sub_enqueue(struct pm_subscriber *sub, char *record)
+{
+    unsigned int tail;
+
+    if (PM_SUB_QUEUE_LEN == sub->count) {
+        if (sub->head_ofs) {
+            // the head record is partly sent; drop the one after it so the
+            // stream stays line aligned
+            unsigned int victim = (sub->head + 1) % PM_SUB_QUEUE_LEN;
+            unsigned int idx;
+
+            free(sub->queue[victim]);
+            for (idx = victim; idx != (sub->head + sub->count - 1) %
+                                      PM_SUB_QUEUE_LEN;
+                 idx = (idx + 1) % PM_SUB_QUEUE_LEN) {
+                sub->queue[idx] = sub->queue[(idx + 1) % PM_SUB_QUEUE_LEN];
+            }
+        } else {
+            free(sub->queue[sub->head]);
+            sub->head = (sub->head + 1) % PM_SUB_QUEUE_LEN;
+        }
+        sub->count--;
+        sub->dropped++;
+    } else if (sub->dropped && sub->count < PM_SUB_QUEUE_LEN - 1) {
+        // there is room again: tell the subscriber what it missed
+        tail = (sub->head + sub->count) % PM_SUB_QUEUE_LEN;
+        sub->queue[tail] = xasprintf("{\"type\":\"dropped\",\"count\":%llu}\n",
+                                     sub->dropped);
+        sub->count++;
+        sub->dropped = 0;
+    }
+
+    tail = (sub->head + sub->count) % PM_SUB_QUEUE_LEN;
+    sub->queue[tail] = record;
+    sub->count++;
+}
+
+static bool
+pm_sub_wants(const struct pm_subscriber *sub, const pm_port_t *port)
+{
+    return sset_is_empty(&sub->interfaces) ||
+           sset_contains(&sub->interfaces, port->instance);
+}
+
+static void
+pm_sub_put_string(struct ds *ds, const char *key, const char *value)
+{
+    if (NULL != value) {
+        ds_put_format(ds, ",\"%s\":", key);
+        json_string_escape(value, ds);
+    }
+}
+
+/*
+ * pm_sub_module_event: report a module insertion, removal or identity change
+ */
+void
+pm_sub_module_event(const pm_port_t *port)
+{
+    const struct ovs_module_info *info = &port->module.ovs_module_columns;
+    struct pm_subscriber *sub;
+    struct ds ds;
+
+    if (list_is_empty(&subscribers)) {
+        return;
+    }
+
+    ds_init(&ds);
+    ds_put_cstr(&ds, "{\"type\":\"module\",\"interface\":");
+    json_string_escape(port->instance, &ds);
+    ds_put_format(&ds, ",\"time\":%lld,\"present\":%s",
+                  time_wall_msec(), port->present ? "true" : "false");
+    pm_sub_put_string(&ds, "connector", info->connector);
+    pm_sub_put_string(&ds, "connector_status", info->connector_status);
+    pm_sub_put_string(&ds, "vendor_name", info->vendor_name);
+    pm_sub_put_string(&ds, "vendor_part_number", info->vendor_part_number);
+    pm_sub_put_string(&ds, "vendor_serial_number", info->vendor_serial_number);
+    pm_sub_put_string(&ds, "max_speed", info->max_speed);
+    ds_put_cstr(&ds, "}\n");
+
+    LIST_FOR_EACH (sub, list_node, &subscribers) {
+        if (sub->events && pm_sub_wants(sub, port)) {
+            pm_sub_enqueue(sub, xstrdup(ds_cstr(&ds)));
+        }
+    }
+
+    ds_destroy(&ds);
+}
+
+static void
+pm_sub_put_lanes(struct ds *ds, const char *key, const uint16_t *raw,
+                 int n_lanes, double scale)
+{
+    int lane;
+
+    ds_put_format(ds, ",\"%s\":[", key);
+    for (lane = 0; lane < n_lanes; lane++) {
+        ds_put_format(ds, "%s%.4f", lane ? "," : "", raw[lane] * scale);
+    }
+    ds_put_char(ds, ']');
+}
+
+// DOM record for one subscriber, with only the metrics it asked for
+static char *
+pm_sub_dom_record(const struct pm_subscriber *sub, const pm_port_t *port)
+{
+    const pm_dom_sample_t *sample = &port->module.dom_sample;
+    struct ds ds;
+
+    ds_init(&ds);
+    ds_put_cstr(&ds, "{\"type\":\"dom\",\"interface\":");
+    json_string_escape(port->instance, &ds);
+    ds_put_format(&ds, ",\"time\":%lld", port->dom_sample_time);
+
+    // same units as pm_info
+    if (sub->metrics & PM_SUB_METRIC_TEMPERATURE) {
+        ds_put_format(&ds, ",\"temperature\":%.2f",
+                      sample->temperature / 256.0);
+    }
+    if (sub->metrics & PM_SUB_METRIC_VCC) {
+        ds_put_format(&ds, ",\"vcc\":%.4f", sample->vcc * 0.0001);
+    }
+    if (sub->metrics & PM_SUB_METRIC_TX_BIAS) {
+        pm_sub_put_lanes(&ds, "tx_bias", sample->tx_bias, sample->n_lanes,
+                         0.002);
+    }
+    if (sub->metrics & PM_SUB_METRIC_TX_POWER) {
+        pm_sub_put_lanes(&ds, "tx_power", sample->tx_power, sample->n_lanes,
+                         0.0001);
+    }
+    if (sub->metrics & PM_SUB_METRIC_RX_POWER) {
+        pm_sub_put_lanes(&ds, "rx_power", sample->rx_power, sample->n_lanes,
+                         0.0001);
+    }
+    if (sub->metrics & PM_SUB_METRIC_FLAGS) {
+        ds_put_format(&ds, ",\"flags\":%u", sample->flags);
+    }
+    ds_put_cstr(&ds, "}\n");
+
+    return ds_steal_cstr(&ds);
+}
+
+/*
+ * pm_sub_dom_sample: report a new DOM sample
+ */
+void
+pm_sub_dom_sample(const pm_port_t *port)
+{
+    struct pm_subscriber *sub;
+    long long int *last;
+
+    LIST_FOR_EACH (sub, list_node, &subscribers) {
+        if (!sub->dom || !pm_sub_wants(sub, port)) {
+            continue;
+        }
+
+        if (sub->min_interval > 0) {
+            last = shash_find_data(&sub->last_dom, port->instance);
+            if (NULL == last) {
+                last = xmalloc(sizeof(*last));
+                shash_add(&sub->last_dom, port->instance, last);
+            } else if (port->dom_sample_time - *last < sub->min_interval) {
+                continue;
+            }
+            *last = port->dom_sample_time;
+        }
+
+        pm_sub_enqueue(sub, pm_sub_dom_record(sub, port));
+    }
+}
+
+/*
+ * pm_sub_dom_unavailable: report that the DOM page of a module can't be read
+ */
+void
+pm_sub_dom_unavailable(const pm_port_t *port)
+{
+    struct pm_subscriber *sub;
+    struct ds ds;
+
+    if (list_is_empty(&subscribers)) {
+        return;
+    }
+
+    ds_init(&ds);
+    ds_put_cstr(&ds, "{\"type\":\"dom_unavailable\",\"interface\":");
+    json_string_escape(port->instance, &ds);
+    ds_put_format(&ds, ",\"time\":%lld}\n", time_wall_msec());
+
+    LIST_FOR_EACH (sub, list_node, &subscribers) {
+        if (sub->dom && pm_sub_wants(sub, port)) {
+            pm_sub_enqueue(sub, xstrdup(ds_cstr(&ds)));
+        }
+    }
+
+    ds_destroy(&ds);
+}
@@ -0,0 +1,39 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for the static tracepoint semaphores.
+ *
+ * One counter per probe of include/pm_trace.h, in the .probes section where
+ * tracers find and increment them when they attach.
+ ***************************************************************************/
+
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+#include "pm_trace.h"
+
+#ifdef HAVE_SYS_SDT_H
+
+#define PM_TRACE_SEMAPHORE_DEFINE(name)                                     \
+    unsigned short ops_pmd_##name##_semaphore                               \
+        __attribute__((section(".probes")));
+PM_TRACE_PROBES(PM_TRACE_SEMAPHORE_DEFINE)
+
+#endif
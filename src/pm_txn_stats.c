@@ -0,0 +1,248 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Source file for OVSDB write amplification accounting.
+ *
+ * pm_info is written as a whole map: a port with one changed key sends all
+ * of them. For every row written this compares the new map with the one in
+ * the IDL replica and counts keys and bytes written against keys and bytes
+ * that actually changed. The ratio of the two is the write amplification
+ * that partial map updates or deadbands would remove.
+ *
+ * Bytes are the size of the map in an OVSDB update, ["map",[["k","v"],...]],
+ * without JSON escapes.
+ ***************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+
+#include <smap.h>
+#include <util.h>
+#include <vswitch-idl.h>
+
+#include "pmd.h"
+
+VLOG_DEFINE_THIS_MODULE(pm_txn_stats);
+
+struct pm_txn_counts {
+    uint64_t    txns;               // transactions with at least one row
+    uint64_t    rows;
+    uint64_t    keys;               // keys written
+    uint64_t    keys_changed;       // keys added or with a new value
+    uint64_t    keys_removed;       // keys dropped from the map
+    uint64_t    bytes;              // map bytes written
+    uint64_t    bytes_changed;      // bytes of the added, changed and
+                                    // removed keys
+    uint64_t    rows_suppressed;    // rows not written: nothing changed
+};
+
+struct pm_txn_stats {
+    struct pm_txn_counts total;     // transactions committed
+    struct pm_txn_counts cur;       // transaction being built
+};
+
+// identity and DOM transactions are kept apart
+static struct pm_txn_stats pm_txn_stats[2];
+
+// ["k","v"], plus the separating comma
+static size_t
+pm_txn_pair_bytes(const char *key, const char *value)
+{
+    return strlen(key) + strlen(value) + 8;
+}
+
+/*
+ * pm_txn_stats_row: account a pm_info map about to be written
+ *
+ * input: DOM (true) or identity transaction
+ *        map currently in the database
+ *        map being written
+ *
+ * output: true if the row has to be written, false if it is identical to
+ *         the database (pm_info is written with omit_alert, so the IDL would
+ *         drop the write anyway)
+ */
+bool
+pm_txn_stats_row(bool dom, const struct smap *old, const struct smap *new)
+{
+    struct pm_txn_counts *cur = &pm_txn_stats[dom].cur;
+    const struct smap_node *node;
+    const char *value;
+
+    // nothing is sent for such a row, whatever the transaction status
+    if (smap_equal(old, new)) {
+        pm_txn_stats[dom].total.rows_suppressed++;
+        return false;
+    }
+
+    cur->rows++;
+    cur->bytes += strlen("[\"map\",[]]");
+
+    SMAP_FOR_EACH (node, new) {
+        size_t bytes = pm_txn_pair_bytes(node->key, node->value);
+
+        cur->keys++;
+        cur->bytes += bytes;
+
+        value = smap_get(old, node->key);
+        if (NULL == value || strcmp(value, node->value)) {
+            cur->keys_changed++;
+            cur->bytes_changed += bytes;
+        }
+    }
+
+    // a removed key is not written, but a partial update would still
+    // have to name it
+    SMAP_FOR_EACH (node, old) {
+        if (NULL == smap_get(new, node->key)) {
+            cur->keys_removed++;
+            cur->bytes_changed += pm_txn_pair_bytes(node->key, node->value);
+        }
+    }
+
+    return true;
+}
+
+/*
+ * pm_txn_stats_commit: the transaction was committed
+ *
+ * input: DOM (true) or identity transaction
+ *        transaction status
+ *
+ * The rows of the transaction are only counted if it succeeded; a
+ * transaction that failed or has to be retried wrote nothing.
+ */
+void
+pm_txn_stats_commit(bool dom, int status)
+{
+    struct pm_txn_stats *stats = &pm_txn_stats[dom];
+    struct pm_txn_counts *cur = &stats->cur;
+
+    if (0 == cur->rows || TXN_SUCCESS != status) {
+        memset(cur, 0, sizeof(*cur));
+        return;
+    }
+
+    stats->total.txns++;
+    stats->total.rows += cur->rows;
+    stats->total.keys += cur->keys;
+    stats->total.keys_changed += cur->keys_changed;
+    stats->total.keys_removed += cur->keys_removed;
+    stats->total.bytes += cur->bytes;
+    stats->total.bytes_changed += cur->bytes_changed;
+
+    memset(cur, 0, sizeof(*cur));
+}
+
+void
+pm_txn_stats_reset(void)
+{
+    memset(pm_txn_stats, 0, sizeof(pm_txn_stats));
+}
+
+static double
+pm_txn_ratio(uint64_t written, uint64_t changed)
+{
+    return changed ? (double)written / changed : 0;
+}
+
+/*
+ * pm_txn_stats_dump: show rows, keys and bytes written per transaction
+ *                    kind, and the write amplification
+ */
+void
+pm_txn_stats_dump(struct ds *ds)
+{
+    int dom;
+
+    ds_put_format(ds, "%-9s %8s %8s %10s %10s %10s %8s %12s %12s %7s "
+                  "%7s\n",
+                  "txn", "count", "rows", "suppressed", "keys", "changed",
+                  "removed", "bytes", "changed", "keys x", "bytes x");
+
+    for (dom = 0; dom < 2; dom++) {
+        const struct pm_txn_counts *stats = &pm_txn_stats[dom].total;
+
+        ds_put_format(ds, "%-9s %8llu %8llu %10llu %10llu %10llu %8llu "
+                      "%12llu %12llu %7.1f %7.1f\n",
+                      dom ? "dom" : "identity",
+                      (unsigned long long)stats->txns,
+                      (unsigned long long)stats->rows,
+                      (unsigned long long)stats->rows_suppressed,
+                      (unsigned long long)stats->keys,
+                      (unsigned long long)stats->keys_changed,
+                      (unsigned long long)stats->keys_removed,
+                      (unsigned long long)stats->bytes,
+                      (unsigned long long)stats->bytes_changed,
+                      pm_txn_ratio(stats->keys,
+                                   stats->keys_changed + stats->keys_removed),
+                      pm_txn_ratio(stats->bytes, stats->bytes_changed));
+    }
+}
+
+/*
+ * pm_txn_stats_metrics: the same counters in the Prometheus text format
+ */
+void
+pm_txn_stats_metrics(struct ds *ds)
+{
+    static const struct {
+        const char *name;
+        size_t offset;
+        const char *help;
+    } counters[] = {
+        { "ops_pmd_ovsdb_txns_total",
+          offsetof(struct pm_txn_counts, txns), "Transactions committed." },
+        { "ops_pmd_ovsdb_rows_written_total",
+          offsetof(struct pm_txn_counts, rows), "Rows written." },
+        { "ops_pmd_ovsdb_rows_suppressed_total",
+          offsetof(struct pm_txn_counts, rows_suppressed),
+          "Rows not written because pm_info was unchanged." },
+        { "ops_pmd_ovsdb_keys_written_total",
+          offsetof(struct pm_txn_counts, keys), "pm_info keys written." },
+        { "ops_pmd_ovsdb_keys_changed_total",
+          offsetof(struct pm_txn_counts, keys_changed),
+          "pm_info keys written with a new value." },
+        { "ops_pmd_ovsdb_keys_removed_total",
+          offsetof(struct pm_txn_counts, keys_removed),
+          "pm_info keys removed." },
+        { "ops_pmd_ovsdb_bytes_written_total",
+          offsetof(struct pm_txn_counts, bytes), "pm_info bytes written." },
+        { "ops_pmd_ovsdb_bytes_changed_total",
+          offsetof(struct pm_txn_counts, bytes_changed),
+          "pm_info bytes of keys added, changed or removed." },
+    };
+    const struct pm_txn_counts *total;
+    size_t metric;
+    int dom;
+
+    for (metric = 0; metric < ARRAY_SIZE(counters); metric++) {
+        ds_put_format(ds, "# HELP %s %s\n# TYPE %s counter\n",
+                      counters[metric].name, counters[metric].help,
+                      counters[metric].name);
+        for (dom = 0; dom < 2; dom++) {
+            total = &pm_txn_stats[dom].total;
+            ds_put_format(ds, "%s{txn=\"%s\"} %llu\n", counters[metric].name,
+                          dom ? "dom" : "identity", (unsigned long long)
+                          *(const uint64_t *)((const char *)total +
+                                              counters[metric].offset));
+        }
+    }
+}
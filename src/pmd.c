@@ -38,19 +38,23 @@
 #include <fatal-signal.h>
 #include <ovsdb-idl.h>
 #include <poll-loop.h>
+#include <timeval.h>
 #include <unixctl.h>
 #include <util.h>
 #include <dynamic-string.h>
 #include <vswitch-idl.h>
-#include <coverage.h>
 
 #include "pmd.h"
+#include "pm_perf.h"
 
 VLOG_DEFINE_THIS_MODULE(ops_pmd);
 
-COVERAGE_DEFINE(pmd_reconfigure);
-
 static unixctl_cb_func pmd_unixctl_dump;
+static unixctl_cb_func pmd_unixctl_dom_history;
+static unixctl_cb_func pmd_unixctl_perf;
+static unixctl_cb_func pmd_unixctl_loop;
+static unixctl_cb_func pmd_unixctl_write_amp;
+static unixctl_cb_func pmd_unixctl_i2c_trace;
 #ifdef PLATFORM_SIMULATION
 static unixctl_cb_func pmd_unixctl_sim;
 #endif
@@ -62,21 +66,102 @@ static void pmd_print_version(void);
 
 static char *program_version = "0.02";
 
+// passive stream for event/DOM subscribers (--subscribe), "none" for none
+static char *subscribe_path = NULL;
+
+// passive stream for metrics scrapes (--metrics), "none" for none
+static char *metrics_path = NULL;
+
+// I2C trace to record to (--i2c-trace) or to replay (--i2c-replay)
+static char *i2c_trace_path = NULL;
+static char *i2c_replay_path = NULL;
+
+// shared-memory segment of the module state snapshot (--shm-name)
+static const char *shm_name = PM_SHM_NAME;
+
+// next time the DOM data is refreshed and published
+static long long int dom_next_refresh = LLONG_MIN;
+
+// next periodic scan for module insertion/removal
+static long long int next_tick = LLONG_MIN;
+
+// IDL sequence number seen by the last scan
+static unsigned int scan_idl_seqno = 0;
+
 extern struct ovsdb_idl *idl;
 extern void pmd_reconfigure(struct ovsdb_idl *idl);
-extern int pmd_sim_insert(const char *name, const char *file, struct ds *ds);
-extern int pmd_sim_remove(const char *name, struct ds *ds);
+
+/*
+ * pmd_publish_init: set up the snapshot segment and the local sockets
+ *
+ * These are shared with the ops-pmd that holds the ops_pmd lock, so a second
+ * instance must not touch them until it holds the lock itself.
+ */
+static void
+pmd_publish_init(void)
+{
+    static bool initialized = false;
+
+    if (initialized) {
+        return;
+    }
+    initialized = true;
+
+    pm_shm_init(shm_name);
+    if (NULL == subscribe_path) {
+        subscribe_path = xasprintf("punix:%s/ops-pmd.sub", ovs_rundir());
+    }
+    if (strcmp(subscribe_path, "none")) {
+        pm_sub_init(subscribe_path);
+    }
+
+    if (NULL == metrics_path) {
+        metrics_path = xasprintf("punix:%s/ops-pmd.metrics", ovs_rundir());
+    }
+    if (strcmp(metrics_path, "none")) {
+        pm_metrics_init(metrics_path);
+    }
+}
 
 static void
 pmd_init(const char *remote)
 {
+    struct ds ds = DS_EMPTY_INITIALIZER;
+
     pm_config_init();
+    if (NULL != i2c_replay_path &&
+        0 != pm_i2c_replay_start(i2c_replay_path, &ds)) {
+        VLOG_FATAL("--i2c-replay: %s", ds_cstr(&ds));
+    }
+    if (NULL != i2c_trace_path &&
+        0 != pm_i2c_trace_start(i2c_trace_path, 0, &ds)) {
+        VLOG_FATAL("--i2c-trace: %s", ds_cstr(&ds));
+    }
+    ds_destroy(&ds);
+
     pm_ovsdb_if_init(remote);
-    unixctl_command_register("ops-pmd/dump", "", 0, 2,
+    unixctl_command_register("ops-pmd/dump",
+                             "[interface [name] | i2c | events | --json [name]]",
+                             0, 2,
                              pmd_unixctl_dump, NULL);
+    unixctl_command_register("ops-pmd/dom-history", "interface [N]", 1, 2,
+                             pmd_unixctl_dom_history, NULL);
+    unixctl_command_register("ops-pmd/perf", "[reset]", 0, 1,
+                             pmd_unixctl_perf, NULL);
+    unixctl_command_register("ops-pmd/loop", "[frozen | clear | wakeups]",
+                             0, 1,
+                             pmd_unixctl_loop, NULL);
+    unixctl_command_register("ops-pmd/write-amp", "[reset]", 0, 1,
+                             pmd_unixctl_write_amp, NULL);
+    unixctl_command_register("ops-pmd/i2c-trace",
+                             "[start file [max-mb] | stop]", 0, 3,
+                             pmd_unixctl_i2c_trace, NULL);
 
 #ifdef PLATFORM_SIMULATION
-    unixctl_command_register("ops-pmd/sim", "", 2, 3,
+    unixctl_command_register("ops-pmd/sim",
+                             "interface [insert file | remove | dom [setting...]]"
+                             " | bus [name [reset | key=value...]]"
+                             " | play [file [seed] | stop]", 1, 12,
                              pmd_unixctl_sim, NULL);
 #endif
 }
@@ -85,15 +170,57 @@ static void
 pmd_exit(void)
 {
     ovsdb_idl_destroy(idl);
+    pm_sub_exit();
+    pm_metrics_exit();
+    pm_shm_exit();
+    pm_i2c_trace_exit();
+}
+
+/*
+ * pmd_scan_due: should this run scan the modules
+ *
+ * Unixctl commands, subscribers and metrics scrapes wake the loop too, but
+ * only to be served; a presence read of every port for each of them would
+ * put a full bus scan behind every scrape. The modules are scanned when the
+ * tick or the DOM refresh is due, when the database changed, or (in the
+ * simulation) when scenario events are due.
+ */
+static bool
+pmd_scan_due(void)
+{
+    long long int now = time_msec();
+
+    if (now >= next_tick || now >= dom_next_refresh ||
+        ovsdb_idl_get_seqno(idl) != scan_idl_seqno) {
+        return true;
+    }
+#ifdef PLATFORM_SIMULATION
+    if (now >= pm_sim_play_next()) {
+        return true;
+    }
+#endif
+
+    return false;
 }
 
 static void
 pmd_run(void)
 {
     int rc;
+    uint64_t run_start;
+    uint64_t start;
 
     ovsdb_idl_run(idl);
 
+    if (false == pmd_scan_due()) {
+        return;
+    }
+    scan_idl_seqno = ovsdb_idl_get_seqno(idl);
+
+    // the modules are scanned now, so the next periodic scan is due one
+    // interval from now, whatever woke us up this time
+    next_tick = time_msec() + PM_TICK_INTERVAL;
+
     if (ovsdb_idl_is_lock_contended(idl)) {
         static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 1);
 
@@ -105,17 +232,48 @@ pmd_run(void)
         return;
     }
 
+    pmd_publish_init();
+
+    run_start = pm_perf_now();
+
     // Process DB changes.
+    start = run_start;
     pmd_reconfigure(idl);
+    pm_loop_phase_end(PM_PERF_RECONFIGURE, start);
+
+#ifdef PLATFORM_SIMULATION
+    // scenario events due now, so this scan already sees them
+    pm_sim_play_run();
+#endif
 
     // Scan pluggable modules for current status.
+    start = pm_perf_now();
     rc = pm_read_state();
+    pm_loop_phase_end(PM_PERF_READ_STATE, start);
     if (0 != rc) {
         VLOG_ERR_ONCE("Failed to read pluggable module state, rc=%d\n", rc);
     }
 
     // Update OVSDB.
+    start = pm_perf_now();
     pm_ovsdb_update();
+    pm_loop_phase_end(PM_PERF_OVSDB_UPDATE, start);
+
+    // Refresh DOM data and publish it in its own transaction, on its own
+    // cadence, so telemetry does not ride along with identity updates.
+    if (time_msec() >= dom_next_refresh) {
+        start = pm_perf_now();
+        pm_read_dom_state();
+        pm_loop_phase_end(PM_PERF_DOM_READ, start);
+
+        start = pm_perf_now();
+        pm_ovsdb_dom_update();
+        pm_loop_phase_end(PM_PERF_DOM_UPDATE, start);
+
+        dom_next_refresh = time_msec() + PM_DOM_INTERVAL;
+    }
+
+    pm_perf_end(PM_PERF_RUN, run_start);
 
     daemonize_complete();
     vlog_enable_async();
@@ -125,10 +283,21 @@ pmd_run(void)
 static void
 pmd_wait(void)
 {
+    long long int deadline = next_tick;
+
     ovsdb_idl_wait(idl);
 
-    // Wakeup periodically for pluggable module detection.
-    poll_timer_wait_at(PM_INTERVAL, __FUNCTION__);
+    // Wakeup periodically for pluggable module detection and, once we own
+    // the lock (pmd_run doesn't get to set it before), for the next DOM
+    // refresh.
+    if (ovsdb_idl_has_lock(idl)) {
+        deadline = MIN(deadline, dom_next_refresh);
+    }
+#ifdef PLATFORM_SIMULATION
+    deadline = MIN(deadline, pm_sim_play_next());
+#endif
+    poll_timer_wait_at(deadline, __FUNCTION__);
+    pm_loop_set_deadline(deadline);
 }
 
 #ifdef PLATFORM_SIMULATION
@@ -144,15 +313,23 @@ pmd_unixctl_sim(struct unixctl_conn *conn, int argc,
     /* usage:
         ops-pmd/sim <interface> insert <file>
         ops-pmd/sim <interface> remove
+        ops-pmd/sim <interface> dom [walk=on|off] [ramp=<secs>] [<monitor>[<lane>]=<value>...]
+        ops-pmd/sim bus [<bus> [reset | <key>=<value>...]]
+        ops-pmd/sim play [<file> [<seed>] | stop]
     */
-    if (4 == argc && strcmp("insert", argv[2]) == 0) {
+    if (strcmp("bus", argv[1]) == 0) {
+        rc = pm_sim_bus_command(argc - 2, argv + 2, &ds);
+    } else if (strcmp("play", argv[1]) == 0) {
+        rc = pm_sim_play_command(argc - 2, argv + 2, &ds);
+    } else if (4 == argc && strcmp("insert", argv[2]) == 0) {
         rc = pmd_sim_insert(interface, argv[3], &ds);
     } else if (3 == argc && strcmp("remove", argv[2]) == 0) {
         rc = pmd_sim_remove(interface, &ds);
+    } else if (3 <= argc && strcmp("dom", argv[2]) == 0) {
+        rc = pm_sim_dom_command(interface, argc - 3, argv + 3, &ds);
     } else {
         rc = -1;
-        ds_put_cstr(&ds, "Invalid usage: ... ops-pmd/sim <interface> [insert <file> | remove]");
-        return;
+        ds_put_cstr(&ds, "Invalid usage: ... ops-pmd/sim <interface> [insert <file> | remove | dom [<setting>...]] | bus [<bus> [reset | <key>=<value>...]] | play [<file> [<seed>] | stop]");
     }
 
     if (rc < 0) {
@@ -166,17 +343,145 @@ pmd_unixctl_sim(struct unixctl_conn *conn, int argc,
 #endif
 
 static void
-pmd_unixctl_dump(struct unixctl_conn *conn, int argc OVS_UNUSED,
-                 const char *argv[] OVS_UNUSED, void *aux OVS_UNUSED)
+pmd_unixctl_dump(struct unixctl_conn *conn, int argc,
+                 const char *argv[], void *aux OVS_UNUSED)
 {
     struct ds ds = DS_EMPTY_INITIALIZER;
 
+    // the JSON dump also carries the main loop's schedule, which lives here
+    if (argc > 1 && !strcmp(argv[1], "--json")) {
+        if (pm_json_dump(&ds, argc > 2 ? argv[2] : NULL,
+                         dom_next_refresh) < 0) {
+            unixctl_command_reply_error(conn, ds_cstr(&ds));
+        } else {
+            unixctl_command_reply(conn, ds_cstr(&ds));
+        }
+        ds_destroy(&ds);
+        return;
+    }
+
     pm_debug_dump(&ds, argc, argv);
 
     unixctl_command_reply(conn, ds_cstr(&ds));
     ds_destroy(&ds);
 }
 
+static void
+pmd_unixctl_dom_history(struct unixctl_conn *conn, int argc,
+                        const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    unsigned int n = 0;
+    int rc;
+
+    if (3 == argc && !str_to_uint(argv[2], 10, &n)) {
+        unixctl_command_reply_error(conn, "N must be a number");
+        return;
+    }
+
+    rc = pm_dom_history_dump(&ds, argv[1], n);
+
+    if (rc < 0) {
+        unixctl_command_reply_error(conn, ds_cstr(&ds));
+    } else {
+        unixctl_command_reply(conn, ds_cstr(&ds));
+    }
+
+    ds_destroy(&ds);
+}
+
+static void
+pmd_unixctl_perf(struct unixctl_conn *conn, int argc,
+                 const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+
+    if (2 == argc) {
+        if (strcmp(argv[1], "reset")) {
+            unixctl_command_reply_error(conn, "usage: ops-pmd/perf [reset]");
+            return;
+        }
+        pm_perf_reset();
+        unixctl_command_reply(conn, NULL);
+        return;
+    }
+
+    pm_perf_dump(&ds);
+
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
+}
+
+static void
+pmd_unixctl_loop(struct unixctl_conn *conn, int argc,
+                 const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    bool frozen = false;
+
+    if (2 == argc) {
+        if (!strcmp(argv[1], "clear")) {
+            pm_loop_clear();
+            unixctl_command_reply(conn, NULL);
+            return;
+        } else if (!strcmp(argv[1], "frozen")) {
+            frozen = true;
+        } else if (!strcmp(argv[1], "wakeups")) {
+            pm_loop_wakeups_dump(&ds);
+            unixctl_command_reply(conn, ds_cstr(&ds));
+            ds_destroy(&ds);
+            return;
+        } else {
+            unixctl_command_reply_error(conn, "usage: ops-pmd/loop "
+                                        "[frozen | clear | wakeups]");
+            return;
+        }
+    }
+
+    pm_loop_dump(&ds, frozen);
+
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
+}
+
+static void
+pmd_unixctl_write_amp(struct unixctl_conn *conn, int argc,
+                      const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+
+    if (2 == argc) {
+        if (strcmp(argv[1], "reset")) {
+            unixctl_command_reply_error(conn,
+                                        "usage: ops-pmd/write-amp [reset]");
+            return;
+        }
+        pm_txn_stats_reset();
+        unixctl_command_reply(conn, NULL);
+        return;
+    }
+
+    pm_txn_stats_dump(&ds);
+
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
+}
+
+static void
+pmd_unixctl_i2c_trace(struct unixctl_conn *conn, int argc,
+                      const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+
+    if (pm_i2c_trace_command(argc - 1, argv + 1, &ds) < 0) {
+        unixctl_command_reply_error(conn, ds_cstr(&ds));
+    } else {
+        unixctl_command_reply(conn, ds_cstr(&ds));
+    }
+
+    ds_destroy(&ds);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -207,11 +512,19 @@ main(int argc, char *argv[])
 
     exiting = false;
     while (!exiting) {
+        pm_loop_begin();
         pmd_run();
+        pm_sub_run();
+        pm_metrics_run();
+        // last, so it only gets the wakeups nothing else explains
         unixctl_server_run(unixctl);
+        pm_loop_note_unixctl();
+        pm_loop_end();
 
         pmd_wait();
         unixctl_server_wait(unixctl);
+        pm_sub_wait();
+        pm_metrics_wait();
 
         if (exiting) {
             poll_immediate_wake();
@@ -229,6 +542,14 @@ parse_options(int argc, char *argv[], char **unixctl_pathp)
 {
     enum {
         OPT_UNIXCTL = UCHAR_MAX + 1,
+        OPT_DOM_HISTORY,
+        OPT_SUBSCRIBE,
+        OPT_METRICS,
+        OPT_LOOP_BUDGET,
+        OPT_MAX_WAKEUPS,
+        OPT_I2C_TRACE,
+        OPT_I2C_REPLAY,
+        OPT_SHM_NAME,
         VLOG_OPTION_ENUMS,
         DAEMON_OPTION_ENUMS,
     };
@@ -236,6 +557,14 @@ parse_options(int argc, char *argv[], char **unixctl_pathp)
         {"help",        no_argument, NULL, 'h'},
         {"version",     no_argument, NULL, 'V'},
         {"unixctl",     required_argument, NULL, OPT_UNIXCTL},
+        {"dom-history", required_argument, NULL, OPT_DOM_HISTORY},
+        {"subscribe",   required_argument, NULL, OPT_SUBSCRIBE},
+        {"metrics",     required_argument, NULL, OPT_METRICS},
+        {"loop-budget", required_argument, NULL, OPT_LOOP_BUDGET},
+        {"max-wakeups", required_argument, NULL, OPT_MAX_WAKEUPS},
+        {"i2c-trace",   required_argument, NULL, OPT_I2C_TRACE},
+        {"i2c-replay",  required_argument, NULL, OPT_I2C_REPLAY},
+        {"shm-name",    required_argument, NULL, OPT_SHM_NAME},
         DAEMON_LONG_OPTIONS,
         VLOG_LONG_OPTIONS,
         {NULL, 0, NULL, 0},
@@ -262,6 +591,53 @@ parse_options(int argc, char *argv[], char **unixctl_pathp)
             *unixctl_pathp = optarg;
             break;
 
+        case OPT_DOM_HISTORY:
+            // the ring is allocated per port, so the depth is bounded
+            if (!str_to_uint(optarg, 10, &pm_dom_history_depth) ||
+                pm_dom_history_depth > PM_DOM_HISTORY_MAX) {
+                VLOG_FATAL("--dom-history argument must be a number from 0 "
+                           "(disabled) to %d", PM_DOM_HISTORY_MAX);
+            }
+            break;
+
+        case OPT_SUBSCRIBE:
+            subscribe_path = optarg;
+            break;
+
+        case OPT_METRICS:
+            metrics_path = optarg;
+            break;
+
+        case OPT_LOOP_BUDGET:
+            if (!str_to_uint(optarg, 10, &pm_loop_budget)) {
+                VLOG_FATAL("--loop-budget argument must be a number");
+            }
+            break;
+
+        case OPT_MAX_WAKEUPS:
+            if (!str_to_uint(optarg, 10, &pm_loop_max_rate)) {
+                VLOG_FATAL("--max-wakeups argument must be a number");
+            }
+            break;
+
+        case OPT_I2C_TRACE:
+            i2c_trace_path = optarg;
+            break;
+
+        case OPT_I2C_REPLAY:
+            i2c_replay_path = optarg;
+            break;
+
+        case OPT_SHM_NAME:
+            // a POSIX shared-memory object name: one leading '/'
+            if ('/' != optarg[0] || NULL != strchr(optarg + 1, '/') ||
+                '\0' == optarg[1] || strlen(optarg) > NAME_MAX) {
+                VLOG_FATAL("--shm-name argument must be a name starting "
+                           "with '/', such as %s", PM_SHM_NAME);
+            }
+            shm_name = optarg;
+            break;
+
         VLOG_OPTION_HANDLERS
         DAEMON_OPTION_HANDLERS
 
@@ -274,6 +650,10 @@ parse_options(int argc, char *argv[], char **unixctl_pathp)
     }
     free(short_options);
 
+    if (NULL != i2c_trace_path && NULL != i2c_replay_path) {
+        VLOG_FATAL("--i2c-trace and --i2c-replay can't be used together");
+    }
+
     argc -= optind;
     argv += optind;
 
@@ -302,8 +682,30 @@ usage(void)
     vlog_usage();
     printf("\nOther options:\n"
            "  --unixctl=SOCKET        override default control socket name\n"
+           "  --dom-history=N         keep the last N DOM samples per port\n"
+           "                          (default: %d, at most %d, 0 disables)\n"
+           "  --subscribe=PSTREAM     listen for event/DOM subscribers on PSTREAM\n"
+           "                          (default: \"punix:%s/ops-pmd.sub\",\n"
+           "                          \"none\" disables)\n"
+           "  --metrics=PSTREAM       serve metrics (Prometheus text format)\n"
+           "                          on PSTREAM\n"
+           "                          (default: \"punix:%s/ops-pmd.metrics\",\n"
+           "                          \"none\" disables)\n"
+           "  --loop-budget=MSECS     freeze the loop flight recorder when an\n"
+           "                          iteration takes longer (default: %d,\n"
+           "                          0 disables)\n"
+           "  --max-wakeups=N         log seconds with more than N main loop\n"
+           "                          wakeups (default: %d, 0 disables)\n"
+           "  --i2c-trace=FILE        record every I2C operation to FILE\n"
+           "  --i2c-replay=FILE       answer I2C operations from the trace\n"
+           "                          FILE instead of the bus\n"
+           "  --shm-name=NAME         publish the module state snapshot in\n"
+           "                          the shared-memory segment NAME\n"
+           "                          (default: \"%s\")\n"
            "  -h, --help              display this help message\n"
-           "  -V, --version           display version information\n");
+           "  -V, --version           display version information\n",
+           PM_DOM_HISTORY_DEPTH, PM_DOM_HISTORY_MAX, ovs_rundir(),
+           ovs_rundir(), PM_LOOP_BUDGET, PM_LOOP_MAX_RATE, PM_SHM_NAME);
     exit(EXIT_SUCCESS);
 }
 
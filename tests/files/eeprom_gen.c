@@ -0,0 +1,444 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * eeprom_gen: write a corpus of synthetic SFP+/QSFP+/QSFP28 EEPROM images
+ *
+ *      cc -I../../include -o eeprom_gen eeprom_gen.c
+ *      ./eeprom_gen <directory> [seed]
+ *
+ * The directory is created if it doesn't exist; its parent must.
+ *
+ * There is one module for every compliance code pm_parse() decodes, and a
+ * few it doesn't. For each module <name>:
+ *
+ *  <name>.txt              serial ID in hex, as the other *.txt files here
+ *                          (atoc turns it into a 128 byte image)
+ *  <name>.bin              whole pages, for "ops-pmd/sim <interface> insert":
+ *                          SFP+ A0h, then A2h with thresholds and monitors
+ *                          if the module has DOM; QSFP lower page and upper
+ *                          page 00h, then pages 01h to 03h if it has DOM
+ *  <name>_BAD_CC_BASE.bin  the same, with CC_BASE broken
+ *  <name>_BAD_CC_EXT.bin   the same, with CC_EXT broken
+ *
+ * plus BLANK_SFP.bin and BLANK_QSFP.bin, unprogrammed (all 0xff) EEPROMs.
+ *
+ * manifest.txt lists every image with the port connector it is meant for,
+ * the pm_info connector ops-pmd should report ("unknown" when a checksum
+ * is bad) and whether its checksums are good, so benchmarks and tests
+ * can check what they decode. The seed only changes serial numbers and
+ * vendors. CC_BASE and CC_EXT are computed the way sum.c checks them.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "plug.h"
+
+#define PAGE_LEN        128
+
+#define PORT_SFP        "SFP_PLUS"
+#define PORT_QSFP       "QSFP_PLUS"
+#define PORT_QSFP28     "QSFP28"
+
+#define ID_SFP          0x03
+#define ID_QSFP         0x0d
+#define ID_QSFP28       0x11
+
+// SFF-8024 connector codes
+#define CONN_LC         0x07
+#define CONN_MPO        0x0c
+#define CONN_RJ45       0x22
+#define CONN_NONE       0x23
+
+// DOM: SFF-8472 A2h and SFF-8636 lower page/upper page 03h offsets
+#define SFP_DIAG_DOM            0x68    // digital, internal cal, avg power
+#define SFP_A2_MONITORS         96
+#define SFP_A2_CC_DMI           95
+#define QSFP_DIAG_DOM           0x08    // average input power
+#define QSFP_STATUS             2
+#define QSFP_FLAT_MEM           0x04
+#define QSFP_TEMPERATURE        22
+#define QSFP_VCC                26
+#define QSFP_CHANNEL_MONITORS   34
+
+struct module_type {
+    const char *name;
+    const char *port;           // port connector it is made for
+    const char *connector;      // pm_info connector pm_parse() reports
+    unsigned char identifier;
+    unsigned char connector_code;
+    int code_byte;              // compliance code: byte of the serial ID...
+    unsigned char code_bit;     // ...and its bit (0 for none)
+    unsigned char ext_code;     // QSFP extended compliance code
+    unsigned char bit_rate;     // nominal, units of 100Mb/s
+    unsigned char copper;       // cable length in m, 0 for optics
+    int dom;
+};
+
+static const struct module_type types[] = {
+    // SFP+: bytes 3 (10G), 6 (1G) and 8 (cable technology)
+    { "SFP_SX",      PORT_SFP, "SFP_SX",   ID_SFP, CONN_LC,   6, 0x01, 0, 0x0d, 0, 1 },
+    { "SFP_LX",      PORT_SFP, "SFP_LX",   ID_SFP, CONN_LC,   6, 0x02, 0, 0x0d, 0, 1 },
+    { "SFP_CX",      PORT_SFP, "SFP_CX",   ID_SFP, CONN_NONE, 6, 0x04, 0, 0x0d, 1, 0 },
+    { "SFP_RJ45",    PORT_SFP, "SFP_RJ45", ID_SFP, CONN_RJ45, 6, 0x08, 0, 0x0d, 0, 0 },
+    { "SFP_SR",      PORT_SFP, "SFP_SR",   ID_SFP, CONN_LC,   3, 0x10, 0, 0x67, 0, 1 },
+    { "SFP_LR",      PORT_SFP, "SFP_LR",   ID_SFP, CONN_LC,   3, 0x20, 0, 0x67, 0, 1 },
+    { "SFP_LRM",     PORT_SFP, "SFP_LRM",  ID_SFP, CONN_LC,   3, 0x40, 0, 0x67, 0, 1 },
+    { "SFP_DAC_PASSIVE", PORT_SFP, "SFP_DAC", ID_SFP, PM_CONNECTOR_COPPER_PIGTAIL,
+                                                 8, 0x04, 0, 0x67, 3, 0 },
+    { "SFP_DAC_ACTIVE",  PORT_SFP, "SFP_DAC", ID_SFP, PM_CONNECTOR_COPPER_PIGTAIL,
+                                                 8, 0x08, 0, 0x67, 7, 0 },
+    { "SFP_DAC_1G",  PORT_SFP, "SFP_DAC",  ID_SFP, PM_CONNECTOR_COPPER_PIGTAIL,
+                                                 8, 0x04, 0, 0x0d, 1, 0 },
+    { "SFP_ER",      PORT_SFP, "unknown",  ID_SFP, CONN_LC,   3, 0x80, 0, 0x67, 0, 1 },
+
+    // QSFP+: byte 131 (upper page 00h byte 3)
+    { "QSFP_LR4",    PORT_QSFP, "QSFP_LR4", ID_QSFP, CONN_LC,   3, 0x02, 0, 0x67, 0, 1 },
+    { "QSFP_SR4",    PORT_QSFP, "QSFP_SR4", ID_QSFP, CONN_MPO,  3, 0x04, 0, 0x67, 0, 1 },
+    { "QSFP_CR4",    PORT_QSFP, "QSFP_CR4", ID_QSFP, CONN_NONE, 3, 0x08, 0, 0x67, 3, 0 },
+    { "QSFP_XLPPI",  PORT_QSFP, "unknown",  ID_QSFP, CONN_NONE, 3, 0x01, 0, 0x67, 0, 0 },
+
+    // QSFP28: the extended bit of byte 131 and the code in byte 192
+    { "QSFP28_SR4",  PORT_QSFP28, "QSFP28_SR4",  ID_QSFP28, CONN_MPO, 3, 0x80,
+      PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_SR4,   0xff, 0, 1 },
+    { "QSFP28_LR4",  PORT_QSFP28, "QSFP28_LR4",  ID_QSFP28, CONN_LC,  3, 0x80,
+      PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_LR4,   0xff, 0, 1 },
+    { "QSFP28_CWDM4", PORT_QSFP28, "QSFP28_CWDM4", ID_QSFP28, CONN_LC, 3, 0x80,
+      PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_CWDM4, 0xff, 0, 1 },
+    { "QSFP28_PSM4", PORT_QSFP28, "QSFP28_PSM4", ID_QSFP28, CONN_MPO, 3, 0x80,
+      PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_PSM4,  0xff, 0, 1 },
+    { "QSFP28_CR4",  PORT_QSFP28, "QSFP28_CR4",  ID_QSFP28, CONN_NONE, 3, 0x80,
+      PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_CR4,   0xff, 3, 0 },
+    { "QSFP28_CLR4", PORT_QSFP28, "QSFP28_CLR4", ID_QSFP28, CONN_LC,  3, 0x80,
+      PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_CLR4,  0xff, 0, 1 },
+    { "QSFP28_ER4",  PORT_QSFP28, "unknown",     ID_QSFP28, CONN_LC,  3, 0x80,
+      PM_QSFP_EXT_COMPLIANCE_CODE_100GBASE_ER4,   0xff, 0, 1 },
+    // a 40G module in a QSFP28 port
+    { "QSFP28_40G_SR4", PORT_QSFP28, "QSFP_SR4", ID_QSFP, CONN_MPO, 3, 0x04,
+      0, 0x67, 0, 1 },
+};
+
+static const struct {
+    const char *name;
+    unsigned char oui[PM_VENDOR_OUI_LEN];
+} vendors[] = {
+    { "ACME OPTICS",    { 0x02, 0x00, 0x01 } },
+    { "CONTOSO PHOTON", { 0x02, 0x00, 0x02 } },
+    { "INITECH CABLE",  { 0x02, 0x00, 0x03 } },
+};
+
+// thresholds (high alarm, low alarm, high warning, low warning) and a
+// typical value of each monitor, in raw units: 1/256 C, 100uV, 2uA, 0.1uW
+static const struct {
+    int thresholds[4];
+    int value;
+    int sfp_threshold;          // offset in A2h
+    int qsfp_threshold;         // offset in upper page 03h
+} monitors[] = {
+    { { 75 * 256, -5 * 256, 70 * 256, 0 },   35 * 256, 0,  0 },    // temperature
+    { { 36300, 29700, 34650, 31350 },       33000,    8,  16 },   // vcc
+    { { 6000, 1000, 5000, 1500 },           3000,     16, 56 },   // tx bias
+    { { 12600, 1000, 10000, 1600 },         5000,     24, 64 },   // tx power
+    { { 12600, 200, 10000, 500 },           4000,     32, 48 },   // rx power
+};
+
+static unsigned int rng;
+
+static unsigned int
+next_random(void)
+{
+    rng = rng * 1103515245 + 12345;
+    return (rng >> 16) & 0x7fff;
+}
+
+// copy a string into a space padded EEPROM field
+static void
+pad(unsigned char *field, size_t len, const char *text)
+{
+    size_t text_len = strlen(text);
+
+    memset(field, ' ', len);
+    memcpy(field, text, text_len < len ? text_len : len);
+}
+
+static unsigned char
+sum(const unsigned char *data, int start, int end)
+{
+    unsigned char value = 0;
+    int idx;
+
+    for (idx = start; idx <= end; idx++) {
+        value += data[idx];
+    }
+
+    return value;
+}
+
+static void
+put16(unsigned char *bytes, int value)
+{
+    bytes[0] = (value >> 8) & 0xff;
+    bytes[1] = value & 0xff;
+}
+
+static void
+put_thresholds(unsigned char *page, int qsfp)
+{
+    int id;
+    int idx;
+
+    for (id = 0; id < (int)(sizeof(monitors) / sizeof(monitors[0])); id++) {
+        int offset = qsfp ? monitors[id].qsfp_threshold :
+                            monitors[id].sfp_threshold;
+
+        for (idx = 0; idx < 4; idx++) {
+            put16(&page[offset + 2 * idx], monitors[id].thresholds[idx]);
+        }
+    }
+}
+
+/*
+ * build_sfp: lay out an SFP+ module
+ *
+ * output: image length
+ */
+static size_t
+build_sfp(const struct module_type *type, int index, unsigned char *image)
+{
+    pm_sfp_serial_id_t *id = (pm_sfp_serial_id_t *)image;
+    unsigned char *bytes = image;
+    unsigned char *a2 = image + 2 * PAGE_LEN;
+    char serial[PM_VENDOR_SN_LEN + 1];
+    int vendor = next_random() % (sizeof(vendors) / sizeof(vendors[0]));
+    int id_idx;
+
+    id->identifier = type->identifier;
+    id->ext_identifier = 0x04;
+    id->connector = type->connector_code;
+    if (0 != type->code_bit) {
+        bytes[type->code_byte] = type->code_bit;
+    }
+    id->encoding = (type->bit_rate > 0x20) ? 0x06 : 0x01;    // 64B/66B, 8B/10B
+    id->bit_rate_nominal = type->bit_rate;
+    id->length_copper = type->copper;
+    if (0 == type->copper) {
+        id->length_mmf_50um_om2 = 8;
+        id->length_mmf_50um_om3 = 30;
+        // 850nm, in the big-endian byte order of the EEPROM
+        bytes[60] = 0x03;
+        bytes[61] = 0x52;
+    }
+    pad(id->vendor_name, PM_VENDOR_NAME_LEN, vendors[vendor].name);
+    memcpy(id->vendor_oui, vendors[vendor].oui, PM_VENDOR_OUI_LEN);
+    pad(id->vendor_part_number, PM_VENDOR_PN_LEN, type->name);
+    pad(id->vendor_revision, PM_SFP_VENDOR_REV_LEN, "A");
+    id->check_code_for_base = sum(image, 0, 62);
+
+    snprintf(serial, sizeof(serial), "SIM%02d%08u", index,
+             (next_random() * 32768 + next_random()) % 100000000);
+    pad(id->vendor_serial_number, PM_VENDOR_SN_LEN, serial);
+    memcpy(&id->vendor_date_code, "160101  ", sizeof(id->vendor_date_code));
+    if (type->dom) {
+        bytes[92] = SFP_DIAG_DOM;
+        id->sff8472_compliance = 0x06;                      // rev 11.4
+    }
+    id->check_code_for_extended = sum(image, 64, 94);
+
+    if (!type->dom) {
+        return 2 * PAGE_LEN;
+    }
+
+    put_thresholds(a2, 0);
+    for (id_idx = 0; id_idx < (int)(sizeof(monitors) / sizeof(monitors[0]));
+         id_idx++) {
+        put16(&a2[SFP_A2_MONITORS + 2 * id_idx], monitors[id_idx].value);
+    }
+    a2[SFP_A2_CC_DMI] = sum(a2, 0, 94);
+
+    return 3 * PAGE_LEN;
+}
+
+/*
+ * build_qsfp: lay out a QSFP+/QSFP28 module
+ *
+ * output: image length
+ */
+static size_t
+build_qsfp(const struct module_type *type, int index, unsigned char *image)
+{
+    unsigned char *lower = image;
+    unsigned char *bytes = image + PAGE_LEN;               // upper page 00h
+    pm_qsfp_serial_id_t *id = (pm_qsfp_serial_id_t *)bytes;
+    unsigned char *page3 = image + 4 * PAGE_LEN;
+    char serial[PM_VENDOR_SN_LEN + 1];
+    int vendor = next_random() % (sizeof(vendors) / sizeof(vendors[0]));
+    int lane;
+
+    lower[0] = type->identifier;
+    lower[1] = 0x07;                                        // SFF-8636 2.8
+    lower[QSFP_STATUS] = type->dom ? 0 : QSFP_FLAT_MEM;
+
+    id->identifier = type->identifier;
+    id->connector = type->connector_code;
+    if (0 != type->code_bit) {
+        bytes[type->code_byte] = type->code_bit;
+    }
+    id->encoding = 0x05;                                    // 64B/66B
+    id->bit_rate_nominal = type->bit_rate;
+    id->length_copper_in_m = type->copper;
+    if (0 == type->copper) {
+        id->length_om3_in_2m = 50;
+    }
+    pad(id->vendor_name, PM_VENDOR_NAME_LEN, vendors[vendor].name);
+    memcpy(id->vendor_oui, vendors[vendor].oui, PM_VENDOR_OUI_LEN);
+    pad(id->vendor_part_number, PM_VENDOR_PN_LEN, type->name);
+    pad(id->vendor_revision, PM_QSFP_VENDOR_REV_LEN, "A");
+    id->max_case_temperature = 70;
+    id->check_code_for_base = sum(bytes, 0, 62);
+
+    id->options.ext_compliance_code = type->ext_code;
+    snprintf(serial, sizeof(serial), "SIM%02d%08u", index,
+             (next_random() * 32768 + next_random()) % 100000000);
+    pad(id->vendor_serial_number, PM_VENDOR_SN_LEN, serial);
+    memcpy(&id->vendor_date_code, "160101  ", sizeof(id->vendor_date_code));
+    if (type->dom) {
+        bytes[92] = QSFP_DIAG_DOM;
+    }
+    id->check_code_for_extended = sum(bytes, 64, 94);
+
+    if (!type->dom) {
+        return 2 * PAGE_LEN;
+    }
+
+    put16(&lower[QSFP_TEMPERATURE], monitors[0].value);
+    put16(&lower[QSFP_VCC], monitors[1].value);
+    for (lane = 0; lane < 4; lane++) {
+        put16(&lower[QSFP_CHANNEL_MONITORS + 2 * lane], monitors[4].value);
+        put16(&lower[QSFP_CHANNEL_MONITORS + 8 + 2 * lane], monitors[2].value);
+        put16(&lower[QSFP_CHANNEL_MONITORS + 16 + 2 * lane],
+              monitors[3].value);
+    }
+    put_thresholds(page3, 1);
+
+    return 5 * PAGE_LEN;
+}
+
+static void
+write_file(const char *dir, const char *name, const char *suffix,
+           const unsigned char *data, size_t len)
+{
+    char path[1024];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s%s", dir, name, suffix);
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Unable to open file: %s\n", path);
+        exit(1);
+    }
+    fwrite(data, len, 1, fp);
+    fclose(fp);
+}
+
+static void
+write_hex(const char *dir, const char *name, const unsigned char *data)
+{
+    char hex[2 * PAGE_LEN + 2];
+    int idx;
+
+    for (idx = 0; idx < PAGE_LEN; idx++) {
+        snprintf(&hex[2 * idx], 3, "%02X", data[idx]);
+    }
+    strcat(hex, "\n");
+
+    write_file(dir, name, ".txt", (const unsigned char *)hex, strlen(hex));
+}
+
+int
+main(int argc, char **argv)
+{
+    FILE *manifest;
+    char path[1024];
+    unsigned char image[5 * PAGE_LEN];
+    unsigned char bad[5 * PAGE_LEN];
+    int idx;
+
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <directory> [seed]\n", argv[0]);
+        exit(1);
+    }
+    rng = (argc == 3) ? strtoul(argv[2], NULL, 0) : 1;
+
+    if (mkdir(argv[1], 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Unable to create directory %s: %s\n", argv[1],
+                strerror(errno));
+        exit(1);
+    }
+
+    snprintf(path, sizeof(path), "%s/manifest.txt", argv[1]);
+    manifest = fopen(path, "w");
+    if (manifest == NULL) {
+        fprintf(stderr, "Unable to open file: %s\n", path);
+        exit(1);
+    }
+    fprintf(manifest, "# image port connector checksums\n");
+
+    for (idx = 0; idx < (int)(sizeof(types) / sizeof(types[0])); idx++) {
+        const struct module_type *type = &types[idx];
+        int qsfp = strcmp(type->port, PORT_SFP);
+        // the serial ID, where the checksums are
+        int serial_id = qsfp ? PAGE_LEN : 0;
+        size_t len;
+
+        memset(image, 0, sizeof(image));
+        if (qsfp) {
+            len = build_qsfp(type, idx, image);
+        } else {
+            len = build_sfp(type, idx, image);
+        }
+
+        write_hex(argv[1], type->name, image + serial_id);
+        write_file(argv[1], type->name, ".bin", image, len);
+        fprintf(manifest, "%s.bin %s %s ok\n", type->name, type->port,
+                type->connector);
+
+        memcpy(bad, image, len);
+        bad[serial_id + 63] ^= 0xff;
+        write_file(argv[1], type->name, "_BAD_CC_BASE.bin", bad, len);
+        fprintf(manifest, "%s_BAD_CC_BASE.bin %s unknown bad\n", type->name,
+                type->port);
+
+        memcpy(bad, image, len);
+        bad[serial_id + 95] ^= 0xff;
+        write_file(argv[1], type->name, "_BAD_CC_EXT.bin", bad, len);
+        fprintf(manifest, "%s_BAD_CC_EXT.bin %s unknown bad\n", type->name,
+                type->port);
+    }
+
+    memset(image, 0xff, sizeof(image));
+    write_file(argv[1], "BLANK_SFP", ".bin", image, PAGE_LEN);
+    fprintf(manifest, "BLANK_SFP.bin %s unknown bad\n", PORT_SFP);
+    write_file(argv[1], "BLANK_QSFP", ".bin", image, PAGE_LEN);
+    fprintf(manifest, "BLANK_QSFP.bin %s unknown bad\n", PORT_QSFP);
+
+    fclose(manifest);
+
+    exit(0);
+}
@@ -0,0 +1,561 @@
+/*
+ *  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License. You may obtain
+ *  a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-pmd
+ *
+ * @file
+ * Micro-benchmarks for the module decode paths (pmd-bench).
+ *
+ *      make pmd-bench
+ *      ./pmd-bench [-n ITERATIONS] [-r REPEATS] [--allocs] FILE|DIR...
+ *
+ * Every *.bin image given (directories are read in name order) is decoded
+ * with libpmd-core, the same code the daemon uses (see pm_core.h):
+ *
+ *  sum_verify   sfpp_sum_verify() of the serial ID page
+ *  parse        pm_parse() then pm_delete_all_data(), one insertion
+ *  set_a2       pm_set_a2() of the DOM page, as on every DOM poll (images
+ *               with a DOM page only: SFP+ A2h, QSFP lower page)
+ *  hex_to_ascii hex_to_ascii() of the serial ID page, and its free()
+ *  pm_info      pm_build_pm_info() of the decoded module into an smap
+ *
+ * Each line is one benchmark on one image: the median ns/op of REPEATS
+ * runs of ITERATIONS operations, and the heap allocations per operation.
+ * Allocations don't depend on timing, so the --allocs output is the same
+ * from run to run and can be diffed between builds as is.
+ *
+ * The port type comes from the identifier byte of the image, so that the
+ * tests/files corpus and the images from tests/files/eeprom_gen.c can be
+ * used directly.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <command-line.h>
+#include <smap.h>
+#include <util.h>
+#include <vswitch-idl.h>
+#include <openswitch-idl.h>
+
+#include "pm_core.h"
+
+VLOG_DEFINE_THIS_MODULE(pmd_bench);
+
+#define PM_BENCH_PAGE_LEN       128
+#define PM_BENCH_MAX_IMAGE      (16 * PM_BENCH_PAGE_LEN)
+
+#define PM_BENCH_ITERATIONS     10000
+#define PM_BENCH_REPEATS        5
+#define PM_BENCH_MAX_REPEATS    99
+
+// identifier byte of the serial ID page (SFF-8024)
+#define PM_BENCH_ID_SFP         0x03
+#define PM_BENCH_ID_QSFP        0x0c
+#define PM_BENCH_ID_QSFP_PLUS   0x0d
+#define PM_BENCH_ID_QSFP28      0x11
+
+struct pm_bench_image {
+    char                *name;
+    unsigned char       data[PM_BENCH_MAX_IMAGE];
+    size_t              len;
+    const char          *connector;     // connector of the port it is for
+    pm_sfp_serial_id_t  *a0;            // serial ID page
+    pm_sfp_dom_t        *a2;            // DOM page, NULL if there is none
+};
+
+struct pm_bench {
+    const char  *name;
+    bool        (*applies)(const struct pm_bench_image *image);
+    void        (*setup)(pm_module_t *port, struct pm_bench_image *image);
+    void        (*run)(pm_module_t *port, struct pm_bench_image *image);
+};
+
+static struct pm_bench_image **images;
+static size_t n_images;
+static size_t allocated_images;
+
+static unsigned int iterations = PM_BENCH_ITERATIONS;
+static unsigned int repeats = PM_BENCH_REPEATS;
+static bool allocs_only = false;
+
+OVS_NO_RETURN static void usage(void);
+
+//
+// Allocation counting: these replace the C library allocator entry points
+// for the whole program (glibc calls them for its own allocations too, so
+// strdup() and asprintf() are counted) and pass through to glibc.
+//
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long long int n_allocs;
+
+void *
+malloc(size_t size)
+{
+    n_allocs++;
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t count, size_t size)
+{
+    n_allocs++;
+    return __libc_calloc(count, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    n_allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+void
+free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+static unsigned long long int
+pm_bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long int)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * pm_bench_classify: find the port type of an image, and where its serial
+ *                    ID and DOM pages are
+ *
+ * A 128 byte image is a serial ID page. Longer ones are laid out as for
+ * "ops-pmd/sim insert": SFP+ A0h then A2h, QSFP lower page then upper
+ * pages.
+ */
+static void
+pm_bench_classify(struct pm_bench_image *image)
+{
+    unsigned char identifier = image->data[0];
+    bool qsfp;
+
+    if (PM_BENCH_ID_QSFP28 == identifier) {
+        image->connector = CONNECTOR_QSFP28;
+    } else if (PM_BENCH_ID_QSFP == identifier ||
+               PM_BENCH_ID_QSFP_PLUS == identifier) {
+        image->connector = CONNECTOR_QSFP_PLUS;
+    } else if (PM_BENCH_ID_SFP == identifier) {
+        image->connector = CONNECTOR_SFP_PLUS;
+    } else if (NULL != strstr(image->name, "QSFP")) {
+        // unprogrammed or corrupted: go by the name
+        image->connector = CONNECTOR_QSFP_PLUS;
+    } else {
+        image->connector = CONNECTOR_SFP_PLUS;
+    }
+    qsfp = (0 != strcmp(image->connector, CONNECTOR_SFP_PLUS));
+
+    image->a0 = (pm_sfp_serial_id_t *)image->data;
+    image->a2 = NULL;
+
+    if (PM_BENCH_PAGE_LEN == image->len) {
+        return;
+    }
+
+    if (qsfp) {
+        image->a0 = (pm_sfp_serial_id_t *)&image->data[QSFP_SERIAL_ID_OFFSET];
+        image->a2 = (pm_sfp_dom_t *)image->data;
+    } else if (image->len >= 3 * PM_BENCH_PAGE_LEN) {
+        image->a2 = (pm_sfp_dom_t *)&image->data[2 * PM_BENCH_PAGE_LEN];
+    }
+}
+
+static void
+pm_bench_load(const char *path, const char *name)
+{
+    struct pm_bench_image *image;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (NULL == fp) {
+        ovs_fatal(errno, "%s: open failed", path);
+    }
+
+    // a0 and a2 point into the image, so images don't move once loaded
+    image = xzalloc(sizeof *image);
+    image->len = fread(image->data, 1, sizeof(image->data), fp);
+    if (!feof(fp) || 0 != image->len % PM_BENCH_PAGE_LEN ||
+        (PM_BENCH_PAGE_LEN != image->len &&
+         image->len < 2 * PM_BENCH_PAGE_LEN)) {
+        // not an image: skip it, as the directory may hold other files
+        fclose(fp);
+        free(image);
+        fprintf(stderr, "%s: not a 128 byte serial ID page or whole pages "
+                "of up to %d bytes, skipped\n", path, PM_BENCH_MAX_IMAGE);
+        return;
+    }
+    fclose(fp);
+
+    image->name = xstrdup(name);
+    pm_bench_classify(image);
+
+    if (n_images >= allocated_images) {
+        images = x2nrealloc(images, &allocated_images, sizeof *images);
+    }
+    images[n_images++] = image;
+}
+
+static int
+pm_bench_compare_names(const void *a_, const void *b_)
+{
+    const char *const *a = a_;
+    const char *const *b = b_;
+
+    return strcmp(*a, *b);
+}
+
+static void
+pm_bench_load_dir(const char *dir)
+{
+    struct dirent *entry;
+    char **names = NULL;
+    size_t n_names = 0;
+    size_t allocated_names = 0;
+    size_t idx;
+    size_t len;
+    DIR *dp;
+
+    dp = opendir(dir);
+    if (NULL == dp) {
+        ovs_fatal(errno, "%s: opendir failed", dir);
+    }
+
+    while (NULL != (entry = readdir(dp))) {
+        len = strlen(entry->d_name);
+        if (len <= strlen(".bin") ||
+            0 != strcmp(entry->d_name + len - strlen(".bin"), ".bin")) {
+            continue;
+        }
+        if (n_names >= allocated_names) {
+            names = x2nrealloc(names, &allocated_names, sizeof *names);
+        }
+        names[n_names++] = xstrdup(entry->d_name);
+    }
+    closedir(dp);
+
+    // readdir order depends on the file system; the output shouldn't
+    qsort(names, n_names, sizeof *names, pm_bench_compare_names);
+
+    for (idx = 0; idx < n_names; idx++) {
+        char *path = xasprintf("%s/%s", dir, names[idx]);
+
+        pm_bench_load(path, names[idx]);
+        free(path);
+        free(names[idx]);
+    }
+    free(names);
+}
+
+static void
+pm_bench_port_init(pm_module_t *port, struct pm_bench_image *image)
+{
+    memset(port, 0, sizeof(*port));
+    port->name = image->name;
+    port->connector = image->connector;
+    port->pluggable = true;
+}
+
+static void
+pm_bench_port_destroy(pm_module_t *port)
+{
+    pm_delete_all_data(port);
+}
+
+static bool
+pm_bench_all(const struct pm_bench_image *image OVS_UNUSED)
+{
+    return true;
+}
+
+static bool
+pm_bench_has_dom(const struct pm_bench_image *image)
+{
+    return NULL != image->a2;
+}
+
+static void
+pm_bench_no_setup(pm_module_t *port OVS_UNUSED,
+                  struct pm_bench_image *image OVS_UNUSED)
+{
+}
+
+// decode the module as on insertion, and DOM as on the first poll
+static void
+pm_bench_decode(pm_module_t *port, struct pm_bench_image *image)
+{
+    pm_parse(image->a0, port);
+    if (NULL != image->a2) {
+        pm_set_a2(port, image->a2);
+    }
+}
+
+static void
+pm_bench_sum_verify(pm_module_t *port OVS_UNUSED, struct pm_bench_image *image)
+{
+    sfpp_sum_verify((unsigned char *)image->a0);
+}
+
+static void
+pm_bench_parse(pm_module_t *port, struct pm_bench_image *image)
+{
+    pm_parse(image->a0, port);
+    pm_delete_all_data(port);
+}
+
+static void
+pm_bench_set_a2(pm_module_t *port, struct pm_bench_image *image)
+{
+    pm_set_a2(port, image->a2);
+}
+
+static void
+pm_bench_hex_to_ascii(pm_module_t *port OVS_UNUSED,
+                      struct pm_bench_image *image)
+{
+    free(hex_to_ascii((char *)image->a0, sizeof(pm_sfp_serial_id_t)));
+}
+
+static void
+pm_bench_pm_info(pm_module_t *port, struct pm_bench_image *image OVS_UNUSED)
+{
+    struct smap pm_info;
+
+    smap_init(&pm_info);
+    pm_build_pm_info(port, &pm_info);
+    smap_destroy(&pm_info);
+}
+
+static const struct pm_bench benches[] = {
+    { "sum_verify",   pm_bench_all,     pm_bench_no_setup, pm_bench_sum_verify },
+    { "parse",        pm_bench_all,     pm_bench_no_setup, pm_bench_parse },
+    { "set_a2",       pm_bench_has_dom, pm_bench_decode,   pm_bench_set_a2 },
+    { "hex_to_ascii", pm_bench_all,     pm_bench_no_setup,
+      pm_bench_hex_to_ascii },
+    { "pm_info",      pm_bench_all,     pm_bench_decode,   pm_bench_pm_info },
+};
+
+static int
+pm_bench_compare_times(const void *a_, const void *b_)
+{
+    const unsigned long long int *a = a_;
+    const unsigned long long int *b = b_;
+
+    return (*a > *b) - (*a < *b);
+}
+
+/*
+ * pm_bench_run: run one benchmark on one image and print its line
+ */
+static void
+pm_bench_run(const struct pm_bench *bench, struct pm_bench_image *image)
+{
+    unsigned long long int times[PM_BENCH_MAX_REPEATS];
+    unsigned long long int allocs = 0;
+    unsigned long long int start;
+    unsigned int repeat;
+    unsigned int idx;
+    pm_module_t port;
+
+    pm_bench_port_init(&port, image);
+    bench->setup(&port, image);
+
+    // one untimed operation, so that the first run doesn't pay for the
+    // cold caches (and set_a2 measures polls of a module already seen)
+    bench->run(&port, image);
+
+    for (repeat = 0; repeat < repeats; repeat++) {
+        allocs -= n_allocs;
+        start = pm_bench_now();
+        for (idx = 0; idx < iterations; idx++) {
+            bench->run(&port, image);
+        }
+        times[repeat] = pm_bench_now() - start;
+        allocs += n_allocs;
+    }
+
+    pm_bench_port_destroy(&port);
+
+    qsort(times, repeats, sizeof times[0], pm_bench_compare_times);
+
+    printf("%-12s  %-32s  %-9s", bench->name, image->name,
+           image->connector);
+    if (!allocs_only) {
+        printf("  %10.1f",
+               (double)times[repeats / 2] / iterations);
+    }
+    printf("  %9.2f\n", (double)allocs / ((double)iterations * repeats));
+}
+
+static void
+parse_options(int argc, char *argv[])
+{
+    enum {
+        OPT_ALLOCS = UCHAR_MAX + 1,
+        VLOG_OPTION_ENUMS,
+    };
+    static const struct option long_options[] = {
+        {"help",        no_argument, NULL, 'h'},
+        {"iterations",  required_argument, NULL, 'n'},
+        {"repeats",     required_argument, NULL, 'r'},
+        {"allocs",      no_argument, NULL, OPT_ALLOCS},
+        VLOG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0},
+    };
+    char *short_options = long_options_to_short_options(long_options);
+
+    for (;;) {
+        int c;
+
+        c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+        case 'h':
+            usage();
+
+        case 'n':
+            if (!str_to_uint(optarg, 10, &iterations) || 0 == iterations) {
+                ovs_fatal(0, "--iterations argument must be a positive "
+                          "number");
+            }
+            break;
+
+        case 'r':
+            if (!str_to_uint(optarg, 10, &repeats) || 0 == repeats ||
+                repeats > PM_BENCH_MAX_REPEATS) {
+                ovs_fatal(0, "--repeats argument must be a number from 1 "
+                          "to %d", PM_BENCH_MAX_REPEATS);
+            }
+            break;
+
+        case OPT_ALLOCS:
+            allocs_only = true;
+            break;
+
+        VLOG_OPTION_HANDLERS
+
+        case '?':
+            exit(EXIT_FAILURE);
+
+        default:
+            abort();
+        }
+    }
+    free(short_options);
+}
+
+static void
+usage(void)
+{
+    printf("%s: micro-benchmarks for the ops-pmd module decode paths\n"
+           "usage: %s [OPTIONS] FILE|DIR...\n"
+           "where each FILE is a module EEPROM image, and each DIR holds\n"
+           "      *.bin images (e.g. tests/files).\n",
+           program_name, program_name);
+    vlog_usage();
+    printf("\nOther options:\n"
+           "  -n, --iterations=N      operations per run (default: %d)\n"
+           "  -r, --repeats=N         runs per benchmark, of which the\n"
+           "                          median is reported (default: %d)\n"
+           "  --allocs                report allocations only, which are\n"
+           "                          the same from run to run\n"
+           "  -h, --help              display this help message\n",
+           PM_BENCH_ITERATIONS, PM_BENCH_REPEATS);
+    exit(EXIT_SUCCESS);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct stat st;
+    size_t bench;
+    size_t idx;
+    int arg;
+
+    set_program_name(argv[0]);
+
+    // the decode paths log at debug and warning level (e.g. for corrupted
+    // images); keep that out of the results unless asked for with -v
+    vlog_set_levels(NULL, VLF_ANY_DESTINATION, VLL_OFF);
+
+    parse_options(argc, argv);
+    if (optind >= argc) {
+        ovs_fatal(0, "no images given (use --help for help)");
+    }
+
+    for (arg = optind; arg < argc; arg++) {
+        if (0 != stat(argv[arg], &st)) {
+            ovs_fatal(errno, "%s", argv[arg]);
+        }
+        if (S_ISDIR(st.st_mode)) {
+            pm_bench_load_dir(argv[arg]);
+        } else {
+            const char *name = strrchr(argv[arg], '/');
+
+            pm_bench_load(argv[arg], (NULL == name) ? argv[arg] : name + 1);
+        }
+    }
+    if (0 == n_images) {
+        ovs_fatal(0, "no images found");
+    }
+
+    printf("# pmd-bench: %"PRIuSIZE" images, %u iterations, "
+           "median of %u runs\n", n_images, iterations, repeats);
+    printf("%-12s  %-32s  %-9s", "# bench", "image", "connector");
+    if (!allocs_only) {
+        printf("  %10s", "ns/op");
+    }
+    printf("  %9s\n", "allocs/op");
+
+    for (bench = 0; bench < ARRAY_SIZE(benches); bench++) {
+        for (idx = 0; idx < n_images; idx++) {
+            if (benches[bench].applies(images[idx])) {
+                pm_bench_run(&benches[bench], images[idx]);
+            }
+        }
+    }
+
+    for (idx = 0; idx < n_images; idx++) {
+        free(images[idx]->name);
+        free(images[idx]);
+    }
+    free(images);
+
+    return 0;
+}
@@ -0,0 +1,560 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+#  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+#
+#  Licensed under the Apache License, Version 2.0 (the "License"); you may
+#  not use this file except in compliance with the License. You may obtain
+#  a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+#  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+#  License for the specific language governing permissions and limitations
+#  under the License.
+
+"""
+End-to-end benchmark of ops-pmd against a local ovsdb-server.
+
+This starts a private ovsdb-server with the OpenSwitch schema, loads a
+synthetic platform from pmd_gen_platform.py and runs a simulation build of
+ops-pmd on it, all in a work directory with its own sockets. Nothing of a
+running switch is touched: ops-pmd publishes its shared-memory snapshot in
+a segment of its own (--shm-name), which is removed when it exits.
+
+It measures:
+
+    startup     time from starting ops-pmd to Daemon:cur_hw=1
+    per phase   with a module in every port and a given percentage of them
+                following a DOM random walk, over --duration seconds:
+                CPU per main loop iteration, commit latency of the identity
+                and DOM transactions that wrote rows, RSS, and the pm_info
+                bytes and database log bytes written per minute
+
+With --storm it measures an insertion storm instead, a line card or box
+powering up with every cage populated: modules go into all ports at once,
+and it reports the time until every port's pm_info is published, the
+distribution of the per-port completion times, the busy time of the main
+loop iterations (all their work, not only pmd_run) and the unixctl round
+trip times during the storm. Completion is polled with ovs-appctl and
+ovsdb-client, so the times are only as fine as a poll round, whose
+durations are reported as well; the polling also loads ovsdb-server.
+
+The results are written as JSON, to stdout or --output. For example:
+
+    tools/pmd_bench_daemon.py -s 2 -p 64 --dom-change 0,10,100 \\
+        --schema /usr/share/openvswitch/vswitch.ovsschema -o run.json
+    tools/pmd_bench_daemon.py -s 8 -p 128 --storm \\
+        --schema /usr/share/openvswitch/vswitch.ovsschema -o storm.json
+
+The binaries are taken from --bin-dir, then PATH.
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import platform
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+FILES_DIR = os.path.join(TOOLS_DIR, os.pardir, "tests", "files")
+
+DAEMON_NAME = "ops-pmd"
+
+# how often the storm polls the database and the control socket
+STORM_POLL_SECS = 0.05
+
+# module identity is published; pm_info of an empty port has no vendor
+PUBLISHED_KEY = "vendor_name"
+
+# commit latency histograms, as named by ops-pmd/perf; they only count
+# transactions that wrote rows, not the empty commit of every tick
+COMMITS = [("identity", "identity_commit"),
+           ("dom", "dom_commit")]
+
+
+class BenchError(Exception):
+    pass
+
+
+class Bench(object):
+    """The processes and sockets of one run, in a work directory."""
+
+    def __init__(self, args, workdir):
+        self.args = args
+        self.workdir = workdir
+        self.db_file = os.path.join(workdir, "ovsdb.db")
+        self.db_sock = "unix:" + os.path.join(workdir, "db.sock")
+        self.pmd_ctl = os.path.join(workdir, "ops-pmd.ctl")
+        self.metrics_sock = os.path.join(workdir, "ops-pmd.metrics")
+        self.shm_name = "/ops-pmd-bench-{}".format(os.getpid())
+        self.ovsdb = None
+        self.pmd = None
+
+    def binary(self, name):
+        if self.args.bin_dir:
+            path = os.path.join(self.args.bin_dir, name)
+            if os.access(path, os.X_OK):
+                return path
+        return name
+
+    def run(self, *cmd):
+        try:
+            return subprocess.check_output(
+                [self.binary(cmd[0])] + list(cmd[1:]),
+                stderr=subprocess.STDOUT).decode("utf-8")
+        except OSError as err:
+            raise BenchError("{}: {}".format(cmd[0], err))
+        except subprocess.CalledProcessError as err:
+            raise BenchError("{} failed: {}".format(
+                " ".join(cmd[:2]), err.output.decode("utf-8").strip()))
+
+    def appctl(self, *cmd):
+        return self.run("ovs-appctl", "-t", self.pmd_ctl, *cmd)
+
+    def transact(self, operations):
+        return json.loads(self.run("ovsdb-client", "transact", self.db_sock,
+                                   json.dumps(operations)))
+
+    def wait_for(self, what, test, timeout):
+        deadline = time.time() + timeout
+        while not test():
+            if time.time() > deadline:
+                raise BenchError("timed out waiting for " + what)
+            time.sleep(0.01)
+
+    def start_ovsdb(self, platform_dir):
+        self.run("ovsdb-tool", "create", self.db_file, self.args.schema)
+        self.ovsdb = subprocess.Popen(
+            [self.binary("ovsdb-server"), self.db_file,
+             "--remote=p" + self.db_sock,
+             "--unixctl=" + os.path.join(self.workdir, "ovsdb-server.ctl"),
+             "--log-file=" + os.path.join(self.workdir, "ovsdb-server.log"),
+             "-vconsole:off"])
+        self.wait_for("ovsdb-server", lambda: os.path.exists(
+            self.db_sock[len("unix:"):]), 10)
+
+        with open(os.path.join(platform_dir, "ovsdb.json")) as rows:
+            operations = json.load(rows)
+        operations.extend(self.daemon_rows())
+        for reply in self.transact(operations):
+            if "error" in reply:
+                raise BenchError("loading the platform: {}".format(reply))
+
+    def daemon_rows(self):
+        """Insert the Daemon row of ops-pmd, referenced from System when the
+        schema keeps Daemon rows that way."""
+        with open(self.args.schema) as schema_file:
+            tables = json.load(schema_file)["tables"]
+
+        daemon = {"op": "insert", "table": "Daemon", "uuid-name": "pmd",
+                  "row": {"name": DAEMON_NAME}}
+        system = {"op": "insert", "table": "System", "row": {}}
+        for column, spec in tables.get("System", {}).get(
+                "columns", {}).items():
+            key = spec.get("type", {})
+            key = key.get("key", {}) if isinstance(key, dict) else {}
+            if isinstance(key, dict) and key.get("refTable") == "Daemon":
+                system["row"][column] = ["set", [["named-uuid", "pmd"]]]
+        return [daemon, system]
+
+    def start_pmd(self):
+        cmd = [self.binary("ops-pmd"), self.db_sock,
+               "--unixctl=" + self.pmd_ctl,
+               "--subscribe=punix:" + os.path.join(self.workdir,
+                                                   "ops-pmd.sub"),
+               "--metrics=punix:" + self.metrics_sock,
+               "--shm-name=" + self.shm_name,
+               "--log-file=" + os.path.join(self.workdir, "ops-pmd.log"),
+               "-vconsole:off"]
+        start = time.time()
+        try:
+            self.pmd = subprocess.Popen(cmd)
+        except OSError as err:
+            raise BenchError("ops-pmd: {}".format(err))
+
+        def cur_hw():
+            if self.pmd.poll() is not None:
+                raise BenchError("ops-pmd exited with {}".format(
+                    self.pmd.returncode))
+            reply = self.transact(["OpenSwitch", {
+                "op": "select", "table": "Daemon",
+                "where": [["name", "==", DAEMON_NAME]],
+                "columns": ["cur_hw"]}])
+            rows = reply[0].get("rows", [])
+            return rows and rows[0]["cur_hw"] == 1
+
+        self.wait_for("cur_hw", cur_hw, self.args.timeout)
+        return (time.time() - start) * 1000
+
+    def stop(self):
+        if self.pmd is not None and self.pmd.poll() is None:
+            try:
+                self.appctl("exit")
+                self.pmd.wait()
+            except BenchError:
+                self.pmd.kill()
+        if self.pmd is not None:
+            try:
+                os.unlink("/dev/shm" + self.shm_name)
+            except OSError:
+                pass
+        if self.ovsdb is not None and self.ovsdb.poll() is None:
+            self.ovsdb.terminate()
+            self.ovsdb.wait()
+
+    def play(self, lines, wait=True):
+        """Play a scenario and, by default, wait until every event has run."""
+        path = os.path.join(self.workdir, "scenario")
+        with open(path, "w") as scenario:
+            scenario.write("\n".join(lines) + "\n")
+        self.appctl("ops-pmd/sim", "play", path, str(self.args.seed))
+        if not wait:
+            return
+        self.wait_for("the scenario",
+                      lambda: "state: done" in self.appctl("ops-pmd/sim",
+                                                           "play"),
+                      self.args.timeout)
+
+    def metrics(self):
+        """Scrape the metrics socket; counters summed over their labels."""
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(self.metrics_sock)
+        sock.sendall(b"GET /metrics HTTP/1.0\r\n\r\n")
+        text = b""
+        while True:
+            data = sock.recv(65536)
+            if not data:
+                break
+            text += data
+        sock.close()
+
+        values = {}
+        for line in text.decode("utf-8").splitlines():
+            if not line.startswith("ops_pmd_") or " " not in line:
+                continue
+            name, value = line.rsplit(" ", 1)
+            name = name.split("{", 1)[0]
+            try:
+                values[name] = values.get(name, 0) + float(value)
+            except ValueError:
+                pass
+        return values
+
+    def perf(self):
+        """ops-pmd/perf as {name: {count, mean, p50, p99, max}}, in usecs."""
+        perf = {}
+        for line in self.appctl("ops-pmd/perf").splitlines()[1:]:
+            fields = line.split()
+            if len(fields) == 6:
+                perf[fields[0]] = dict(zip(("count", "mean", "p50", "p99",
+                                            "max"),
+                                           [int(f) for f in fields[1:]]))
+            elif len(fields) == 2:
+                perf[fields[0]] = {"count": 0}
+        return perf
+
+    def process(self):
+        """CPU seconds used and memory of ops-pmd, from /proc."""
+        with open("/proc/{}/stat".format(self.pmd.pid)) as stat:
+            # fields after the command name, which may hold spaces
+            fields = stat.read().rsplit(")", 1)[1].split()
+        cpu = (int(fields[11]) + int(fields[12])) / float(
+            os.sysconf("SC_CLK_TCK"))
+
+        memory = {}
+        with open("/proc/{}/status".format(self.pmd.pid)) as status:
+            for line in status:
+                if line.startswith(("VmRSS:", "VmHWM:")):
+                    memory[line.split(":")[0]] = int(line.split()[1])
+        return cpu, memory
+
+
+def ranges(names):
+    """Interface names as the comma separated ranges of a scenario."""
+    numbers = sorted(int(name) for name in names)
+    parts = []
+    first = last = None
+    for number in numbers + [None]:
+        if last is not None and number == last + 1:
+            last = number
+            continue
+        if first is not None:
+            parts.append(str(first) if first == last else
+                         "{}..{}".format(first, last))
+        first = last = number
+    return ",".join(parts)
+
+
+def ports_by_connector(platform_dir):
+    ports = {}
+    with open(os.path.join(platform_dir, "ovsdb.json")) as rows:
+        for operation in json.load(rows)[1:]:
+            if operation["table"] != "Interface":
+                continue
+            info = dict(operation["row"]["hw_intf_info"][1])
+            ports.setdefault(info["connector"], []).append(
+                operation["row"]["name"])
+    return ports
+
+
+def insert_lines(bench, ports):
+    """Scenario lines inserting a module into every port at time 0."""
+    images = {"SFP_PLUS": bench.args.sfp_image,
+              "QSFP_PLUS": bench.args.qsfp_image,
+              "QSFP28": bench.args.qsfp_image}
+    return ["0 {} insert {}".format(ranges(names),
+                                    os.path.abspath(images[connector]))
+            for connector, names in sorted(ports.items())]
+
+
+def insert_all(bench, ports):
+    """Put a module in every port and wait until all are published."""
+    count = sum(len(names) for names in ports.values())
+
+    bench.appctl("ops-pmd/perf", "reset")
+    bench.play(insert_lines(bench, ports))
+    bench.wait_for("modules to be published", lambda: bench.perf().get(
+        "insert_to_commit", {}).get("count", 0) >= count, bench.args.timeout)
+
+
+def run_phase(bench, everyone, percent):
+    """Measure a steady state with percent of the modules walking."""
+    lines = ["0 {} dom walk=off".format(everyone)]
+    if percent > 0:
+        lines.append("0 {}{} dom walk=on".format(
+            "" if percent >= 100 else "{}% ".format(percent), everyone))
+    bench.play(lines)
+    time.sleep(bench.args.settle)
+
+    bench.appctl("ops-pmd/perf", "reset")
+    before = bench.metrics()
+    cpu_before, _ = bench.process()
+    db_before = os.path.getsize(bench.db_file)
+    start = time.time()
+
+    time.sleep(bench.args.duration)
+
+    elapsed = time.time() - start
+    after = bench.metrics()
+    cpu_after, memory = bench.process()
+    db_after = os.path.getsize(bench.db_file)
+    perf = bench.perf()
+
+    def delta(name):
+        return after.get(name, 0) - before.get(name, 0)
+
+    def per_minute(value):
+        return value * 60 / elapsed
+
+    ticks = delta("ops_pmd_loop_wakeups_total")
+    cpu = cpu_after - cpu_before
+    return {
+        "dom_change_percent": percent,
+        "seconds": round(elapsed, 3),
+        "loop_iterations": int(ticks),
+        "cpu_percent": round(cpu * 100 / elapsed, 2),
+        "cpu_usecs_per_iteration": round(cpu * 1e6 / ticks, 1) if ticks
+                                   else None,
+        "commit_usecs": dict((kind, perf.get(name, {"count": 0}))
+                             for kind, name in COMMITS),
+        "rss_kb": memory.get("VmRSS"),
+        "peak_rss_kb": memory.get("VmHWM"),
+        "txns_per_minute": round(per_minute(
+            delta("ops_pmd_ovsdb_txns_total")), 1),
+        "pm_info_bytes_per_minute": round(per_minute(
+            delta("ops_pmd_ovsdb_bytes_written_total")), 1),
+        "db_log_bytes_per_minute": round(per_minute(db_after - db_before), 1),
+    }
+
+
+def distribution(values):
+    """Count, percentiles and max of a list of numbers."""
+    values = sorted(values)
+    if not values:
+        return {"count": 0}
+
+    def percentile(percent):
+        return values[min(len(values) - 1, len(values) * percent // 100)]
+
+    return {"count": len(values), "min": values[0], "p50": percentile(50),
+            "p90": percentile(90), "p99": percentile(99), "max": values[-1]}
+
+
+def published(bench):
+    """Names of the interfaces whose module identity is in pm_info."""
+    reply = bench.transact(["OpenSwitch", {
+        "op": "select", "table": "Interface", "where": [],
+        "columns": ["name", "pm_info"]}])
+    return set(row["name"] for row in reply[0].get("rows", [])
+               if PUBLISHED_KEY in dict(row["pm_info"][1]))
+
+
+def run_storm(bench, ports):
+    """Insert a module into every port at once and time the publishing."""
+    count = sum(len(names) for names in ports.values())
+    done = {}
+    unixctl = []
+    rounds = []
+
+    bench.appctl("ops-pmd/perf", "reset")
+    start = time.time()
+    bench.play(insert_lines(bench, ports), wait=False)
+
+    while len(done) < count:
+        if time.time() - start > bench.args.timeout:
+            raise BenchError("timed out with {} of {} ports published".format(
+                len(done), count))
+
+        # a command that does no work measures how long the loop keeps
+        # the control socket waiting
+        sent = time.time()
+        bench.appctl("version")
+        unixctl.append(round((time.time() - sent) * 1000, 1))
+
+        # each round forks two clients and reads every row's pm_info, so a
+        # completion time is only known to within a round and its sleep
+        now = round((time.time() - start) * 1000, 1)
+        for name in published(bench) - set(done):
+            done[name] = now
+        rounds.append(round((time.time() - sent) * 1000, 1))
+        time.sleep(STORM_POLL_SECS)
+
+    perf = bench.perf()
+    _, memory = bench.process()
+    return {
+        "ports": count,
+        "read_path": "serial",
+        "poll_msecs": STORM_POLL_SECS * 1000,
+        "poll_round_msecs": distribution(rounds),
+        "all_published_msecs": max(done.values()),
+        "published_msecs": distribution(list(done.values())),
+        "insert_to_commit_usecs": perf.get("insert_to_commit",
+                                           {"count": 0}),
+        "loop_iteration_usecs": perf.get("loop_busy", {"count": 0}),
+        "unixctl_msecs": distribution(unixctl),
+        "peak_rss_kb": memory.get("VmHWM"),
+    }
+
+
+def parse_percents(text):
+    try:
+        percents = [int(percent) for percent in text.split(",")]
+    except ValueError:
+        percents = []
+    if not percents or min(percents) < 0 or max(percents) > 100:
+        raise argparse.ArgumentTypeError(
+            "expected percentages from 0 to 100, e.g. 0,10,100")
+    return percents
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Benchmark ops-pmd end to end against a local "
+        "ovsdb-server.")
+    parser.add_argument("--schema", required=True,
+                        help="OpenSwitch schema (vswitch.ovsschema)")
+    parser.add_argument("--bin-dir",
+                        help="where ops-pmd and the ovsdb tools are")
+    parser.add_argument("-s", "--subsystems", type=int, default=1,
+                        help="number of subsystems (line cards)")
+    parser.add_argument("-p", "--ports", type=int, default=48,
+                        help="pluggable ports per subsystem")
+    parser.add_argument("--mix", default="8,1,1",
+                        help="SFP+,QSFP+,QSFP28 weights (default 8,1,1)")
+    parser.add_argument("--dom-change", type=parse_percents, default=[0, 100],
+                        help="percentages of modules whose DOM values "
+                        "change, one phase each (default 0,100)")
+    parser.add_argument("--storm", action="store_true",
+                        help="measure an insertion storm instead of the "
+                        "steady state")
+    parser.add_argument("--duration", type=float, default=60,
+                        help="seconds measured per phase (default 60)")
+    parser.add_argument("--settle", type=float, default=10,
+                        help="seconds to wait before measuring a phase "
+                        "(default 10)")
+    parser.add_argument("--timeout", type=float, default=120,
+                        help="seconds to wait for the daemon at each step "
+                        "(default 120)")
+    parser.add_argument("--sfp-image",
+                        default=os.path.join(FILES_DIR, "SFP_SR_AVAGO.bin"),
+                        help="EEPROM image inserted into SFP+ ports")
+    parser.add_argument("--qsfp-image",
+                        default=os.path.join(FILES_DIR, "QSFP_SR4_AVAGO.bin"),
+                        help="EEPROM image inserted into QSFP ports")
+    parser.add_argument("--seed", type=int, default=1,
+                        help="seed of the simulation (default 1)")
+    parser.add_argument("--workdir",
+                        help="work directory, kept (default: a temporary "
+                        "one, removed)")
+    parser.add_argument("-o", "--output", help="write the results here")
+    args = parser.parse_args()
+
+    workdir = args.workdir or tempfile.mkdtemp(prefix="pmd-bench-")
+    if not os.path.isdir(workdir):
+        os.makedirs(workdir)
+    platform_dir = os.path.join(workdir, "platform")
+    bench = Bench(args, workdir)
+
+    try:
+        subprocess.check_call([sys.executable,
+                               os.path.join(TOOLS_DIR, "pmd_gen_platform.py"),
+                               platform_dir, "-s", str(args.subsystems),
+                               "-p", str(args.ports), "--mix", args.mix],
+                              stdout=open(os.devnull, "w"))
+        ports = ports_by_connector(platform_dir)
+        everyone = ranges(sum(ports.values(), []))
+
+        bench.start_ovsdb(platform_dir)
+        results = {
+            "format": 2,
+            "time": time.strftime("%Y-%m-%dT%H:%M:%SZ", time.gmtime()),
+            "host": {"machine": platform.machine(),
+                     "cpus": os.sysconf("SC_NPROCESSORS_ONLN")},
+            "version": bench.run("ops-pmd", "--version").splitlines()[0],
+            "platform": {"subsystems": args.subsystems,
+                         "ports": args.ports, "mix": args.mix,
+                         "connectors": dict((connector, len(names))
+                                            for connector, names
+                                            in ports.items())},
+            "cur_hw_msecs": round(bench.start_pmd(), 1),
+        }
+
+        try:
+            bench.appctl("ops-pmd/sim", "play")
+        except BenchError:
+            raise BenchError("ops-pmd is not a simulation build "
+                             "(no ops-pmd/sim command)")
+        if args.storm:
+            results["storm"] = run_storm(bench, ports)
+        else:
+            insert_all(bench, ports)
+            results["phases"] = [run_phase(bench, everyone, percent)
+                                 for percent in args.dom_change]
+    except BenchError as err:
+        print("pmd_bench_daemon: {} (logs in {})".format(err, workdir),
+              file=sys.stderr)
+        bench.stop()
+        return 1
+
+    bench.stop()
+    if not args.workdir:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    output = open(args.output, "w") if args.output else sys.stdout
+    json.dump(results, output, indent=1, sort_keys=True)
+    output.write("\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
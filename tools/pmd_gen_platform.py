@@ -0,0 +1,247 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+#  (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+#
+#  Licensed under the Apache License, Version 2.0 (the "License"); you may
+#  not use this file except in compliance with the License. You may obtain
+#  a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+#  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+#  License for the specific language governing permissions and limitations
+#  under the License.
+
+"""
+Generate a synthetic platform for ops-pmd scaling tests.
+
+For N subsystems of M pluggable ports each, this writes:
+
+    <outdir>/<subsystem>/devices.yaml   buses and devices (config-yaml)
+    <outdir>/<subsystem>/ports.yaml     ports, module EEPROMs and signals
+    <outdir>/ovsdb.json                 Subsystem and Interface rows
+
+Ports of each subsystem are SFP+, QSFP+ and QSFP28, in blocks sized by
+--mix. Every port has its own EEPROM bus, the way modules sit behind I2C
+mux channels; presence and reset/TX disable bits live in CPLDs of 32 ports
+each. Interface names are numbers, continuing across subsystems, so that
+"ops-pmd/sim play" ranges (1..1024) cover every port.
+
+Load the rows with:
+
+    ovsdb-client transact "$(cat <outdir>/ovsdb.json)"
+
+on a simulation image, after copying the subsystem directories to
+--hw-desc-root on the target. Then use "ops-pmd/sim" or a scenario to
+insert modules.
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import sys
+
+# connector, max speed, speeds and the module_signals keys of each type
+PORT_TYPES = [
+    ("SFP_PLUS", 10000, [1000, 10000],
+     "sfpp_mod_present", "sfpp_tx_disable"),
+    ("QSFP_PLUS", 40000, [10000, 40000],
+     "qsfpp_mod_present", "qsfpp_reset"),
+    ("QSFP28", 100000, [25000, 40000, 50000, 100000],
+     "qsfp28p_mod_present", "qsfp28p_reset"),
+]
+
+PORTS_PER_CPLD = 32
+CPLD_ADDRESS = 0x60
+EEPROM_ADDRESS = 0x50
+PRESENT_REGISTER = 0x10
+CONTROL_REGISTER = 0x20
+
+
+def split_ports(count, weights):
+    """Split count ports by weight, largest remainders first."""
+    total = sum(weights)
+    shares = [count * weight // total for weight in weights]
+    order = sorted(range(len(weights)),
+                   key=lambda idx: (count * weights[idx]) % total,
+                   reverse=True)
+    for idx in order[:count - sum(shares)]:
+        shares[idx] += 1
+    return shares
+
+
+def signal(device, register, index, negative):
+    return ("{{device: {}, register_address: 0x{:02x}, register_size: 8, "
+            "bit_mask: 0x{:02x}, negative_polarity: {}}}"
+            "".format(device, register + index // 8, 1 << (index % 8),
+                      "true" if negative else "false"))
+
+
+def write_subsystem(path, subsystem, ports):
+    """Write devices.yaml and ports.yaml for one subsystem.
+
+    ports is a list of (interface name, port type) pairs.
+    """
+    cplds = (len(ports) + PORTS_PER_CPLD - 1) // PORTS_PER_CPLD
+    bus = 0
+
+    with open(os.path.join(path, "devices.yaml"), "w") as devices:
+        devices.write("---\n# generated by pmd_gen_platform.py\n")
+        devices.write("version: '0.1'\n\nbuses:\n")
+        for each in range(cplds + len(ports)):
+            if each < cplds:
+                name = "{}_cpld{}_bus".format(subsystem, each)
+            else:
+                name = "{}_port{}_bus".format(subsystem,
+                                              ports[each - cplds][0])
+            devices.write("  - name: {}\n    devname: /dev/i2c-{}\n"
+                          "".format(name, bus))
+            bus += 1
+
+        devices.write("\ndevices:\n")
+        for each in range(cplds):
+            devices.write("  - name: {0}_cpld{1}\n"
+                          "    bus: {0}_cpld{1}_bus\n"
+                          "    dev_type: cpld\n"
+                          "    address: 0x{2:02x}\n"
+                          "".format(subsystem, each, CPLD_ADDRESS))
+        for name, _ in ports:
+            devices.write("  - name: {0}_port{1}_eeprom\n"
+                          "    bus: {0}_port{1}_bus\n"
+                          "    dev_type: pluggable\n"
+                          "    address: 0x{2:02x}\n"
+                          "".format(subsystem, name, EEPROM_ADDRESS))
+
+    with open(os.path.join(path, "ports.yaml"), "w") as yaml:
+        yaml.write("---\n# generated by pmd_gen_platform.py\n")
+        yaml.write("version: '0.1'\n\nports:\n")
+        for index, (name, port_type) in enumerate(ports):
+            connector, max_speed, speeds, present, control = port_type
+            cpld = "{}_cpld{}".format(subsystem, index // PORTS_PER_CPLD)
+            bit = index % PORTS_PER_CPLD
+
+            yaml.write("  - name: '{}'\n".format(name))
+            yaml.write("    pluggable: true\n")
+            yaml.write("    connector: {}\n".format(connector))
+            yaml.write("    max_speed: {}\n".format(max_speed))
+            yaml.write("    speeds: [{}]\n".format(
+                ", ".join(str(speed) for speed in speeds)))
+            yaml.write("    module_eeprom: {}_port{}_eeprom\n"
+                       "".format(subsystem, name))
+            yaml.write("    module_signals:\n")
+            # presence is active low, as on most CPLDs
+            yaml.write("      {}: {}\n".format(
+                present, signal(cpld, PRESENT_REGISTER, bit, True)))
+            yaml.write("      {}: {}\n".format(
+                control, signal(cpld, CONTROL_REGISTER, bit, False)))
+
+
+def ovsdb_rows(subsystems, hw_desc_root):
+    """Build the transaction inserting the Subsystem and Interface rows."""
+    operations = ["OpenSwitch"]
+
+    for subsystem, ports in subsystems:
+        refs = []
+        for name, port_type in ports:
+            uuid_name = "intf{}".format(name)
+            refs.append(["named-uuid", uuid_name])
+            operations.append({
+                "op": "insert",
+                "table": "Interface",
+                "uuid-name": uuid_name,
+                "row": {
+                    "name": name,
+                    "type": "system",
+                    "hw_intf_info": ["map", [
+                        ["pluggable", "true"],
+                        ["connector", port_type[0]],
+                        ["max_speed", str(port_type[1])],
+                    ]],
+                    "hw_intf_config": ["map", [["enable", "true"]]],
+                },
+            })
+        operations.append({
+            "op": "insert",
+            "table": "Subsystem",
+            "row": {
+                "name": subsystem,
+                "hw_desc_dir": os.path.join(hw_desc_root, subsystem),
+                "interfaces": ["set", refs],
+            },
+        })
+
+    return operations
+
+
+def parse_mix(text):
+    try:
+        weights = [int(weight) for weight in text.split(",")]
+    except ValueError:
+        weights = []
+    if (len(weights) != len(PORT_TYPES) or min(weights) < 0 or
+            sum(weights) == 0):
+        raise argparse.ArgumentTypeError(
+            "expected {} weights, e.g. 8,1,1".format(len(PORT_TYPES)))
+    return weights
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generate a synthetic platform for ops-pmd scaling tests.")
+    parser.add_argument("outdir", help="directory to write the platform to")
+    parser.add_argument("-s", "--subsystems", type=int, default=1,
+                        help="number of subsystems (line cards)")
+    parser.add_argument("-p", "--ports", type=int, default=48,
+                        help="pluggable ports per subsystem")
+    parser.add_argument("--mix", type=parse_mix, default=[8, 1, 1],
+                        help="SFP+,QSFP+,QSFP28 weights (default 8,1,1)")
+    parser.add_argument("--prefix", default="lc",
+                        help="subsystem name prefix (default lc)")
+    parser.add_argument("--first-port", type=int, default=1,
+                        help="number of the first interface (default 1)")
+    parser.add_argument("--hw-desc-root",
+                        help="where the subsystem directories are on the "
+                        "target (default outdir)")
+    args = parser.parse_args()
+
+    if args.subsystems < 1 or args.ports < 1:
+        parser.error("need at least one subsystem and one port")
+
+    hw_desc_root = args.hw_desc_root or os.path.abspath(args.outdir)
+    shares = split_ports(args.ports, args.mix)
+    number = args.first_port
+    subsystems = []
+
+    for each in range(args.subsystems):
+        subsystem = "{}{}".format(args.prefix, each + 1)
+        path = os.path.join(args.outdir, subsystem)
+        ports = []
+
+        for port_type, share in zip(PORT_TYPES, shares):
+            for _ in range(share):
+                ports.append((str(number), port_type))
+                number += 1
+
+        if not os.path.isdir(path):
+            os.makedirs(path)
+        write_subsystem(path, subsystem, ports)
+        subsystems.append((subsystem, ports))
+
+    with open(os.path.join(args.outdir, "ovsdb.json"), "w") as rows:
+        json.dump(ovsdb_rows(subsystems, hw_desc_root), rows, indent=1)
+        rows.write("\n")
+
+    print("{} subsystems x {} ports ({} SFP+, {} QSFP+, {} QSFP28 each): "
+          "interfaces {}..{}".format(args.subsystems, args.ports,
+                                     shares[0], shares[1], shares[2],
+                                     args.first_port, number - 1))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())